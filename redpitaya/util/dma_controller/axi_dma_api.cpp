@@ -11,8 +11,15 @@
 // =================================================================================
 #include "axi_dma_api.h"
 #include "axi_dma_controller.hpp"
+#include "axi_dma_backend.hpp"
+#include "axi_dma_emulator.hpp"
+#include "axi_dma_rt.hpp"
 #include <iostream>
 
+// DmaBlock_t is handed straight to the C++ batch API
+static_assert(sizeof(DmaBlock_t) == sizeof(AxiDmaController::DmaBlock), "DmaBlock_t layout mismatch");
+static_assert(DMA_ERR_HALTED == AxiDmaController::DMA_ERROR, "DMA_ERR_HALTED mismatch");
+
 extern "C" {
 
 AxiDmaHandle_t dma_create(uint64_t dma_phys_addr, uint64_t mem_phys_addr, uint64_t mem_size) {
@@ -33,7 +40,26 @@ AxiDmaHandle_t dma_create_irq(uint64_t dma_phys_addr, uint64_t mem_phys_addr, ui
     }
 }
 
+AxiDmaHandle_t dma_create_udmabuf(uint64_t dma_phys_addr, const char* udmabuf_name, const char* uio_mm2s, const char* uio_s2mm) {
+    if (!udmabuf_name) return nullptr;
+    try {
+        if (uio_mm2s && uio_s2mm)
+            return new AxiDmaController(new UdmabufBackend(dma_phys_addr, udmabuf_name, uio_mm2s, uio_s2mm));
+        return new AxiDmaController(new UdmabufBackend(dma_phys_addr, udmabuf_name));
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Creation Failed: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
 
+AxiDmaHandle_t dma_create_emulated(uint64_t mem_size, int use_irq) {
+    try {
+        return new AxiDmaController(new AxiDmaEmulator(mem_size, use_irq != 0));
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Creation Failed: " << e.what() << std::endl;
+        return nullptr;
+    }
+}
 
 void dma_destroy(AxiDmaHandle_t handle) {
     if (handle) {
@@ -48,12 +74,18 @@ void dma_reset(AxiDmaHandle_t handle) {
     }
 }
 
+static AxiDmaController::DmaMode to_cpp_mode(DmaMode_e mode) {
+    switch (mode) {
+    case DMA_MODE_SG: return AxiDmaController::DmaMode::SCATTER_GATHER;
+    case DMA_MODE_CYCLIC: return AxiDmaController::DmaMode::CYCLIC;
+    default: return AxiDmaController::DmaMode::UNINITIALIZED;
+    }
+}
+
 int dma_init_channel(AxiDmaHandle_t handle, DmaMode_e mode_mm2s, DmaMode_e mode_s2mm, uint32_t num_bds, uint32_t buffer_size) {
     if (!handle) return -1;
     try {
-        AxiDmaController::DmaMode cpp_mode_mm2s = (mode_mm2s == DMA_MODE_SG) ? AxiDmaController::DmaMode::SCATTER_GATHER : AxiDmaController::DmaMode::CYCLIC;
-        AxiDmaController::DmaMode cpp_mode_s2mm = (mode_s2mm == DMA_MODE_SG) ? AxiDmaController::DmaMode::SCATTER_GATHER : AxiDmaController::DmaMode::CYCLIC;
-        handle->initSG(cpp_mode_mm2s, cpp_mode_s2mm, num_bds, buffer_size);
+        handle->initSG(to_cpp_mode(mode_mm2s), to_cpp_mode(mode_s2mm), num_bds, buffer_size);
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "DMA Channel Init Failed: " << e.what() << std::endl;
@@ -61,6 +93,36 @@ int dma_init_channel(AxiDmaHandle_t handle, DmaMode_e mode_mm2s, DmaMode_e mode_
     }
 }
 
+int dma_init_layout(AxiDmaHandle_t handle, const DmaLayout_t* layout) {
+    if (!handle || !layout) return -1;
+    try {
+        AxiDmaController::SgLayout cpp_layout;
+        cpp_layout.mode_mm2s = to_cpp_mode(layout->mode_mm2s);
+        cpp_layout.mode_s2mm = to_cpp_mode(layout->mode_s2mm);
+        cpp_layout.tx_num_bds = layout->tx_num_bds;
+        cpp_layout.tx_buffer_size = layout->tx_buffer_size;
+        cpp_layout.rx_num_bds = layout->rx_num_bds;
+        cpp_layout.rx_buffer_size = layout->rx_buffer_size;
+        cpp_layout.tx_fraction = layout->tx_fraction;
+        handle->initSG(cpp_layout);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Channel Init Failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_init_rx_only(AxiDmaHandle_t handle, DmaMode_e mode_s2mm, uint32_t num_bds, uint32_t buffer_size) {
+    DmaLayout_t layout;
+    layout.mode_mm2s = DMA_MODE_DISABLED;
+    layout.mode_s2mm = mode_s2mm;
+    layout.tx_num_bds = layout.tx_buffer_size = 0;
+    layout.rx_num_bds = num_bds;
+    layout.rx_buffer_size = buffer_size;
+    layout.tx_fraction = 0;
+    return dma_init_layout(handle, &layout);
+}
+
 void dma_start(AxiDmaHandle_t handle, DmaDirection_e dir) {
     if (handle) {
         AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
@@ -68,6 +130,97 @@ void dma_start(AxiDmaHandle_t handle, DmaDirection_e dir) {
     }
 }
 
+int dma_set_coalescing(AxiDmaHandle_t handle, DmaDirection_e dir, uint32_t threshold, uint32_t delay) {
+    if (!handle || threshold < 1 || threshold > 255 || delay > 255) return -1;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    handle->setCoalescing(cpp_dir, (uint8_t)threshold, (uint8_t)delay);
+    return 0;
+}
+
+int dma_set_wait_mode(AxiDmaHandle_t handle, DmaWaitMode_e mode, uint32_t spin_iterations, uint32_t spin_us) {
+    if (!handle) return -1;
+    try {
+        AxiDmaController::DmaWaitMode cpp_mode = (mode == DMA_WAIT_POLL) ? AxiDmaController::DmaWaitMode::WAIT_POLL
+                                               : (mode == DMA_WAIT_IRQ)  ? AxiDmaController::DmaWaitMode::WAIT_IRQ
+                                                                         : AxiDmaController::DmaWaitMode::WAIT_HYBRID;
+        handle->setWaitMode(cpp_mode);
+        handle->setSpinBudget(spin_iterations, spin_us);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Set Wait Mode Failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_get_stats(AxiDmaHandle_t handle, DmaDirection_e dir, DmaStats_t* stats) {
+    if (!handle || !stats) return -1;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    AxiDmaController::ChannelStats s = handle->getStats(cpp_dir);
+    stats->bytes = s.bytes;
+    stats->blocks = s.blocks;
+    stats->irqs = s.irqs;
+    stats->spurious_wakeups = s.spurious_wakeups;
+    stats->occupancy_hwm = s.occupancy_hwm;
+    stats->ring_full_count = s.ring_full_count;
+    stats->ring_full_ns = s.ring_full_ns;
+    stats->error_bits = s.error_bits;
+    stats->error_reads = s.error_reads;
+    return 0;
+}
+
+void dma_reset_stats(AxiDmaHandle_t handle, DmaDirection_e dir) {
+    if (handle) {
+        AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+        handle->resetStats(cpp_dir);
+    }
+}
+
+int dma_dump_trace(AxiDmaHandle_t handle, const char* path) {
+    if (!handle || !path) return -1;
+    try {
+        return (int)handle->dumpTrace(path);
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Trace Dump Failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+uint32_t dma_get_errors(AxiDmaHandle_t handle, DmaDirection_e dir) {
+    if (!handle) return 0;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    return handle->getDmaErrors(cpp_dir);
+}
+
+int dma_recover(AxiDmaHandle_t handle) {
+    if (!handle) return -1;
+    try {
+        return handle->recover();
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Recover Failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_enter_realtime(AxiDmaHandle_t handle, int cpu, int priority, int lock_memory) {
+    if (!handle) return -1;
+    try {
+        AxiDmaController::RealtimeConfig config;
+        config.lock_memory = lock_memory != 0;
+        config.cpu = cpu;
+        config.priority = priority;
+        handle->enterRealtime(config);
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << "DMA Enter Realtime Failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_check_cpu_isolation(int cpu) {
+    axi_dma_rt::CpuIsolation info = axi_dma_rt::cpuIsolation(cpu);
+    return (info.isolated ? 1 : 0) | (info.nohz_full ? 2 : 0) | (info.rcu_nocbs ? 4 : 0);
+}
+
 int dma_simple_transmit(AxiDmaHandle_t handle, uint64_t tx_addr, uint32_t len) {
     if (!handle) return -1;
     try {
@@ -112,6 +265,44 @@ int dma_get_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir, void** da
     }
 }
 
+int dma_get_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, DmaBlock_t* blocks, uint32_t max_blocks) {
+    if (!handle || !blocks || dir != DMA_RECEIVE) return -1;
+    try {
+        return handle->sgReceiveBatch(reinterpret_cast<AxiDmaController::DmaBlock*>(blocks), max_blocks);
+    } catch (const std::exception& e) {
+        std::cerr << "DMA get blocks failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_try_get_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir, void** data_ptr, uint32_t* len) {
+    if (!handle || !data_ptr || !len || dir != DMA_RECEIVE) return -1;
+    return handle->tryReceive(data_ptr, len);
+}
+
+int dma_try_get_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, DmaBlock_t* blocks, uint32_t max_blocks) {
+    if (!handle || !blocks || dir != DMA_RECEIVE) return -1;
+    return handle->tryReceiveBatch(reinterpret_cast<AxiDmaController::DmaBlock*>(blocks), max_blocks);
+}
+
+int dma_get_fd(AxiDmaHandle_t handle, DmaDirection_e dir) {
+    if (!handle) return -1;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    return handle->getIrqFd(cpp_dir);
+}
+
+int dma_arm_irq(AxiDmaHandle_t handle, DmaDirection_e dir) {
+    if (!handle) return -1;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    return handle->armIrq(cpp_dir);
+}
+
+int dma_consume_irq(AxiDmaHandle_t handle, DmaDirection_e dir) {
+    if (!handle) return -1;
+    AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+    return handle->consumeIrq(cpp_dir);
+}
+
 void dma_release_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir) {
     if (handle) {
         AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
@@ -119,6 +310,55 @@ void dma_release_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir) {
     }
 }
 
+void dma_release_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, uint32_t n) {
+    if (handle) {
+        AxiDmaController::DmaDirection cpp_dir = (dir == DMA_TRANSMIT) ? AxiDmaController::DmaDirection::TRANSMIT : AxiDmaController::DmaDirection::RECEIVE;
+        handle->releaseBlocks(cpp_dir, n);
+    }
+}
+
+int dma_claim_block(AxiDmaHandle_t handle, DmaBlock_t* block, uint32_t* id, int wait) {
+    if (!handle || !block || !id) return -1;
+    AxiDmaController::DmaBlock* cpp_block = reinterpret_cast<AxiDmaController::DmaBlock*>(block);
+    try {
+        return wait ? handle->claimBlockWait(cpp_block, id) : handle->claimBlock(cpp_block, id);
+    } catch (const std::exception& e) {
+        std::cerr << "DMA claim block failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+void dma_release_claimed_block(AxiDmaHandle_t handle, uint32_t id) {
+    if (handle) {
+        handle->releaseClaimed(id);
+    }
+}
+
+int dma_cyclic_receive(AxiDmaHandle_t handle, DmaBlock_t* block, int wait) {
+    if (!handle || !block) return -1;
+    try {
+        return handle->cyclicReceive(reinterpret_cast<AxiDmaController::DmaBlock*>(block), wait != 0);
+    } catch (const std::exception& e) {
+        std::cerr << "DMA cyclic receive failed: " << e.what() << std::endl;
+        return -1;
+    }
+}
+
+int dma_cyclic_release(AxiDmaHandle_t handle) {
+    if (!handle) return -1;
+    return handle->cyclicRelease();
+}
+
+int dma_get_cyclic_stats(AxiDmaHandle_t handle, DmaCyclicStats_t* stats) {
+    if (!handle || !stats) return -1;
+    AxiDmaController::CyclicStats s = handle->getCyclicStats();
+    stats->blocks = s.blocks;
+    stats->overruns = s.overruns;
+    stats->blocks_lost = s.blocks_lost;
+    stats->blocks_corrupted = s.blocks_corrupted;
+    return 0;
+}
+
 int dma_submit_transmit_block(AxiDmaHandle_t handle, const void* data_ptr, uint32_t len) {
     if (!handle) return -1;
     try {
@@ -129,6 +369,25 @@ int dma_submit_transmit_block(AxiDmaHandle_t handle, const void* data_ptr, uint3
     }
 }
 
+void* dma_acquire_transmit_buffer(AxiDmaHandle_t handle, uint32_t offset, uint32_t* capacity) {
+    if (!handle) return nullptr;
+    void* buf = nullptr;
+    if (handle->acquireTransmitBuffer(&buf, capacity, offset) <= 0)
+        return nullptr;
+    return buf;
+}
+
+int dma_commit_transmit_blocks(AxiDmaHandle_t handle, const uint32_t* lens, uint32_t n, int sof, int eof) {
+    if (!handle || !lens) return -1;
+    return handle->commitTransmitBlocks(lens, n, sof != 0, eof != 0);
+}
+
+void dma_flush_transmit(AxiDmaHandle_t handle) {
+    if (handle) {
+        handle->flushTransmit();
+    }
+}
+
 
 int dma_wait_for_transmit_completion_sg(AxiDmaHandle_t handle) {
     if (!handle) return -1;
@@ -28,9 +28,34 @@ typedef enum {
 
 typedef enum {
     DMA_MODE_SG,
-    DMA_MODE_CYCLIC
+    DMA_MODE_CYCLIC,
+    DMA_MODE_DISABLED  // Channel not used, e.g. MM2S in RX-only readout
 } DmaMode_e;
 
+typedef enum {
+    DMA_WAIT_POLL,   // Busy-spin on the descriptor status
+    DMA_WAIT_IRQ,    // Block on the UIO interrupt
+    DMA_WAIT_HYBRID  // Spin for a bounded budget, then block on the UIO interrupt
+} DmaWaitMode_e;
+
+// Returned by the blocking SG receive/transmit calls and dma_arm_irq when the
+// channel halted on a DMA error, see dma_get_errors and dma_recover
+#define DMA_ERR_HALTED (-2)
+
+// DMASR error bits reported by dma_get_errors
+#define DMA_ERR_DMA_INTERNAL 0x010  // DMAIntErr: e.g. a BD with length 0
+#define DMA_ERR_DMA_SLAVE    0x020  // DMASlvErr: slave error on a data transfer
+#define DMA_ERR_DMA_DECODE   0x040  // DMADecErr: invalid data buffer address
+#define DMA_ERR_SG_INTERNAL  0x100  // SGIntErr: fetched a BD that was already complete
+#define DMA_ERR_SG_SLAVE     0x200  // SGSlvErr: slave error on a BD fetch
+#define DMA_ERR_SG_DECODE    0x400  // SGDecErr: invalid BD address
+
+// A completed data block: address in the mapped DMA buffer and length in bytes
+typedef struct {
+    void* data;
+    uint32_t len;
+} DmaBlock_t;
+
 
 /**
  * @brief Creates and initializes a DMA controller instance.
@@ -54,6 +79,27 @@ AxiDmaHandle_t dma_create(uint64_t dma_phys_addr, uint64_t mem_phys_addr, uint64
  */
 AxiDmaHandle_t dma_create_irq(uint64_t dma_phys_addr, uint64_t mem_phys_addr, uint64_t mem_size, const char* uio_mm2s, const char* uio_s2mm);
 
+/**
+ * @brief Creates a DMA controller whose buffers live in a u-dma-buf device, mapped cacheable.
+ * Buffer descriptors stay uncached; data buffers are synced with sync_for_cpu/sync_for_device
+ * by the receive/release/transmit calls, so the CPU reads received data through the cache.
+ * @param dma_phys_addr Physical base address of the AXI DMA's control registers.
+ * @param udmabuf_name Name of the u-dma-buf device, e.g., "udmabuf0" (for /dev/udmabuf0).
+ * @param uio_mm2s Path to the UIO device for uio_mm2s, or NULL to poll.
+ * @param uio_s2mm Path to the UIO device for uio_s2mm, or NULL to poll.
+ * @return A handle to the DMA controller, or NULL on failure.
+ */
+AxiDmaHandle_t dma_create_udmabuf(uint64_t dma_phys_addr, const char* udmabuf_name, const char* uio_mm2s, const char* uio_s2mm);
+
+/**
+ * @brief Creates a DMA controller on the software AXI DMA emulator instead of the hardware.
+ * The emulated MM2S channel is looped back into S2MM, like the FPGA loopback design.
+ * @param mem_size Size of the emulated reserved memory region.
+ * @param use_irq Non-zero to emulate the UIO interrupts (eventfd), zero to poll.
+ * @return A handle to the DMA controller, or NULL on failure.
+ */
+AxiDmaHandle_t dma_create_emulated(uint64_t mem_size, int use_irq);
+
 /**
  * @brief Destroys a DMA controller instance and releases all resources.
  * @param handle The handle returned by dma_create.
@@ -71,13 +117,47 @@ void dma_reset(AxiDmaHandle_t handle);
  * @brief Initializes a DMA channel for Scatter-Gather or Cyclic mode.
  * @param handle The DMA handle.
  * @param dir The direction (DMA_TRANSMIT or DMA_RECEIVE).
- * @param mode The mode (DMA_MODE_SG or DMA_MODE_CYCLIC).
+ * @param mode The mode (DMA_MODE_SG or DMA_MODE_CYCLIC, or DMA_MODE_DISABLED to leave a channel unused).
  * @param num_bds The number of buffer descriptors to create in the ring.
  * @param buffer_size The size of each data buffer associated with a descriptor.
  * @return 0 on success, -1 on failure.
  */
 int dma_init_channel(AxiDmaHandle_t handle, DmaMode_e mode_mm2s, DmaMode_e mode_s2mm, uint32_t num_bds, uint32_t buffer_size);
 
+/**
+ * @brief Memory layout for dma_init_layout.
+ * The reserved region is split at tx_fraction into an MM2S and an S2MM part, each holding
+ * its BD ring followed by its buffers. A DMA_MODE_DISABLED channel gets no memory.
+ */
+typedef struct {
+    DmaMode_e mode_mm2s;
+    DmaMode_e mode_s2mm;
+    uint32_t tx_num_bds;
+    uint32_t tx_buffer_size;
+    uint32_t rx_num_bds;
+    uint32_t rx_buffer_size;
+    double tx_fraction;   // Share of the region for MM2S, in (0, 1) when both channels are used
+} DmaLayout_t;
+
+/**
+ * @brief Initializes the channels with per-direction ring sizes and an explicit memory split.
+ * The layout is validated: each ring (BD area sized from its BD count, plus buffers) must fit in its partition.
+ * @param handle The DMA handle.
+ * @param layout The layout.
+ * @return 0 on success, -1 on failure (invalid layout).
+ */
+int dma_init_layout(AxiDmaHandle_t handle, const DmaLayout_t* layout);
+
+/**
+ * @brief Initializes an RX-only readout: the whole region goes to the S2MM ring, MM2S is not set up.
+ * @param handle The DMA handle.
+ * @param mode_s2mm The receive mode (DMA_MODE_SG or DMA_MODE_CYCLIC).
+ * @param num_bds The number of buffer descriptors in the receive ring.
+ * @param buffer_size The size of each receive buffer.
+ * @return 0 on success, -1 on failure (invalid layout).
+ */
+int dma_init_rx_only(AxiDmaHandle_t handle, DmaMode_e mode_s2mm, uint32_t num_bds, uint32_t buffer_size);
+
 /**
  * @brief Starts a DMA channel.
  * @param handle The DMA handle.
@@ -85,6 +165,120 @@ int dma_init_channel(AxiDmaHandle_t handle, DmaMode_e mode_mm2s, DmaMode_e mode_
  */
 void dma_start(AxiDmaHandle_t handle, DmaDirection_e dir);
 
+/**
+ * @brief Configures interrupt coalescing (DMACR IRQThreshold / IRQDelay) for a channel.
+ * The channel then interrupts once per `threshold` completed packets, or when the
+ * delay timer expires `delay` periods after the last packet. Use a non-zero delay
+ * with threshold > 1 so the tail of a burst is still delivered at low rates.
+ * Takes effect immediately on a running channel, otherwise at dma_start.
+ * @param handle The DMA handle.
+ * @param dir The direction to configure.
+ * @param threshold Packets per interrupt, 1-255.
+ * @param delay Delay timeout in timer periods, 0-255 (0 disables the delay interrupt).
+ * @return 0 on success, -1 on failure.
+ */
+int dma_set_coalescing(AxiDmaHandle_t handle, DmaDirection_e dir, uint32_t threshold, uint32_t delay);
+
+/**
+ * @brief Selects how the SG receive/transmit calls wait for a descriptor to complete.
+ * In DMA_WAIT_HYBRID mode the call first spins on the descriptor's completion bit
+ * for at most spin_iterations reads or spin_us microseconds (0 = no limit on that
+ * dimension, both 0 = no spinning) and only then arms and blocks on the UIO device.
+ * In all modes no syscall is made when the descriptor is already complete.
+ * @param handle The DMA handle.
+ * @param mode The wait mode. DMA_WAIT_IRQ and DMA_WAIT_HYBRID need UIO devices.
+ * @param spin_iterations Spin budget in status reads (DMA_WAIT_HYBRID only).
+ * @param spin_us Spin budget in microseconds (DMA_WAIT_HYBRID only).
+ * @return 0 on success, -1 on failure.
+ */
+int dma_set_wait_mode(AxiDmaHandle_t handle, DmaWaitMode_e mode, uint32_t spin_iterations, uint32_t spin_us);
+
+/**
+ * @brief Per-direction counters, see dma_get_stats.
+ * Occupancy and ring-full time count the BDs held back from the DMA: receive blocks completed
+ * and not yet released, transmit blocks committed and not yet reclaimed. A receive ring that
+ * stays full means the FPGA FIFO is filling up.
+ */
+typedef struct {
+    uint64_t bytes;             // Payload received or committed for transmit
+    uint64_t blocks;
+    uint64_t irqs;              // Interrupts taken
+    uint64_t spurious_wakeups;  // Woken by an interrupt with the awaited block still incomplete
+    uint32_t occupancy_hwm;     // Most BDs held back at once
+    uint64_t ring_full_count;   // Times every BD was held back
+    uint64_t ring_full_ns;      // Time every BD was held back, including a full stretch still going on
+                                // (RX: upper bound, from the last time the reader saw a free BD)
+    uint32_t error_bits;        // DMASR error bits ever seen
+    uint64_t error_reads;       // DMASR reads that showed error bits
+} DmaStats_t;
+
+/**
+ * @brief Takes a consistent snapshot of a direction's counters.
+ * Safe to call from any thread while another one runs the readout; it never blocks it.
+ * @param handle The DMA handle.
+ * @param dir The direction.
+ * @param stats Filled with the counters.
+ * @return 0 on success, -1 on failure.
+ */
+int dma_get_stats(AxiDmaHandle_t handle, DmaDirection_e dir, DmaStats_t* stats);
+
+/**
+ * @brief Zeroes a direction's counters.
+ * @param handle The DMA handle.
+ * @param dir The direction.
+ */
+void dma_reset_stats(AxiDmaHandle_t handle, DmaDirection_e dir);
+
+/**
+ * @brief Writes the latency trace ring to a file for dma_trace_dump.
+ * Only records when the library is built with AXI_DMA_TRACE (`make TRACE=1`).
+ * @param handle The DMA handle.
+ * @param path Output file.
+ * @return Number of events written (0 if tracing is not built in), -1 on failure.
+ */
+int dma_dump_trace(AxiDmaHandle_t handle, const char* path);
+
+/**
+ * @brief Returns the DMASR error bits of a channel (DMA_ERR_* flags, 0 if none).
+ * A channel with errors is halted until dma_recover.
+ * @param handle The DMA handle.
+ * @param dir The channel direction.
+ * @return The error bits, 0 without errors or on failure.
+ */
+uint32_t dma_get_errors(AxiDmaHandle_t handle, DmaDirection_e dir);
+
+/**
+ * @brief Recovers from a DMA error in place, without dma_destroy/dma_init_channel.
+ * Resets the core and re-arms both rings: receive blocks completed before the error are
+ * kept and returned by the next receive calls, flushed transmit blocks not sent yet are
+ * queued again from the start of their packet. Blocks handed out stay valid and are
+ * released as usual. Call it from the receiving thread after a DMA_ERR_HALTED return.
+ * @param handle The DMA handle.
+ * @return 1 after recovering, 0 if no channel had an error, -1 on failure.
+ */
+int dma_recover(AxiDmaHandle_t handle);
+
+/**
+ * @brief Real-time mode for the calling thread, which should be the one receiving.
+ * Locks all process memory (lock_memory != 0), prefaults the DMA mappings and the stack,
+ * pins the thread to `cpu` (-1 = keep) and switches it to SCHED_FIFO at `priority`
+ * (0 = keep the policy). Prints a warning if the core is not in isolcpus and nohz_full.
+ * Call after dma_init_channel/dma_init_layout. Needs root or CAP_IPC_LOCK/CAP_SYS_NICE.
+ * @param handle The DMA handle.
+ * @param cpu Core to pin to, or -1.
+ * @param priority SCHED_FIFO priority 1..99, or 0.
+ * @param lock_memory Non-zero to mlockall the process.
+ * @return 0 on success, -1 on failure.
+ */
+int dma_enter_realtime(AxiDmaHandle_t handle, int cpu, int priority, int lock_memory);
+
+/**
+ * @brief Reports the kernel isolation settings of a core.
+ * @param cpu The core.
+ * @return Bit 0: in isolcpus, bit 1: in nohz_full, bit 2: in rcu_nocbs.
+ */
+int dma_check_cpu_isolation(int cpu);
+
 /**
  * @brief Performs a simple one-shot transmit transfer in Direct Register Mode.
  * @param handle The DMA handle.
@@ -118,25 +312,155 @@ int dma_wait_for_completion(AxiDmaHandle_t handle, DmaDirection_e dir);
  * @param dir The direction to check.
  * @param data_ptr A pointer that will be filled with the address of the data buffer.
  * @param len A pointer that will be filled with the number of bytes received/transmitted.
- * @return 1 if a block was successfully retrieved, 0 if a spurious interrupt occurred, -1 on error.
+ * @return 1 if a block was successfully retrieved, 0 if a spurious interrupt occurred,
+ *         DMA_ERR_HALTED if the channel halted on a DMA error, -1 on other errors.
  */
 int dma_get_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir, void** data_ptr, uint32_t* len);
 
+/**
+ * @brief Waits for completed data blocks and retrieves all of them in one call.
+ * Blocks until the oldest unreleased BD is complete, then returns every completed
+ * BD from there up to the first incomplete one (at most max_blocks).
+ * The blocks stay valid until released with dma_release_completed_blocks.
+ * @param handle The DMA handle.
+ * @param dir The direction to check (only DMA_RECEIVE is supported).
+ * @param blocks Array filled with the (data, len) pairs of the completed blocks.
+ * @param max_blocks Capacity of the blocks array.
+ * @return The number of blocks retrieved, DMA_ERR_HALTED on a DMA error, or -1 on other errors.
+ */
+int dma_get_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, DmaBlock_t* blocks, uint32_t max_blocks);
+
+/**
+ * @brief Non-blocking receive: returns the next completed block if there is one.
+ * Makes no system call, so it can be called from an event loop or a busy loop.
+ * @param handle The DMA handle.
+ * @param dir The direction (must be DMA_RECEIVE).
+ * @param data_ptr Pointer to a void* that will be updated with the block's address.
+ * @param len Pointer to a uint32_t that will be updated with the block's length.
+ * @return 1 if a block was returned, 0 if none is complete yet, -1 on error.
+ */
+int dma_try_get_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir, void** data_ptr, uint32_t* len);
+
+/**
+ * @brief Non-blocking variant of dma_get_completed_blocks.
+ * @return The number of completed blocks written to `blocks` (0 if none), -1 on error.
+ */
+int dma_try_get_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, DmaBlock_t* blocks, uint32_t max_blocks);
+
+/**
+ * @brief Returns the interrupt file descriptor of a channel for poll/epoll/select.
+ * The fd becomes readable when the channel interrupt fires after dma_arm_irq.
+ * @param handle The DMA handle.
+ * @param dir The channel direction.
+ * @return The file descriptor, or -1 if the handle has no interrupt support.
+ */
+int dma_get_fd(AxiDmaHandle_t handle, DmaDirection_e dir);
+
+/**
+ * @brief Acknowledges and re-enables the channel interrupt before waiting on its fd.
+ * A block that completed before the re-arm raises no new event, so check the result:
+ * 1 means a block is already complete (drain it instead of waiting).
+ * @param handle The DMA handle.
+ * @param dir The channel direction.
+ * @return 1 if a block is already complete, 0 if the caller may wait on the fd,
+ *         DMA_ERR_HALTED if the channel halted on a DMA error, -1 on other errors.
+ */
+int dma_arm_irq(AxiDmaHandle_t handle, DmaDirection_e dir);
+
+/**
+ * @brief Consumes the pending interrupt event once the fd reported readable.
+ * @param handle The DMA handle.
+ * @param dir The channel direction.
+ * @return The interrupt count, or -1 on error.
+ */
+int dma_consume_irq(AxiDmaHandle_t handle, DmaDirection_e dir);
+
 /**
  * @brief Waits for the next transmit block to complete in SG mode (does not return data pointer or length).
  * This is a blocking call (polling or interrupt based).
  * @param handle The DMA handle.
- * @return 1 if a block was completed, 0 if not, -1 on error.
+ * @return 1 if a block was completed, 0 if not, DMA_ERR_HALTED on a DMA error, -1 on other errors.
  */
 int dma_wait_for_transmit_completion_sg(AxiDmaHandle_t handle);
 
 /**
  * @brief Releases a processed block, making its buffer available to the DMA again.
+ * For DMA_TRANSMIT it reclaims the oldest transmit block only if the DMA has completed it.
  * @param handle The DMA handle.
  * @param dir The direction to release the block for.
  */
 void dma_release_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir);
 
+/**
+ * @brief Releases the n oldest processed blocks with a single tail descriptor update.
+ * @param handle The DMA handle.
+ * @param dir The direction to release the blocks for.
+ * @param n The number of blocks to release, usually the count returned by dma_get_completed_blocks.
+ *          For DMA_TRANSMIT, up to n completed transmit blocks are reclaimed, oldest first; blocks
+ *          the DMA has not completed yet are left queued.
+ */
+void dma_release_completed_blocks(AxiDmaHandle_t handle, DmaDirection_e dir, uint32_t n);
+
+/**
+ * @brief Claims the next completed receive block for the calling thread (multi-consumer receive).
+ * Any number of threads may claim blocks concurrently and process them straight out of
+ * DMA memory; each block is handed back with dma_release_claimed_block, in any order.
+ * Do not mix with dma_get_completed_block(s)/dma_release_completed_block(s) on the same handle.
+ * @param handle The DMA handle.
+ * @param block Filled with the block's address and length.
+ * @param id Filled with the id to pass to dma_release_claimed_block.
+ * @param wait Non-zero to block until a block completes, zero to return 0 immediately.
+ * @return 1 if a block was claimed, 0 if none was complete (wait == 0),
+ *         DMA_ERR_HALTED on a DMA error, -1 on other errors.
+ */
+int dma_claim_block(AxiDmaHandle_t handle, DmaBlock_t* block, uint32_t* id, int wait);
+
+/**
+ * @brief Releases a claimed receive block. The DMA gets buffers back in ring order,
+ * as soon as every older claimed block has been released as well.
+ * @param handle The DMA handle.
+ * @param id The id returned by dma_claim_block.
+ */
+void dma_release_claimed_block(AxiDmaHandle_t handle, uint32_t id);
+
+/**
+ * @brief Cyclic capture statistics, see dma_get_cyclic_stats.
+ */
+typedef struct {
+    uint64_t blocks;            // Blocks returned by dma_cyclic_receive
+    uint64_t overruns;          // Times the DMA lapped the reader and it resynchronised
+    uint64_t blocks_lost;       // Blocks skipped by resynchronisation (lower bound)
+    uint64_t blocks_corrupted;  // Blocks overwritten while held
+} DmaCyclicStats_t;
+
+/**
+ * @brief Gets the next block of a free-running DMA_MODE_CYCLIC S2MM capture.
+ * The DMA never stops and overwrites blocks that were not read in time. When it has lapped
+ * the reader, the reader resynchronises behind it without stopping it and the loss is counted.
+ * @param handle The DMA handle.
+ * @param block Filled with the block's address and length.
+ * @param wait Non-zero to block until a block completes, zero to return 0 immediately.
+ * @return 1 if a block was returned, 0 if none was complete (wait == 0),
+ *         DMA_ERR_HALTED on a DMA error, -1 on other errors.
+ */
+int dma_cyclic_receive(AxiDmaHandle_t handle, DmaBlock_t* block, int wait);
+
+/**
+ * @brief Releases the block returned by dma_cyclic_receive.
+ * @param handle The DMA handle.
+ * @return 1 if the block stayed intact while it was held, 0 if the DMA overwrote it
+ *         meanwhile (discard what was decoded from it), -1 on error.
+ */
+int dma_cyclic_release(AxiDmaHandle_t handle);
+
+/**
+ * @brief Reads the cyclic capture statistics.
+ * @param handle The DMA handle.
+ * @param stats Filled with the counters since the last initialization.
+ * @return 0 on success, -1 on failure.
+ */
+int dma_get_cyclic_stats(AxiDmaHandle_t handle, DmaCyclicStats_t* stats);
+
 /**
  * @brief Submits a block of data for transmission.
  * @param handle The DMA handle.
@@ -146,6 +470,35 @@ void dma_release_completed_block(AxiDmaHandle_t handle, DmaDirection_e dir);
  */
 int dma_submit_transmit_block(AxiDmaHandle_t handle, const void* data_ptr, uint32_t len);
 
+/**
+ * @brief Returns a writable pointer to a free transmit buffer, for zero-copy transmit.
+ * The buffer belongs to the BD `offset` slots after the next free one, so several
+ * buffers can be filled before committing them.
+ * @param handle The DMA handle.
+ * @param offset Index of the buffer among the free buffers (0 = next free buffer).
+ * @param capacity Filled with the buffer size in bytes (may be NULL).
+ * @return Pointer to the buffer, or NULL if no such free buffer exists.
+ */
+void* dma_acquire_transmit_buffer(AxiDmaHandle_t handle, uint32_t offset, uint32_t* capacity);
+
+/**
+ * @brief Commits n filled transmit buffers, in acquisition order, as one packet segment.
+ * SOF is set on the first buffer if sof is non-zero, EOF on the last if eof is non-zero.
+ * The hardware is not notified until dma_flush_transmit is called.
+ * @param handle The DMA handle.
+ * @param lens Number of valid bytes in each buffer.
+ * @param n Number of buffers to commit.
+ * @return n on success, 0 if not enough free buffers are available, -1 on error
+ *         (a length of 0 or above the buffer size). On 0 or -1 nothing is committed.
+ */
+int dma_commit_transmit_blocks(AxiDmaHandle_t handle, const uint32_t* lens, uint32_t n, int sof, int eof);
+
+/**
+ * @brief Hands all committed transmit buffers to the hardware with a single TAILDESC write.
+ * @param handle The DMA handle.
+ */
+void dma_flush_transmit(AxiDmaHandle_t handle);
+
 
 #ifdef __cplusplus
 }
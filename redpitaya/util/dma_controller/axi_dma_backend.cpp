@@ -0,0 +1,246 @@
+// =================================================================================
+// FILE: axi_dma_backend.cpp
+//
+// DESCRIPTION:
+// /dev/mem + UIO implementation of the AxiDmaBackend interface, the backend
+// used on the board, and its u-dma-buf variant with cacheable data buffers.
+//
+// =================================================================================
+#include "axi_dma_backend.hpp"
+#include "axi_dma_regs.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdexcept>
+
+DevMemBackend::DevMemBackend(uint64_t dma_regs_addr)
+    : m_dma_regs_addr(dma_regs_addr), m_mem_phys_addr(0), m_mem_size(0)
+{
+    // Open memory device
+    // Use non-cached memory with O_SYNC and MAP_SHARED to be coherent with CPU
+    m_mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
+    if (m_mem_fd < 0)
+        throw std::runtime_error("Failed to open /dev/mem device files.");
+
+    void *regs = mmap(NULL, DMA_REG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_mem_fd, m_dma_regs_addr);
+    m_dma_regs = (regs == MAP_FAILED) ? nullptr : static_cast<volatile uint32_t *>(regs);
+    if (!m_dma_regs)
+    {
+        cleanup();
+        throw std::runtime_error("Memory mapping failed.");
+    }
+}
+
+DevMemBackend::DevMemBackend(uint64_t dma_regs_addr, uint64_t mem_phys_addr, uint64_t mem_size)
+    : DevMemBackend(dma_regs_addr)
+{
+    m_mem_phys_addr = mem_phys_addr;
+    m_mem_size = mem_size;
+    void *mem = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_mem_fd, m_mem_phys_addr);
+    m_mem_region = (mem == MAP_FAILED) ? nullptr : static_cast<volatile uint8_t *>(mem);
+    if (!m_mem_region)
+    {
+        cleanup();
+        throw std::runtime_error("Memory mapping failed.");
+    }
+}
+
+DevMemBackend::DevMemBackend(uint64_t dma_regs_addr,
+                             uint64_t mem_phys_addr,
+                             uint64_t mem_size,
+                             const std::string &uio_mm2s,
+                             const std::string &uio_s2mm) : DevMemBackend(dma_regs_addr, mem_phys_addr, mem_size)
+{
+    openUio(uio_mm2s, uio_s2mm);
+}
+
+void DevMemBackend::openUio(const std::string &uio_mm2s, const std::string &uio_s2mm)
+{
+    m_uio_mm2s_fd = open(uio_mm2s.c_str(), O_RDWR | O_SYNC);
+    m_uio_s2mm_fd = open(uio_s2mm.c_str(), O_RDWR | O_SYNC);
+    if (m_uio_mm2s_fd < 0 || m_uio_s2mm_fd < 0)
+    {
+        cleanup();
+        throw std::runtime_error("Failed to open " + uio_mm2s + " or " + uio_s2mm + " device files.");
+    }
+}
+
+DevMemBackend::~DevMemBackend()
+{
+    if (hasIrq())
+    {
+        // Leave both UIO lines enabled for the next user
+        enableIrq(DmaDirection::TRANSMIT);
+        enableIrq(DmaDirection::RECEIVE);
+    }
+    cleanup();
+}
+
+void DevMemBackend::cleanup()
+{
+    if (m_dma_regs)
+        munmap((void *)m_dma_regs, DMA_REG_SIZE);
+    if (m_mem_region)
+        munmap((void *)m_mem_region, m_mem_size);
+    if (m_mem_fd >= 0)
+        close(m_mem_fd);
+    if (m_uio_mm2s_fd >= 0)
+        close(m_uio_mm2s_fd);
+    if (m_uio_s2mm_fd >= 0)
+        close(m_uio_s2mm_fd);
+    m_dma_regs = nullptr;
+    m_mem_region = nullptr;
+    m_mem_fd = m_uio_mm2s_fd = m_uio_s2mm_fd = -1;
+}
+
+int DevMemBackend::waitIrq(DmaDirection dir)
+{
+    unsigned int irq_count;
+    ssize_t nbytes = read(irqFd(dir), &irq_count, sizeof(irq_count));
+    if (nbytes != sizeof(irq_count))
+    {
+        perror("Failed to read UIO interrupt");
+        return -1;
+    }
+    return (int)irq_count;
+}
+
+void DevMemBackend::enableIrq(DmaDirection dir)
+{
+    // Re-enable the interrupt in UIO (write any value)
+    unsigned int reenable = 1;
+    ssize_t write_return = write(irqFd(dir), &reenable, sizeof(reenable));
+    (void)write_return;
+}
+
+//-------------------------------------------u-dma-buf---------------------------------------------------
+
+// Reads a sysfs attribute of the u-dma-buf device (newer drivers use the
+// "u-dma-buf" class, older ones "udmabuf"). Returns false if it is missing.
+static bool readUdmabufAttr(const std::string &name, const char *attr, uint64_t *value)
+{
+    const char *classes[] = {"/sys/class/u-dma-buf/", "/sys/class/udmabuf/"};
+    for (const char *cls : classes)
+    {
+        std::string path = std::string(cls) + name + "/" + attr;
+        FILE *f = fopen(path.c_str(), "r");
+        if (!f)
+            continue;
+        char line[64] = {0};
+        bool ok = fgets(line, sizeof(line), f) != nullptr;
+        fclose(f);
+        if (!ok)
+            return false;
+        *value = strtoull(line, nullptr, 0); // phys_addr is hex with 0x, size is decimal
+        return true;
+    }
+    return false;
+}
+
+static int openUdmabufAttr(const std::string &name, const char *attr)
+{
+    int fd = open(("/sys/class/u-dma-buf/" + name + "/" + attr).c_str(), O_WRONLY);
+    if (fd < 0)
+        fd = open(("/sys/class/udmabuf/" + name + "/" + attr).c_str(), O_WRONLY);
+    return fd;
+}
+
+UdmabufBackend::UdmabufBackend(uint64_t dma_regs_addr, const std::string &name)
+    : DevMemBackend(dma_regs_addr)
+{
+    try
+    {
+        openBuffer(name);
+    }
+    catch (...)
+    {
+        closeBuffer(); // ~DevMemBackend releases the registers
+        throw;
+    }
+}
+
+UdmabufBackend::UdmabufBackend(uint64_t dma_regs_addr,
+                               const std::string &name,
+                               const std::string &uio_mm2s,
+                               const std::string &uio_s2mm) : UdmabufBackend(dma_regs_addr, name)
+{
+    openUio(uio_mm2s, uio_s2mm);
+}
+
+UdmabufBackend::~UdmabufBackend()
+{
+    closeBuffer();
+}
+
+void UdmabufBackend::openBuffer(const std::string &name)
+{
+    uint64_t coherent = 0;
+    if (!readUdmabufAttr(name, "phys_addr", &m_mem_phys_addr) || !readUdmabufAttr(name, "size", &m_mem_size))
+        throw std::runtime_error("Cannot read the sysfs attributes of u-dma-buf device " + name + ".");
+    if (readUdmabufAttr(name, "dma_coherent", &coherent))
+        m_dma_coherent = (coherent != 0);
+
+    std::string dev = "/dev/" + name;
+    m_buf_fd = open(dev.c_str(), O_RDWR | O_SYNC);
+    m_buf_cached_fd = open(dev.c_str(), O_RDWR);
+    if (m_buf_fd < 0 || m_buf_cached_fd < 0)
+        throw std::runtime_error("Failed to open " + dev + ".");
+    if (!m_dma_coherent)
+    {
+        m_sync_cpu_fd = openUdmabufAttr(name, "sync_for_cpu");
+        m_sync_device_fd = openUdmabufAttr(name, "sync_for_device");
+        if (m_sync_cpu_fd < 0 || m_sync_device_fd < 0)
+            throw std::runtime_error("Failed to open the sync attributes of " + dev + ".");
+    }
+
+    void *mem = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_buf_fd, 0);
+    void *data = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_buf_cached_fd, 0);
+    m_mem_region = (mem == MAP_FAILED) ? nullptr : static_cast<volatile uint8_t *>(mem);
+    m_data_region = (data == MAP_FAILED) ? nullptr : static_cast<volatile uint8_t *>(data);
+    if (!m_mem_region || !m_data_region)
+        throw std::runtime_error("Memory mapping of " + dev + " failed.");
+}
+
+void UdmabufBackend::closeBuffer()
+{
+    // Unmapped here, so that DevMemBackend::cleanup() leaves m_mem_region alone
+    if (m_mem_region)
+        munmap((void *)m_mem_region, m_mem_size);
+    if (m_data_region)
+        munmap((void *)m_data_region, m_mem_size);
+    int fds[] = {m_buf_fd, m_buf_cached_fd, m_sync_cpu_fd, m_sync_device_fd};
+    for (int fd : fds)
+        if (fd >= 0)
+            close(fd);
+    m_mem_region = m_data_region = nullptr;
+    m_buf_fd = m_buf_cached_fd = m_sync_cpu_fd = m_sync_device_fd = -1;
+}
+
+void UdmabufBackend::sync(int fd, DmaDirection dir, uint64_t offset, uint64_t len)
+{
+    // Whole cache lines. The command packs the offset into bits 63:32, the size
+    // into bits 31:4, the dma_data_direction into bits 3:2 and the enable bit 0.
+    uint64_t start = offset & ~(CACHE_LINE - 1);
+    uint64_t end = (offset + len + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+    uint32_t direction = (dir == DmaDirection::TRANSMIT) ? 1 : 2; // DMA_TO_DEVICE : DMA_FROM_DEVICE
+    char cmd[24];
+    int n = snprintf(cmd, sizeof(cmd), "0x%08X%08X", (uint32_t)start,
+                     (uint32_t)((end - start) & 0xFFFFFFF0) | (direction << 2) | 1);
+    if (pwrite(fd, cmd, n, 0) != n)
+        perror("u-dma-buf sync failed");
+}
+
+void UdmabufBackend::syncForCpu(DmaDirection dir, uint64_t offset, uint64_t len)
+{
+    if (!m_dma_coherent)
+        sync(m_sync_cpu_fd, dir, offset, len);
+}
+
+void UdmabufBackend::syncForDevice(DmaDirection dir, uint64_t offset, uint64_t len)
+{
+    if (!m_dma_coherent)
+        sync(m_sync_device_fd, dir, offset, len);
+}
@@ -0,0 +1,129 @@
+// =================================================================================
+// FILE: axi_dma_backend.hpp
+//
+// DESCRIPTION:
+// Register/memory backend interface used by AxiDmaController. A backend owns
+// the AXI DMA register block, the reserved DMA memory region and the two UIO
+// interrupt lines. The default backend maps everything through /dev/mem
+// (uncached); the u-dma-buf backend keeps the descriptors uncached but maps
+// the data buffers cacheable and syncs them explicitly. The software emulator
+// in `axi_dma_emulator.hpp` implements the same interface so the controller
+// can run without a board. Internal header.
+//
+// =================================================================================
+#ifndef AXI_DMA_BACKEND_HPP
+#define AXI_DMA_BACKEND_HPP
+
+#include "axi_dma_controller.hpp"
+#include <cstdint>
+#include <string>
+
+class AxiDmaBackend {
+public:
+    typedef AxiDmaController::DmaDirection DmaDirection;
+
+    virtual ~AxiDmaBackend() {}
+
+    // --- Register block (byte offsets as in the AXI DMA register map) ---
+    virtual uint32_t readReg(uint32_t offset) = 0;
+    virtual void writeReg(uint32_t offset, uint32_t value) = 0;
+
+    // --- Reserved DMA memory region ---
+    virtual volatile uint8_t* memRegion() = 0;
+    virtual uint64_t memPhysAddr() const = 0;
+    virtual uint64_t memSize() const = 0;
+    virtual uint64_t regsPhysAddr() const = 0;
+
+    // View of the same region used for the data buffers. Backends with a
+    // cacheable mapping return it here and keep memRegion() uncached for the
+    // buffer descriptors; the sync calls then hand buffer ranges (byte offsets
+    // into the region) between CPU and DMA. No-ops for coherent backends.
+    virtual volatile uint8_t* dataRegion() { return memRegion(); }
+    virtual bool needsSync() const { return false; }
+    virtual void syncForCpu(DmaDirection dir, uint64_t offset, uint64_t len) { (void)dir; (void)offset; (void)len; }
+    virtual void syncForDevice(DmaDirection dir, uint64_t offset, uint64_t len) { (void)dir; (void)offset; (void)len; }
+
+    // --- Interrupts, with UIO semantics ---
+    // waitIrq() blocks until the next interrupt and returns the event count
+    // (or -1 on error). The line stays masked until enableIrq() re-arms it.
+    virtual bool hasIrq() const = 0;
+    virtual int irqFd(DmaDirection dir) const = 0;
+    virtual int waitIrq(DmaDirection dir) = 0;
+    virtual void enableIrq(DmaDirection dir) = 0;
+};
+
+// Hardware backend: register block and reserved memory mapped from /dev/mem
+// (uncached, O_SYNC), interrupts from two optional UIO devices.
+class DevMemBackend : public AxiDmaBackend {
+public:
+    // Constructor: Opens devices and maps memory. Throws on error.
+    DevMemBackend(uint64_t dma_regs_addr, uint64_t mem_phys_addr, uint64_t mem_size);
+    DevMemBackend(uint64_t dma_regs_addr, uint64_t mem_phys_addr, uint64_t mem_size, const std::string& uio_mm2s, const std::string& uio_s2mm);
+    ~DevMemBackend();
+
+    uint32_t readReg(uint32_t offset) { return m_dma_regs[offset / 4]; }
+    void writeReg(uint32_t offset, uint32_t value) { m_dma_regs[offset / 4] = value; }
+
+    volatile uint8_t* memRegion() { return m_mem_region; }
+    uint64_t memPhysAddr() const { return m_mem_phys_addr; }
+    uint64_t memSize() const { return m_mem_size; }
+    uint64_t regsPhysAddr() const { return m_dma_regs_addr; }
+
+    bool hasIrq() const { return m_uio_mm2s_fd >= 0 && m_uio_s2mm_fd >= 0; }
+    int irqFd(DmaDirection dir) const { return (dir == DmaDirection::TRANSMIT) ? m_uio_mm2s_fd : m_uio_s2mm_fd; }
+    int waitIrq(DmaDirection dir);
+    void enableIrq(DmaDirection dir);
+
+protected:
+    // Maps the register block only; the derived class provides the memory
+    explicit DevMemBackend(uint64_t dma_regs_addr);
+    void openUio(const std::string& uio_mm2s, const std::string& uio_s2mm);
+    void cleanup();
+
+    int m_uio_mm2s_fd = -1;
+    int m_uio_s2mm_fd = -1;
+    int m_mem_fd = -1;
+
+    uint64_t m_dma_regs_addr;
+    uint64_t m_mem_phys_addr;
+    uint64_t m_mem_size;
+
+    volatile uint32_t* m_dma_regs = nullptr;
+    volatile uint8_t* m_mem_region = nullptr;
+};
+
+// Hardware backend with cacheable buffers: the reserved memory is a u-dma-buf
+// device (e.g. /dev/udmabuf0) instead of a /dev/mem carve-out. It is mapped
+// twice, uncached (O_SYNC) for the buffer descriptors and cacheable for the
+// data buffers, and buffer ownership is handed over through the device's
+// sync_for_cpu / sync_for_device sysfs attributes. The device must be created
+// with sync_mode=1 (the default) so that O_SYNC gives an uncached mapping.
+// Registers and UIO interrupts are handled as in DevMemBackend.
+class UdmabufBackend : public DevMemBackend {
+public:
+    // `name` is the device name, e.g. "udmabuf0". Throws on error.
+    UdmabufBackend(uint64_t dma_regs_addr, const std::string& name);
+    UdmabufBackend(uint64_t dma_regs_addr, const std::string& name, const std::string& uio_mm2s, const std::string& uio_s2mm);
+    ~UdmabufBackend();
+
+    volatile uint8_t* dataRegion() { return m_data_region; }
+    bool needsSync() const { return !m_dma_coherent; }
+    void syncForCpu(DmaDirection dir, uint64_t offset, uint64_t len);
+    void syncForDevice(DmaDirection dir, uint64_t offset, uint64_t len);
+
+private:
+    static constexpr uint64_t CACHE_LINE = 32; // Cortex-A9 L1/L2 line size
+
+    void openBuffer(const std::string& name);
+    void closeBuffer();
+    void sync(int fd, DmaDirection dir, uint64_t offset, uint64_t len);
+
+    int m_buf_fd = -1;          // O_SYNC: uncached mapping
+    int m_buf_cached_fd = -1;   // cacheable mapping
+    int m_sync_cpu_fd = -1;
+    int m_sync_device_fd = -1;
+    bool m_dma_coherent = false;
+    volatile uint8_t* m_data_region = nullptr;
+};
+
+#endif // AXI_DMA_BACKEND_HPP
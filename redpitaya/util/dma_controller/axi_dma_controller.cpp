@@ -7,110 +7,99 @@
 //
 // =================================================================================
 #include "axi_dma_controller.hpp"
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <unistd.h>
+#include "axi_dma_backend.hpp"
+#include "axi_dma_regs.hpp"
+#include "axi_dma_rt.hpp"
+#include "axi_dma_trace.hpp"
+#include "axi_dma_probes.hpp"
 #include <string.h>
 #include <stdexcept>
 #include <iostream>
+#include <chrono>
 
-// --- AXI DMA Register Offsets ---
-constexpr uint32_t DMA_REG_SIZE = 0x10000;
-constexpr uint32_t MM2S_DMACR = 0x00;
-constexpr uint32_t MM2S_DMASR = 0x04;
-constexpr uint32_t MM2S_SA = 0x18;
-constexpr uint32_t MM2S_SA_MSB = 0x1C;
-constexpr uint32_t MM2S_LENGTH = 0x28;
-constexpr uint32_t MM2S_CURDESC = 0x08;
-constexpr uint32_t MM2S_TAILDESC = 0x10;
-
-constexpr uint32_t S2MM_DMACR = 0x30;
-constexpr uint32_t S2MM_DMASR = 0x34;
-constexpr uint32_t S2MM_DA = 0x48;
-constexpr uint32_t S2MM_DA_MSB = 0x4C;
-constexpr uint32_t S2MM_LENGTH = 0x58;
-constexpr uint32_t S2MM_CURDESC = 0x38;
-constexpr uint32_t S2MM_TAILDESC = 0x40;
-
-// --- DMA Control/Status Register Bits ---
-constexpr uint32_t DMA_CR_RUN_STOP_MASK = 0x00000001;
-constexpr uint32_t DMA_CR_RESET_MASK = 0x00000004;
-constexpr uint32_t DMA_CR_IOC_IRQ_EN_MASK = 0x00001000;
-constexpr uint32_t DMA_CR_ERR_IRQ_EN_MASK = 0x00004000;
-constexpr uint32_t DMA_CR_CYCLIC_EN_MASK = 0x00000010;
-
-constexpr uint32_t DMA_SR_HALTED_MASK = 0x00000001;
-constexpr uint32_t DMA_SR_IDLE_MASK = 0x00000002;
-constexpr uint32_t DMA_SR_IOC_IRQ_MASK = 0x00001000;
-constexpr uint32_t DMA_SR_ERR_IRQ_MASK = 0x00004000;
-constexpr uint32_t DMA_SR_ALL_ERR_MASK = 0x00000070;
-
-// --- Buffer Descriptor Structure ---
-constexpr uint32_t SG_BD_RANGE = 0x2000;
-struct AxiDmaBufferDescriptor
-{
-    uint32_t next_desc_ptr;
-    uint32_t next_desc_ptr_MSB;
-    uint32_t buffer_addr;
-    uint32_t buffer_addr_MSB;
-    uint32_t reserved3;
-    uint32_t reserved4;
-    uint32_t control;
-    uint32_t status;
-    uint32_t app[5];
-    uint32_t unused[3]; // Placeholder to make it aligned to 0x40
-};
+// Hint to the core that we are busy-waiting
+static inline void cpuRelax()
+{
+#if defined(__arm__) || defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#elif defined(__x86_64__) || defined(__i386__)
+    __asm__ __volatile__("pause");
+#endif
+}
 
-// --- Class Implementation ---
+static inline uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-AxiDmaController::AxiDmaController(uint64_t dma_regs_addr, uint64_t mem_phys_addr, uint64_t mem_size)
-    : m_dma_regs_addr(dma_regs_addr), m_mem_phys_addr(mem_phys_addr), m_mem_size(mem_size)
+// A BD the engine finished without error
+static inline bool bdDone(uint32_t status)
 {
-    // Use polling since no UIO are provided
-    WAIT_METHOD = DmaWaitMode::WAIT_POLL;
+    return (status & (BD_STS_COMPLETE_MASK | BD_STS_ALL_ERR_MASK)) == BD_STS_COMPLETE_MASK;
+}
 
-    // Open memory device
-    // Use non-cached memory with O_SYNC and MAP_SHARED to be coherent with CPU
-    m_mem_fd = open("/dev/mem", O_RDWR | O_SYNC);
-    if (m_mem_fd < 0)
-        throw std::runtime_error("Failed to open /dev/mem device files.");
+// Latency trace points, see axi_dma_trace.hpp. Compiled out unless AXI_DMA_TRACE is defined.
+#ifdef AXI_DMA_TRACE
+#define DMA_TRACE(dir, kind, idx, n, num_bds) traceEvent(dir, kind, idx, n, num_bds, nowNs())
+#else
+#define DMA_TRACE(dir, kind, idx, n, num_bds) do {} while (0)
+#endif
 
-    // Memory mapped regions
-    m_dma_regs = static_cast<volatile uint32_t *>(mmap(NULL, DMA_REG_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, m_mem_fd, m_dma_regs_addr));
-    m_mem_region = static_cast<volatile uint8_t *>(mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_mem_fd, m_mem_phys_addr));
-    if (m_dma_regs == MAP_FAILED || m_mem_region == MAP_FAILED)
-        throw std::runtime_error("Memory mapping failed.");
+// USDT probes, see axi_dma_probes.hpp
+#define DMA_PROBE(name, dir, bd, len, occupancy) \
+    AXI_DMA_PROBE(name, (dir) == DmaDirection::RECEIVE, bd, len, occupancy)
 
-    phys_addr_tx_buf = phys_addr_tx_bd = m_mem_phys_addr;
-    phys_addr_rx_buf = phys_addr_rx_bd = m_mem_phys_addr + mem_size / 2;
-    virt_tx_buf = (uint64_t)m_mem_region;
-    virt_rx_buf = (uint64_t)m_mem_region+ mem_size / 2;
+// --- Class Implementation ---
 
-    m_mm2s_channel.mode = DmaMode::DIRECT_REGISTER;
-    m_s2mm_channel.mode = DmaMode::DIRECT_REGISTER;
-    reset(DmaDirection::TRANSMIT);
-    reset(DmaDirection::RECEIVE);
+const int AxiDmaController::DMA_ERROR;
+
+AxiDmaController::AxiDmaController(uint64_t dma_regs_addr, uint64_t mem_phys_addr, uint64_t mem_size)
+    : AxiDmaController(new DevMemBackend(dma_regs_addr, mem_phys_addr, mem_size))
+{
 }
 
 AxiDmaController::AxiDmaController(uint64_t dma_regs_addr,
                                    uint64_t mem_phys_addr,
                                    uint64_t mem_size,
                                    const std::string &uio_mm2s,
-                                   const std::string &uio_s2mm) : AxiDmaController(dma_regs_addr, mem_phys_addr, mem_size)
+                                   const std::string &uio_s2mm)
+    : AxiDmaController(new DevMemBackend(dma_regs_addr, mem_phys_addr, mem_size, uio_mm2s, uio_s2mm))
 {
-    // Use interrupt
-    WAIT_METHOD = DmaWaitMode::WAIT_IRQ;
+}
 
-    // Open memory device
-    m_uio_mm2s_fd = open(uio_mm2s.c_str(), O_RDWR | O_SYNC);
-    m_uio_s2mm_fd = open(uio_s2mm.c_str(), O_RDWR | O_SYNC);
-    if (m_uio_mm2s_fd < 0 || m_uio_s2mm_fd < 0)
+AxiDmaController::AxiDmaController(AxiDmaBackend *backend)
+    : m_backend(backend)
+{
+    // Use interrupts when the backend provides them, polling otherwise
+    WAIT_METHOD = m_backend->hasIrq() ? DmaWaitMode::WAIT_IRQ : DmaWaitMode::WAIT_POLL;
+
+    m_dma_regs_addr = m_backend->regsPhysAddr();
+    m_mem_phys_addr = m_backend->memPhysAddr();
+    m_mem_size = m_backend->memSize();
+    m_mem_region = m_backend->memRegion();
+    m_data_region = m_backend->dataRegion();
+    m_sync_buffers = m_backend->needsSync();
+#ifdef AXI_DMA_TRACE
+    m_trace.reset(new AxiDmaTraceRing());
+#endif
+
+    phys_addr_tx_buf = phys_addr_tx_bd = m_mem_phys_addr;
+    phys_addr_rx_buf = phys_addr_rx_bd = m_mem_phys_addr + m_mem_size / 2;
+    virt_tx_buf = (uint64_t)m_data_region;
+    virt_rx_buf = (uint64_t)m_data_region + m_mem_size / 2;
+
+    m_mm2s_channel.mode = DmaMode::DIRECT_REGISTER;
+    m_s2mm_channel.mode = DmaMode::DIRECT_REGISTER;
+    reset(DmaDirection::TRANSMIT);
+    reset(DmaDirection::RECEIVE);
+
+    if (WAIT_METHOD == DmaWaitMode::WAIT_IRQ)
     {
-        throw std::runtime_error("Failed to open " + uio_mm2s + " or " + uio_s2mm + " device files.");
+        // Clear previous pending interrupts
+        resetIRQ(DmaDirection::RECEIVE);
+        resetIRQ(DmaDirection::TRANSMIT);
     }
-    // Clear previous pending interrupts
-    resetIRQ(DmaDirection::RECEIVE);
-    resetIRQ(DmaDirection::TRANSMIT);
 }
 
 AxiDmaController::~AxiDmaController()
@@ -118,46 +107,37 @@ AxiDmaController::~AxiDmaController()
     // Cleanup: Reset and clear all status bits for both channels to avoid stale IRQs
     stop(DmaDirection::TRANSMIT);
     stop(DmaDirection::RECEIVE);
-    m_dma_regs[MM2S_DMASR / 4] = 0xFFFFFFFF;
-    m_dma_regs[S2MM_DMASR / 4] = 0xFFFFFFFF;
-
-    // unmap and close file descriptors
-    if (m_dma_regs)
-        munmap((void *)m_dma_regs, DMA_REG_SIZE);
-    if (m_mem_region)
-        munmap((void *)m_mem_region, m_mem_size);
-    if (m_mem_fd >= 0)
-        close(m_mem_fd);
-    if (WAIT_METHOD == DmaWaitMode::WAIT_IRQ)
-    {
-        // Clear previous pending interrupts
-        unsigned int reenable = 1;
-        ssize_t write_return;
-        write_return = write(m_uio_mm2s_fd, &reenable, sizeof(reenable));
-        write_return = write(m_uio_s2mm_fd, &reenable, sizeof(reenable));
-        (void)write_return;
-        if (m_uio_mm2s_fd >= 0)
-            close(m_uio_mm2s_fd);
-        if (m_uio_s2mm_fd >= 0)
-            close(m_uio_s2mm_fd);
-    }
+    writeReg(MM2S_DMASR, 0xFFFFFFFF);
+    writeReg(S2MM_DMASR, 0xFFFFFFFF);
+    // The backend unmaps memory and closes the device files
+}
+
+uint32_t AxiDmaController::readReg(uint32_t offset)
+{
+    return m_backend->readReg(offset);
+}
+
+void AxiDmaController::writeReg(uint32_t offset, uint32_t value)
+{
+    m_backend->writeReg(offset, value);
 }
 
 void AxiDmaController::reset(DmaDirection dir)
 {
     uint32_t offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMACR : S2MM_DMACR;
-    m_dma_regs[offset / 4] = DMA_CR_RESET_MASK;
-    while (m_dma_regs[offset / 4] & DMA_CR_RESET_MASK)
+    writeReg(offset, DMA_CR_RESET_MASK);
+    while (readReg(offset) & DMA_CR_RESET_MASK)
         ;
 }
 
 void AxiDmaController::simpleTransmit(uint64_t tx_addr, uint32_t tx_len, bool blocking)
 {
-    m_dma_regs[MM2S_DMACR / 4] = DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK;
-    m_dma_regs[MM2S_SA / 4] = tx_addr & 0xFFFFFFFF;
+    writeReg(MM2S_DMACR, DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK);
+    writeReg(MM2S_SA, tx_addr & 0xFFFFFFFF);
     if (m_dma_regs_addr > 0xFFFFFFFF)
-        m_dma_regs[MM2S_SA_MSB / 4] = tx_addr >> 32;
-    m_dma_regs[MM2S_LENGTH / 4] = tx_len;
+        writeReg(MM2S_SA_MSB, tx_addr >> 32);
+    writeReg(MM2S_LENGTH, tx_len);
+    noteBlocks(DmaDirection::TRANSMIT, 1, tx_len, 0, 0);
 
     if (blocking)
     {
@@ -170,11 +150,12 @@ void AxiDmaController::simpleTransmit(uint64_t tx_addr, uint32_t tx_len, bool bl
 
 void AxiDmaController::simpleReceive(uint64_t rx_addr, uint32_t rx_len, bool blocking)
 {
-    m_dma_regs[S2MM_DMACR / 4] = DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK;
-    m_dma_regs[S2MM_DA / 4] = rx_addr & 0xFFFFFFFF;
+    writeReg(S2MM_DMACR, DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK);
+    writeReg(S2MM_DA, rx_addr & 0xFFFFFFFF);
     if (m_dma_regs_addr > 0xFFFFFFFF)
-        m_dma_regs[S2MM_DA_MSB / 4] = rx_addr >> 32;
-    m_dma_regs[S2MM_LENGTH / 4] = rx_len;
+        writeReg(S2MM_DA_MSB, rx_addr >> 32);
+    writeReg(S2MM_LENGTH, rx_len);
+    noteBlocks(DmaDirection::RECEIVE, 1, rx_len, 0, 0);
 
     if (blocking)
     {
@@ -200,104 +181,172 @@ void AxiDmaController::waitForCompletion_poll(DmaDirection dir)
     uint32_t count = 0;
     do
     {
-        status = m_dma_regs[dmasr_offset / 4];
+        status = readReg(dmasr_offset);
         count ++;
     } while (!(status & DMA_SR_IOC_IRQ_MASK) && count<0xFFFFFFFF);
 
-    m_dma_regs[dmasr_offset / 4] |= DMA_SR_IOC_IRQ_MASK;
+    writeReg(dmasr_offset, DMA_SR_IOC_IRQ_MASK);
 }
 
 void AxiDmaController::waitForCompletion_irq(DmaDirection dir)
 {
     uint32_t dmasr_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMASR : S2MM_DMASR;
-    int uio_fd = (dir == DmaDirection::TRANSMIT) ? m_uio_mm2s_fd : m_uio_s2mm_fd;
 
-    // Wait for S2MM interrupt
-    unsigned int irq_count;
-    ssize_t nbytes;
-    nbytes = read(uio_fd, &irq_count, sizeof(irq_count));
-    if (nbytes != sizeof(irq_count))
-        perror("Failed to read UIO interrupt");
+    // Wait for the interrupt
+    DMA_PROBE(irq_wait_start, dir, 0, 0, 0);
+    if (m_backend->waitIrq(dir) >= 0)
+        noteIrq(dir, false);
+    DMA_PROBE(irq_wait_end, dir, 0, 0, 0);
 
     // Acknowledge the interrupts
-    m_dma_regs[dmasr_offset / 4] |= DMA_SR_IOC_IRQ_MASK;
-    // Re-enable the interrupt in UIO (write any value)
-    unsigned int reenable = 1;
-    nbytes = write(uio_fd, &reenable, sizeof(reenable));
+    writeReg(dmasr_offset, DMA_SR_IOC_IRQ_MASK);
+    // Re-enable the interrupt in UIO
+    m_backend->enableIrq(dir);
 }
 
 void AxiDmaController::stop(DmaDirection dir)
 {
     uint32_t offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMACR : S2MM_DMACR;
-    m_dma_regs[offset / 4] &= ~DMA_CR_RUN_STOP_MASK;
+    writeReg(offset, readReg(offset) & ~DMA_CR_RUN_STOP_MASK);
 }
 
 //-------------------------------------------SG Mode------------------------------------------------------
 
 void AxiDmaController::initSG(DmaMode mode_mm2s, DmaMode mode_s2mm, uint32_t num_bds, uint32_t buffer_size)
 {
-    reset(DmaDirection::RECEIVE);
-    reset(DmaDirection::TRANSMIT);
-
-    phys_addr_tx_buf = phys_addr_tx_bd + SG_BD_RANGE;
-    phys_addr_rx_buf = phys_addr_rx_bd + SG_BD_RANGE;
-    virt_tx_buf = (uint64_t)m_mem_region + SG_BD_RANGE;
-    virt_rx_buf = (uint64_t)m_mem_region + m_mem_size / 2 + SG_BD_RANGE;    
+    // Same ring on both channels, region split in two halves
+    SgLayout layout;
+    layout.mode_mm2s = mode_mm2s;
+    layout.mode_s2mm = mode_s2mm;
+    layout.tx_num_bds = layout.rx_num_bds = num_bds;
+    layout.tx_buffer_size = layout.rx_buffer_size = buffer_size;
+    layout.tx_fraction = 0.5;
+    initSG(layout);
+}
 
-    // --- Robust memory partitioning for BDs and buffers ---
-    // 1. The memory region is divided into two halfs
+void AxiDmaController::initSG(const SgLayout &layout)
+{
+    bool tx_used = (layout.mode_mm2s != DmaMode::UNINITIALIZED);
+    bool rx_used = (layout.mode_s2mm != DmaMode::UNINITIALIZED);
+    if (layout.mode_mm2s == DmaMode::DIRECT_REGISTER || layout.mode_s2mm == DmaMode::DIRECT_REGISTER)
+        throw std::runtime_error("initSG: channel mode must be SCATTER_GATHER, CYCLIC or UNINITIALIZED (unused).");
+    if (!tx_used && !rx_used)
+        throw std::runtime_error("initSG: both channels unused.");
+
+    // --- Memory partitioning for BDs and buffers ---
     // | MM2S BDs --> MM2S buffers | S2MM BDs --> S2MM buffers |
+    // The MM2S part gets tx_fraction of the region (page aligned), an unused
+    // channel gets nothing.
+    uint64_t tx_part = 0;
+    if (tx_used && !rx_used)
+        tx_part = m_mem_size;
+    else if (tx_used)
+    {
+        if (!(layout.tx_fraction > 0.0 && layout.tx_fraction < 1.0))
+            throw std::runtime_error("initSG: tx_fraction must be in (0, 1) when both channels are used.");
+        tx_part = (uint64_t)(m_mem_size * layout.tx_fraction) & ~(uint64_t)(PAGE_ALIGN - 1);
+    }
+    uint64_t rx_part = m_mem_size - tx_part;
+    if (tx_used)
+        validateRing("MM2S", layout.tx_num_bds, layout.tx_buffer_size, tx_part);
+    if (rx_used)
+        validateRing("S2MM", layout.rx_num_bds, layout.rx_buffer_size, rx_part);
+    // A resync leaves at least 2 BDs between the engine and the reader
+    if (layout.mode_s2mm == DmaMode::CYCLIC && layout.rx_num_bds < 3)
+        throw std::runtime_error("initSG: a CYCLIC S2MM ring needs at least 3 BDs.");
 
-    // MM2S BDs: base
-    uint64_t mm2s_bd_base_virt = (uint64_t)m_mem_region;
-    uint64_t mm2s_bd_base_phys = m_mem_phys_addr;
-
-    // S2MM BDs: after MM2S buffers, at the midpoint of memery range
-    uint64_t s2mm_bd_base_virt = mm2s_bd_base_virt + m_mem_size / 2;
-    uint64_t s2mm_bd_base_phys = mm2s_bd_base_phys + m_mem_size / 2;
+    reset(DmaDirection::RECEIVE);
+    reset(DmaDirection::TRANSMIT);
 
-    m_mm2s_channel.mode = mode_mm2s;
-    m_mm2s_channel.num_bds = num_bds;
-    m_mm2s_channel.buffer_size_per_bd = buffer_size;
-    m_mm2s_channel.bd_chain = reinterpret_cast<volatile AxiDmaBufferDescriptor *>(mm2s_bd_base_virt);
-    m_mm2s_channel.bd_chain_phys_addr = mm2s_bd_base_phys;
-    m_mm2s_channel.buffer_phys_address = phys_addr_tx_buf;
-    m_mm2s_channel.head_idx = 0;
-    m_mm2s_channel.tail_idx = 0;
-    setupBdChain(m_mm2s_channel);
+    phys_addr_tx_bd = m_mem_phys_addr;
+    phys_addr_rx_bd = m_mem_phys_addr + tx_part;
+    // Each BD area is sized from its ring, the buffers follow it
+    uint64_t tx_bd_area = tx_used ? sgBdAreaSize(layout.tx_num_bds) : 0;
+    uint64_t rx_bd_area = rx_used ? sgBdAreaSize(layout.rx_num_bds) : 0;
+    phys_addr_tx_buf = phys_addr_tx_bd + tx_bd_area;
+    phys_addr_rx_buf = phys_addr_rx_bd + rx_bd_area;
+    virt_tx_buf = (uint64_t)m_data_region + tx_bd_area;
+    virt_rx_buf = (uint64_t)m_data_region + tx_part + rx_bd_area;
+
+    setupChannel(m_mm2s_channel, tx_used ? layout.mode_mm2s : DmaMode::UNINITIALIZED,
+                 layout.tx_num_bds, layout.tx_buffer_size, 0);
+    setupChannel(m_s2mm_channel, rx_used ? layout.mode_s2mm : DmaMode::UNINITIALIZED,
+                 layout.rx_num_bds, layout.rx_buffer_size, tx_part);
+
+    m_cyclic_stats = CyclicStats();
+    m_cyclic_held = false;
+    m_cyclic_guard_idx = -1;
+
+    uint32_t rx_bds = m_s2mm_channel.num_bds;
+    m_claim_seq.store(0);
+    m_release_seq.store(0);
+    m_released_bitmap.reset(new std::atomic<uint32_t>[(rx_bds + 31) / 32]);
+    for (uint32_t i = 0; i < (rx_bds + 31) / 32; ++i)
+        m_released_bitmap[i].store(0);
+}
 
-    m_s2mm_channel.mode = mode_s2mm;
-    m_s2mm_channel.num_bds = num_bds;
-    m_s2mm_channel.buffer_size_per_bd = buffer_size;
-    m_s2mm_channel.bd_chain = reinterpret_cast<volatile AxiDmaBufferDescriptor *>(s2mm_bd_base_virt);
-    m_s2mm_channel.bd_chain_phys_addr = s2mm_bd_base_phys;
-    m_s2mm_channel.buffer_phys_address = phys_addr_rx_buf;
-    m_s2mm_channel.head_idx = 0;
-    m_s2mm_channel.tail_idx = 0;
-    setupBdChain(m_s2mm_channel);
+void AxiDmaController::validateRing(const char *name, uint32_t num_bds, uint32_t buffer_size, uint64_t part_size) const
+{
+    std::string prefix = std::string("initSG: ") + name + " ";
+    if (num_bds == 0 || buffer_size == 0)
+        throw std::runtime_error(prefix + "needs at least one BD and a non-zero buffer size.");
+    if (buffer_size > BD_LENGTH_MASK)
+        throw std::runtime_error(prefix + "buffer size exceeds the BD length field.");
+    uint64_t needed = sgBdAreaSize(num_bds) + (uint64_t)num_bds * buffer_size;
+    if (needed > part_size)
+        throw std::runtime_error(prefix + "ring of " + std::to_string(num_bds) + " BDs needs " + std::to_string(needed) +
+                                 " bytes (BD area + buffers), its partition has " + std::to_string(part_size) + ".");
+}
 
+// Builds the BD ring of one channel at `offset` into the region (BD area sized
+// from num_bds first, buffers after it). An unused channel is left without BDs.
+void AxiDmaController::setupChannel(DmaChannel &channel, DmaMode mode, uint32_t num_bds, uint32_t buffer_size, uint64_t offset)
+{
+    channel.mode = mode;
+    channel.head_idx = 0;
+    channel.tail_idx = 0;
+    channel.in_flight = 0;
+    channel.unflushed = 0;
+    channel.counted = 0;
+    if (mode == DmaMode::UNINITIALIZED)
+    {
+        channel.num_bds = 0;
+        channel.buffer_size_per_bd = 0;
+        channel.bd_chain = nullptr;
+        return;
+    }
+    channel.num_bds = num_bds;
+    channel.buffer_size_per_bd = buffer_size;
+    channel.bd_chain = reinterpret_cast<volatile AxiDmaBufferDescriptor *>((uint64_t)m_mem_region + offset);
+    channel.bd_chain_phys_addr = m_mem_phys_addr + offset;
+    channel.buffer_phys_address = m_mem_phys_addr + offset + sgBdAreaSize(num_bds);
+    setupBdChain(channel);
 }
 
 void AxiDmaController::setupBdChain(DmaChannel &channel)
 {
     for (uint32_t i = 0; i < channel.num_bds; ++i)
-    {
-        uint64_t next_bd_phys = channel.bd_chain_phys_addr + ((i + 1) % channel.num_bds) * sizeof(AxiDmaBufferDescriptor);
-        channel.bd_chain[i].next_desc_ptr = next_bd_phys & 0xFFFFFFFF;
-        channel.bd_chain[i].next_desc_ptr_MSB = 0;
-        channel.bd_chain[i].buffer_addr = channel.buffer_phys_address + (i * channel.buffer_size_per_bd);
-        channel.bd_chain[i].buffer_addr_MSB = 0;
-        channel.bd_chain[i].reserved3 = 0;
-        channel.bd_chain[i].reserved4 = 0;
-        channel.bd_chain[i].control = (channel.buffer_size_per_bd & 0x03FFFFFF); // | (1 << 27) | (1 << 26); // Set length, SOF, EOF
-        channel.bd_chain[i].status = 0;
-        for (int j = 0; j < 5; ++j)
-            channel.bd_chain[i].app[j] = 0;
-        // std::cout << "  BD[" << i << "] next_desc_ptr=0x" << std::hex << channel.bd_chain[i].next_desc_ptr
-        //           << " buffer_addr=0x" << channel.bd_chain[i].buffer_addr
-        //           << " control=0x" << channel.bd_chain[i].control
-        //           << " status=0x" << channel.bd_chain[i].status << std::dec << std::endl;
-    }
+        setupBd(channel, i);
+}
+
+// Writes BD i as a fresh, unused descriptor of the chain
+void AxiDmaController::setupBd(DmaChannel &channel, uint32_t i)
+{
+    uint64_t next_bd_phys = channel.bd_chain_phys_addr + ((i + 1) % channel.num_bds) * sizeof(AxiDmaBufferDescriptor);
+    channel.bd_chain[i].next_desc_ptr = next_bd_phys & 0xFFFFFFFF;
+    channel.bd_chain[i].next_desc_ptr_MSB = 0;
+    channel.bd_chain[i].buffer_addr = channel.buffer_phys_address + (i * channel.buffer_size_per_bd);
+    channel.bd_chain[i].buffer_addr_MSB = 0;
+    channel.bd_chain[i].reserved3 = 0;
+    channel.bd_chain[i].reserved4 = 0;
+    channel.bd_chain[i].control = (channel.buffer_size_per_bd & BD_LENGTH_MASK); // | (1 << 27) | (1 << 26); // Set length, SOF, EOF
+    channel.bd_chain[i].status = 0;
+    for (int j = 0; j < 5; ++j)
+        channel.bd_chain[i].app[j] = 0;
+    // std::cout << "  BD[" << i << "] next_desc_ptr=0x" << std::hex << channel.bd_chain[i].next_desc_ptr
+    //           << " buffer_addr=0x" << channel.bd_chain[i].buffer_addr
+    //           << " control=0x" << channel.bd_chain[i].control
+    //           << " status=0x" << channel.bd_chain[i].status << std::dec << std::endl;
 }
 
 void AxiDmaController::startSG(DmaDirection dir)
@@ -305,6 +354,7 @@ void AxiDmaController::startSG(DmaDirection dir)
     DmaChannel &channel = (dir == DmaDirection::TRANSMIT) ? m_mm2s_channel : m_s2mm_channel;
     if (channel.mode == DmaMode::SCATTER_GATHER || channel.mode == DmaMode::CYCLIC)
     {
+        DMA_PROBE(start_sg, dir, 0, channel.buffer_size_per_bd, channel.num_bds);
         if (debug_enabled) {
             std::cout << "[DEBUG] Printing all Buffer Descriptors before starting DMA (dir=" << (dir == DmaDirection::TRANSMIT ? "MM2S" : "S2MM") << ")" << std::endl;
             for (uint32_t i = 0; i < channel.num_bds; ++i)
@@ -320,17 +370,15 @@ void AxiDmaController::startSG(DmaDirection dir)
         uint32_t curdesc_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_CURDESC : S2MM_CURDESC;
         uint32_t taildesc_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_TAILDESC : S2MM_TAILDESC;
 
-        uint32_t cr_val = DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK | DMA_CR_ERR_IRQ_EN_MASK;
-        if (channel.mode == DmaMode::CYCLIC)
-            cr_val |= DMA_CR_CYCLIC_EN_MASK;
-        m_dma_regs[curdesc_offset / 4] = channel.bd_chain_phys_addr & 0xFFFFFFFF;
-        m_dma_regs[cr_offset / 4] = cr_val;
+        uint32_t cr_val = controlValue(channel);
+        writeReg(curdesc_offset, channel.bd_chain_phys_addr & 0xFFFFFFFF);
+        writeReg(cr_offset, cr_val);
         if (dir == DmaDirection::RECEIVE)
-            m_dma_regs[taildesc_offset / 4] = channel.bd_chain_phys_addr + (channel.num_bds - 1) * sizeof(AxiDmaBufferDescriptor);
+            writeReg(taildesc_offset, channel.bd_chain_phys_addr + (channel.num_bds - 1) * sizeof(AxiDmaBufferDescriptor));
         if (debug_enabled) {
-            std::cout<<std::hex<< m_dma_regs[cr_offset / 4]<<std::endl;
-            std::cout<<std::hex<< m_dma_regs[curdesc_offset / 4]<<","<<std::hex<< (channel.bd_chain_phys_addr & 0xFFFFFFFF)<<std::endl;
-            std::cout<<std::hex<< m_dma_regs[taildesc_offset / 4]<<std::endl;            
+            std::cout<<std::hex<< readReg(cr_offset)<<std::endl;
+            std::cout<<std::hex<< readReg(curdesc_offset)<<","<<std::hex<< (channel.bd_chain_phys_addr & 0xFFFFFFFF)<<std::endl;
+            std::cout<<std::hex<< readReg(taildesc_offset)<<std::endl;            
             std::cout << "[DEBUG] Set taildesc (offset 0x" << std::hex << taildesc_offset << ") to 0x" << (channel.bd_chain_phys_addr + (channel.num_bds - 1) * sizeof(AxiDmaBufferDescriptor)) << std::dec << std::endl;
         }
     }
@@ -339,6 +387,29 @@ void AxiDmaController::startSG(DmaDirection dir)
 
 }
 
+void AxiDmaController::setCoalescing(DmaDirection dir, uint8_t threshold, uint8_t delay)
+{
+    DmaChannel &channel = (dir == DmaDirection::TRANSMIT) ? m_mm2s_channel : m_s2mm_channel;
+    channel.irq_threshold = threshold ? threshold : 1; // The hardware ignores a threshold of 0
+    channel.irq_delay = delay;
+
+    // Apply immediately if the channel is already running
+    uint32_t cr_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMACR : S2MM_DMACR;
+    if (readReg(cr_offset) & DMA_CR_RUN_STOP_MASK)
+        writeReg(cr_offset, controlValue(channel));
+}
+
+uint32_t AxiDmaController::controlValue(const DmaChannel &channel) const
+{
+    uint32_t cr_val = DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK | DMA_CR_ERR_IRQ_EN_MASK;
+    cr_val |= ((uint32_t)channel.irq_threshold << DMA_CR_IRQ_THRESHOLD_SHIFT) & DMA_CR_IRQ_THRESHOLD_MASK;
+    if (channel.irq_delay)
+        cr_val |= DMA_CR_DLY_IRQ_EN_MASK | (((uint32_t)channel.irq_delay << DMA_CR_IRQ_DELAY_SHIFT) & DMA_CR_IRQ_DELAY_MASK);
+    if (channel.mode == DmaMode::CYCLIC)
+        cr_val |= DMA_CR_CYCLIC_EN_MASK;
+    return cr_val;
+}
+
 int AxiDmaController::sgTransmit(const void *data_ptr, uint32_t len) {
     DmaChannel &channel = m_mm2s_channel;
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
@@ -349,6 +420,9 @@ int AxiDmaController::sgTransmit(const void *data_ptr, uint32_t len) {
     uint32_t remaining = len;
     uint32_t block_size = channel.buffer_size_per_bd;
     int num_blocks = (len + block_size - 1) / block_size;
+    // Never queue half a packet
+    if (channel.in_flight + num_blocks > channel.num_bds)
+        return 0;
     for (int i = 0; i < num_blocks; ++i) {
         uint32_t this_block = (remaining > block_size) ? block_size : remaining;
         bool sof = (i == 0);
@@ -369,75 +443,129 @@ int AxiDmaController::waitForTransmitCompletionSG() {
     DmaChannel& channel = m_mm2s_channel;
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
         return -1; // Invalid mode
+    if (channel.in_flight == 0)
+        return 0; // Nothing submitted
     checkDmaStatus();
 
-    // Check if the next BD is already complete
-    if (!(channel.bd_chain[channel.tail_idx].status & 0x80000000)) {
-        if (WAIT_METHOD == DmaWaitMode::WAIT_POLL) {
-            // Poll until complete
-            while (!(channel.bd_chain[channel.tail_idx].status & 0x80000000)) {
-                // Optionally add a small sleep or yield here
-            }
-        } else {
-            // Wait for IRQ
-            uint32_t irq_count;
-            ssize_t n = read(m_uio_mm2s_fd, &irq_count, sizeof(irq_count));
-            (void)n;
-        }
-    }
+    // Wait until the next BD is complete. No syscall is made if it already is.
+    int ret;
+    while ((ret = waitForBd(dir, channel, channel.tail_idx)) == 0)
+        ;
+    if (ret < 0)
+        return ret;
 
-    // If still not complete, return 0
-    if (!(channel.bd_chain[channel.tail_idx].status & 0x80000000))
+    reclaimTransmitBd(channel);
+    return 1; // Success
+}
+
+int AxiDmaController::tryTransmitCompletionSG() {
+    DmaChannel& channel = m_mm2s_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+    if (channel.in_flight == 0 || !bdDone(channel.bd_chain[channel.tail_idx].status))
         return 0;
+    reclaimTransmitBd(channel);
+    return 1;
+}
 
-    // Advance tail pointer
+// Reclaims the BD at tail and advances the tail pointer
+void AxiDmaController::reclaimTransmitBd(DmaChannel& channel) {
+    channel.bd_chain[channel.tail_idx].status = 0;
     channel.tail_idx = (channel.tail_idx + 1) % channel.num_bds;
-    resetIRQ(dir);
+    channel.in_flight--;
+    noteRingFreed(DmaDirection::TRANSMIT);
+}
 
-    return 1; // Success
+int AxiDmaController::acquireTransmitBuffer(void** buf, uint32_t* capacity, uint32_t offset) {
+    DmaChannel& channel = m_mm2s_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1;
+    // Check if there is a free BD `offset` slots after head
+    if (channel.in_flight + offset >= channel.num_bds)
+        return 0; // No free BDs
+    int idx = (channel.head_idx + offset) % channel.num_bds;
+    *buf = (void*)(virt_tx_buf + (idx * channel.buffer_size_per_bd));
+    if (capacity)
+        *capacity = channel.buffer_size_per_bd;
+    return 1;
 }
 
-int AxiDmaController::prepareTransmitBlock(const void* data_ptr, uint32_t len, bool sof, bool eof) {
+int AxiDmaController::commitTransmitBlock(uint32_t len, bool sof, bool eof) {
     DmaChannel& channel = m_mm2s_channel;
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
         return -1;
-    // Check if there is a free BD
-    if (channel.bd_chain[channel.head_idx].status & 0x80000000)
+    if (len == 0 || len > channel.buffer_size_per_bd)
+        return -1;
+    if (channel.in_flight >= channel.num_bds)
         return 0; // No free BDs
-    // Copy user data to the DMA buffer
-    uint64_t buf_address_virt = virt_tx_buf + (channel.head_idx * channel.buffer_size_per_bd);
-    void* dma_buffer_virt = (void*)(buf_address_virt);
-    memcpy(dma_buffer_virt, data_ptr, len);
     // Prepare the BD (set SOF/EOF as requested)
-    uint32_t control = (len & 0x03FFFFFF);
-    if (sof) control |= (1 << 27);
-    if (eof) control |= (1 << 26);
+    uint32_t control = (len & BD_LENGTH_MASK);
+    if (sof) control |= BD_CTRL_TXSOF_MASK;
+    if (eof) control |= BD_CTRL_TXEOF_MASK;
     channel.bd_chain[channel.head_idx].control = control;
     channel.bd_chain[channel.head_idx].status = 0;
     // Advance head pointer
     channel.head_idx = (channel.head_idx + 1) % channel.num_bds;
+    channel.in_flight++;
+    channel.unflushed++;
+    noteBlocks(DmaDirection::TRANSMIT, 1, len, channel.in_flight, channel.num_bds);
     return 1;
 }
 
+int AxiDmaController::commitTransmitBlocks(const uint32_t* lens, uint32_t n, bool sof, bool eof) {
+    DmaChannel& channel = m_mm2s_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1;
+    if (channel.in_flight + n > channel.num_bds)
+        return 0; // Not enough free BDs for the whole batch
+    // All or nothing: check every length before the first BD is committed
+    for (uint32_t i = 0; i < n; ++i) {
+        if (lens[i] == 0 || lens[i] > channel.buffer_size_per_bd)
+            return -1;
+    }
+    for (uint32_t i = 0; i < n; ++i)
+        commitTransmitBlock(lens[i], sof && i == 0, eof && i == n - 1);
+    return n;
+}
+
+int AxiDmaController::prepareTransmitBlock(const void* data_ptr, uint32_t len, bool sof, bool eof) {
+    void* dma_buffer_virt;
+    int ret = acquireTransmitBuffer(&dma_buffer_virt, nullptr);
+    if (ret <= 0)
+        return ret;
+    DMA_PROBE(prepare_transmit, DmaDirection::TRANSMIT, m_mm2s_channel.head_idx, len, m_mm2s_channel.in_flight);
+    // Copy user data to the DMA buffer
+    memcpy(dma_buffer_virt, data_ptr, len);
+    return commitTransmitBlock(len, sof, eof);
+}
+
 void AxiDmaController::flushTransmit() {
     DmaChannel& channel = m_mm2s_channel;
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
         return;
+    if (channel.unflushed == 0)
+        return; // Re-writing the same TAILDESC would re-run completed BDs
     int last_idx = (channel.head_idx + channel.num_bds - 1) % channel.num_bds;
     uint64_t bd_address_phys = phys_addr_tx_bd + (last_idx * sizeof(AxiDmaBufferDescriptor));
+    int first_idx = (channel.head_idx + channel.num_bds - channel.unflushed) % channel.num_bds;
+    DMA_PROBE(flush_transmit, DmaDirection::TRANSMIT, first_idx, channel.unflushed, channel.in_flight);
+
+    // Write back the filled buffers before the hardware may fetch them
+    syncRing(false, DmaDirection::TRANSMIT, channel, first_idx, channel.unflushed);
 
     // Check if DMA is halted (idle)
-    uint32_t status = m_dma_regs[MM2S_DMASR / 4];
+    uint32_t status = readReg(MM2S_DMASR);
+    noteDmaStatus(DmaDirection::TRANSMIT, status);
     if (status & DMA_SR_HALTED_MASK) {
-        // Set CURDESC to the first BD in the ring (tail_idx)
-        int first_idx = channel.tail_idx % channel.num_bds;
+        // Set CURDESC to the first BD not yet processed by the hardware
         uint64_t first_bd_phys = phys_addr_tx_bd + (first_idx * sizeof(AxiDmaBufferDescriptor));
-        m_dma_regs[MM2S_CURDESC / 4] = first_bd_phys & 0xFFFFFFFF;
+        writeReg(MM2S_CURDESC, first_bd_phys & 0xFFFFFFFF);
         // Start DMA
-        m_dma_regs[MM2S_DMACR / 4] = DMA_CR_RUN_STOP_MASK | DMA_CR_IOC_IRQ_EN_MASK | DMA_CR_ERR_IRQ_EN_MASK;
+        writeReg(MM2S_DMACR, controlValue(channel));
     }
     // Always update TAILDESC to notify hardware of new BDs
-    m_dma_regs[MM2S_TAILDESC / 4] = bd_address_phys & 0xFFFFFFFF;
+    writeReg(MM2S_TAILDESC, bd_address_phys & 0xFFFFFFFF);
+    channel.unflushed = 0;
 }
 
 int AxiDmaController::sgReceive(void **data_ptr, uint32_t *len)
@@ -447,32 +575,30 @@ int AxiDmaController::sgReceive(void **data_ptr, uint32_t *len)
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
         return -1; // Invalid mode
 
-    // m_dma_regs[S2MM_TAILDESC / 4] = channel.bd_chain_phys_addr + (channel.num_bds - 1) * sizeof(AxiDmaBufferDescriptor);
+    // writeReg(S2MM_TAILDESC, channel.bd_chain_phys_addr + (channel.num_bds - 1) * sizeof(AxiDmaBufferDescriptor));
+    DMA_PROBE(sg_receive_entry, dir, channel.tail_idx, 0, channel.counted);
     checkDmaStatus();
 
-    // Check if the next BD is already complete
-    // std::cout << "[DEBUG] sgReceive: Checking BD status, tail_idx=" << channel.tail_idx << std::endl;
-    // std::cout << "[DEBUG] BD status: 0x" << std::hex << channel.bd_chain[channel.tail_idx].status << std::dec << std::endl;
-    if (!(channel.bd_chain[channel.tail_idx].status & 0x80000000))
-    {
-        // std::cout << "[DEBUG] BD not complete, waiting for IRQ..." << std::endl;
-        uint32_t irq_count;
-        ssize_t n = read(m_uio_s2mm_fd, &irq_count, sizeof(irq_count));
-    }
-
-    // Advance tail pointer and release
-    // channel.tail_idx = (channel.tail_idx + 1) % channel.num_bds;
-    resetIRQ(dir);
-
-    if (!(channel.bd_chain[channel.tail_idx].status & 0x80000000))
-    {
-        std::cout << "[DEBUG] Still no completed BD after IRQ." << std::endl;
-        return 0; // No new block
-    }
+    // Wait until the next BD is complete. No syscall is made if it already is.
+    int ret;
+    while ((ret = waitForBd(dir, channel, channel.tail_idx)) == 0)
+        ;
+    if (ret < 0)
+        return ret;
 
     // Get the address of received data
     *data_ptr = (void *)(virt_rx_buf + (channel.tail_idx * channel.buffer_size_per_bd));
-    *len = channel.bd_chain[channel.tail_idx].status & 0x03FFFFFF;
+    *len = channel.bd_chain[channel.tail_idx].status & BD_LENGTH_MASK;
+    if (channel.counted == 0)
+        DMA_TRACE(dir, AXI_DMA_TRACE_OBSERVED, channel.tail_idx, 1, channel.num_bds);
+    syncBuffers(true, dir, (uint64_t)*data_ptr, *len);
+    if (channel.counted == 0)
+    {
+        channel.counted = 1;
+        noteBlocks(dir, 1, *len, 0, 0);
+        DMA_TRACE(dir, AXI_DMA_TRACE_HANDED, channel.tail_idx, 1, channel.num_bds);
+    }
+    DMA_PROBE(sg_receive_return, dir, channel.tail_idx, *len, channel.counted);
 
     // std::cout << "[DEBUG] Completed BD found! len=" << *len << std::endl;
     return 1; // Success
@@ -480,62 +606,845 @@ int AxiDmaController::sgReceive(void **data_ptr, uint32_t *len)
 
 
 
+int AxiDmaController::sgReceiveBatch(DmaBlock *blocks, uint32_t max_blocks)
+{
+    DmaDirection dir = DmaDirection::RECEIVE;
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+    if (max_blocks == 0)
+        return 0;
+
+    checkDmaStatus();
+
+    // Block until at least the BD at tail_idx is complete
+    int ret;
+    while ((ret = waitForBd(dir, channel, channel.tail_idx)) == 0)
+        ;
+    if (ret < 0)
+        return ret;
+
+    uint32_t count = collectCompleted(channel, blocks, max_blocks);
+    DMA_PROBE(sg_receive_batch, dir, channel.tail_idx, count, channel.counted);
+    return count;
+}
+
+int AxiDmaController::tryReceive(void **data_ptr, uint32_t *len)
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+
+    uint32_t status = channel.bd_chain[channel.tail_idx].status;
+    if (!bdDone(status))
+        return 0; // Nothing yet
+    *data_ptr = (void *)(virt_rx_buf + (channel.tail_idx * channel.buffer_size_per_bd));
+    *len = status & BD_LENGTH_MASK;
+    if (channel.counted == 0)
+        DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_OBSERVED, channel.tail_idx, 1, channel.num_bds);
+    syncBuffers(true, DmaDirection::RECEIVE, (uint64_t)*data_ptr, *len);
+    if (channel.counted == 0)
+    {
+        channel.counted = 1;
+        noteBlocks(DmaDirection::RECEIVE, 1, *len, 0, 0);
+        DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_HANDED, channel.tail_idx, 1, channel.num_bds);
+    }
+    return 1;
+}
+
+int AxiDmaController::tryReceiveBatch(DmaBlock *blocks, uint32_t max_blocks)
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+    return collectCompleted(channel, blocks, max_blocks);
+}
+
+// Hands out every completed BD from tail_idx up to the first incomplete one
+uint32_t AxiDmaController::collectCompleted(DmaChannel &channel, DmaBlock *blocks, uint32_t max_blocks)
+{
+    uint32_t limit = (max_blocks < channel.num_bds) ? max_blocks : channel.num_bds;
+    uint32_t count = 0;
+    uint64_t new_bytes = 0;
+    int idx = channel.tail_idx;
+    while (count < limit)
+    {
+        uint32_t status = channel.bd_chain[idx].status;
+        if (!bdDone(status))
+            break;
+        blocks[count].data = (void *)(virt_rx_buf + (idx * channel.buffer_size_per_bd));
+        blocks[count].len = status & BD_LENGTH_MASK;
+        // Blocks handed out again before their release are counted once
+        if (count >= channel.counted)
+            new_bytes += blocks[count].len;
+        count++;
+        idx = (idx + 1) % channel.num_bds;
+    }
+#ifdef AXI_DMA_TRACE
+    uint64_t observed_ns = nowNs();
+#endif
+    syncRing(true, DmaDirection::RECEIVE, channel, channel.tail_idx, count);
+    if (count > channel.counted)
+    {
+        noteBlocks(DmaDirection::RECEIVE, count - channel.counted, new_bytes, count, channel.num_bds);
+#ifdef AXI_DMA_TRACE
+        // Both stamps are taken before recording, so the per-BD records stay out of the stage
+        uint32_t first_new = (channel.tail_idx + channel.counted) % channel.num_bds;
+        uint64_t handed_ns = nowNs();
+        traceEvent(DmaDirection::RECEIVE, AXI_DMA_TRACE_OBSERVED, first_new, count - channel.counted, channel.num_bds, observed_ns);
+        traceEvent(DmaDirection::RECEIVE, AXI_DMA_TRACE_HANDED, first_new, count - channel.counted, channel.num_bds, handed_ns);
+#endif
+        channel.counted = count;
+    }
+    return count;
+}
+
 void AxiDmaController::releaseBlock(DmaDirection dir)
 {
-    DmaChannel &channel = (dir == DmaDirection::TRANSMIT) ? m_mm2s_channel : m_s2mm_channel;
+    releaseBlocks(dir, 1);
+}
+
+void AxiDmaController::releaseBlocks(DmaDirection dir, uint32_t n)
+{
+    // Transmit BDs go through the reclaim path, so in_flight stays right: only
+    // completed ones, oldest first; BDs the engine still owns are left alone
+    if (dir == DmaDirection::TRANSMIT)
+    {
+        for (uint32_t i = 0; i < n && tryTransmitCompletionSG() > 0; ++i)
+            ;
+        return;
+    }
+
+    DmaChannel &channel = m_s2mm_channel;
     if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
         return;
+    if (n == 0)
+        return;
+    if (n > channel.num_bds)
+        n = channel.num_bds;
 
-    channel.bd_chain[channel.tail_idx].status = 0;
-    channel.tail_idx = (channel.tail_idx + 1) % channel.num_bds;
+    // Hand the received buffers back to the DMA before their BDs are re-armed
+    DMA_TRACE(dir, AXI_DMA_TRACE_RELEASED, channel.tail_idx, n, channel.num_bds);
+    syncRing(false, dir, channel, channel.tail_idx, n);
 
-    if (channel.mode == DmaMode::SCATTER_GATHER && dir == DmaDirection::RECEIVE)
+    for (uint32_t i = 0; i < n; ++i)
     {
-        // Always keep S2MM_TAILDESC at the last BD in the ring
-        uint32_t taildesc_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_TAILDESC : S2MM_TAILDESC;
+        channel.bd_chain[channel.tail_idx].status = 0;
+        channel.tail_idx = (channel.tail_idx + 1) % channel.num_bds;
+    }
+    channel.counted = (channel.counted > n) ? channel.counted - n : 0;
+    noteRingFreed(dir);
+    DMA_PROBE(release_blocks, dir, (channel.tail_idx + channel.num_bds - n) % channel.num_bds, n, channel.counted);
+
+    if (channel.mode == DmaMode::SCATTER_GATHER)
+    {
+        // Always keep S2MM_TAILDESC at the last BD in the ring, one write per batch
         int new_tail_idx = (channel.tail_idx + channel.num_bds - 1) % channel.num_bds;
-        m_dma_regs[taildesc_offset / 4] = channel.bd_chain_phys_addr + new_tail_idx * sizeof(AxiDmaBufferDescriptor);
+        writeReg(S2MM_TAILDESC, channel.bd_chain_phys_addr + new_tail_idx * sizeof(AxiDmaBufferDescriptor));
+    }
+}
+
+//-------------------------------------Multi-consumer receive------------------------------------------------
+
+int AxiDmaController::claimBlock(DmaBlock *block, uint32_t *id)
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+
+    uint64_t seq = m_claim_seq.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        // A BD whose previous occupant is not retired yet still belongs to a consumer
+        if (seq - m_release_seq.load(std::memory_order_acquire) >= channel.num_bds)
+            return 0;
+        uint32_t idx = seq % channel.num_bds;
+        uint32_t status = channel.bd_chain[idx].status;
+        if (!bdDone(status))
+            return 0;
+        if (m_claim_seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            block->data = (void *)(virt_rx_buf + (idx * channel.buffer_size_per_bd));
+            block->len = status & BD_LENGTH_MASK;
+            *id = idx;
+            DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_OBSERVED, idx, 1, channel.num_bds);
+            syncBuffers(true, DmaDirection::RECEIVE, (uint64_t)block->data, block->len);
+            noteBlocks(DmaDirection::RECEIVE, 1, block->len,
+                       (uint32_t)(seq + 1 - m_release_seq.load(std::memory_order_relaxed)), channel.num_bds);
+            DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_HANDED, idx, 1, channel.num_bds);
+            return 1;
+        }
+        // Lost the race, seq now holds the current claim index
     }
 }
 
+int AxiDmaController::claimBlockWait(DmaBlock *block, uint32_t *id)
+{
+    DmaChannel &channel = m_s2mm_channel;
+    int ret = claimBlock(block, id);
+    if (ret != 0)
+        return ret;
+
+    checkDmaStatus();
+    std::unique_lock<std::mutex> lock(m_claim_wait_mutex);
+    for (;;)
+    {
+        ret = claimBlock(block, id);
+        if (ret != 0)
+            return ret;
+
+        uint64_t seq = m_claim_seq.load(std::memory_order_relaxed);
+        if (seq - m_release_seq.load(std::memory_order_seq_cst) < channel.num_bds)
+        {
+            // Sleep until the next BD completes, the other consumers queue on the mutex
+            ret = waitForBd(DmaDirection::RECEIVE, channel, seq % channel.num_bds);
+            if (ret < 0)
+                return ret;
+            continue;
+        }
+        // Every BD is claimed: nothing can complete before a consumer releases one
+        m_claim_full_waiting.store(true, std::memory_order_seq_cst);
+        if (seq - m_release_seq.load(std::memory_order_seq_cst) >= channel.num_bds)
+            m_claim_cv.wait(lock);
+        m_claim_full_waiting.store(false, std::memory_order_relaxed);
+    }
+}
+
+void AxiDmaController::releaseClaimed(uint32_t id)
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return;
+    if (id >= channel.num_bds)
+        return;
+    DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_RELEASED, id, 1, channel.num_bds);
+    m_released_bitmap[id / 32].fetch_or(1u << (id % 32), std::memory_order_seq_cst);
+    retirePending();
+}
+
+// Whoever holds the retire lock advances the prefix. A release that finds
+// the lock taken is picked up by the holder's re-check after unlocking.
+void AxiDmaController::retirePending()
+{
+    DmaChannel &channel = m_s2mm_channel;
+    for (;;)
+    {
+        if (m_retire_lock.exchange(true, std::memory_order_seq_cst))
+            return;
+        uint32_t retired = retireReleased();
+        m_retire_lock.store(false, std::memory_order_seq_cst);
+
+        if (retired && m_claim_full_waiting.load(std::memory_order_seq_cst))
+        {
+            std::lock_guard<std::mutex> lock(m_claim_wait_mutex);
+            m_claim_cv.notify_all();
+        }
+        uint32_t idx = m_release_seq.load(std::memory_order_relaxed) % channel.num_bds;
+        if (!(m_released_bitmap[idx / 32].load(std::memory_order_seq_cst) & (1u << (idx % 32))))
+            return;
+    }
+}
+
+// Retires the contiguous released prefix: clears the BDs, hands their buffers
+// back and moves TAILDESC once. Called with m_retire_lock held.
+uint32_t AxiDmaController::retireReleased()
+{
+    DmaChannel &channel = m_s2mm_channel;
+    uint64_t seq = m_release_seq.load(std::memory_order_relaxed);
+    uint32_t first_idx = seq % channel.num_bds;
+    uint32_t count = 0;
+    while (count < channel.num_bds)
+    {
+        uint32_t idx = (seq + count) % channel.num_bds;
+        uint32_t bit = 1u << (idx % 32);
+        if (!(m_released_bitmap[idx / 32].load(std::memory_order_acquire) & bit))
+            break;
+        m_released_bitmap[idx / 32].fetch_and(~bit, std::memory_order_relaxed);
+        channel.bd_chain[idx].status = 0;
+        count++;
+    }
+    if (count == 0)
+        return 0;
+
+    syncRing(false, DmaDirection::RECEIVE, channel, first_idx, count);
+    // Publish the cleared BDs before claimers may reuse them
+    m_release_seq.store(seq + count, std::memory_order_seq_cst);
+    noteRingFreed(DmaDirection::RECEIVE);
+    if (channel.mode == DmaMode::SCATTER_GATHER)
+    {
+        int new_tail_idx = (seq + count + channel.num_bds - 1) % channel.num_bds;
+        writeReg(S2MM_TAILDESC, channel.bd_chain_phys_addr + new_tail_idx * sizeof(AxiDmaBufferDescriptor));
+    }
+    return count;
+}
+
+//-------------------------------------Cyclic capture--------------------------------------------------------
+
+int AxiDmaController::cyclicReceive(DmaBlock *block, bool wait)
+{
+    DmaDirection dir = DmaDirection::RECEIVE;
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::CYCLIC)
+        return -1; // Invalid mode
+
+    checkDmaStatus();
+    for (;;)
+    {
+        int idx = channel.tail_idx;
+        int prev_idx = (idx + channel.num_bds - 1) % channel.num_bds;
+        if (channel.bd_chain[idx].status & BD_STS_COMPLETE_MASK)
+        {
+            // The previous BD was zeroed on release: complete again means the
+            // engine went all the way round and is past this block
+            if (channel.bd_chain[prev_idx].status & BD_STS_COMPLETE_MASK)
+            {
+                cyclicResync(channel);
+                continue;
+            }
+            if (idx == m_cyclic_guard_idx)
+                m_cyclic_guard_idx = -1;
+            block->data = (void *)(virt_rx_buf + (idx * channel.buffer_size_per_bd));
+            block->len = channel.bd_chain[idx].status & BD_LENGTH_MASK;
+            DMA_TRACE(dir, AXI_DMA_TRACE_OBSERVED, idx, 1, channel.num_bds);
+            syncBuffers(true, dir, (uint64_t)block->data, block->len);
+            m_cyclic_held = true;
+            m_cyclic_stats.blocks++;
+            noteBlocks(dir, 1, block->len, 0, 0);
+            DMA_TRACE(dir, AXI_DMA_TRACE_HANDED, idx, 1, channel.num_bds);
+            return 1;
+        }
+        // The resync zeroed the BD at CURDESC just as the engine completed it:
+        // the engine is past it, so skip it as lost
+        int next_idx = (idx + 1) % channel.num_bds;
+        if (idx == m_cyclic_guard_idx && (channel.bd_chain[next_idx].status & BD_STS_COMPLETE_MASK))
+        {
+            m_cyclic_guard_idx = -1;
+            m_cyclic_stats.blocks_lost++;
+            channel.tail_idx = next_idx;
+            continue;
+        }
+        if (!wait)
+            return 0;
+        int ret = waitForBd(dir, channel, idx);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+int AxiDmaController::cyclicRelease()
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::CYCLIC || !m_cyclic_held)
+        return -1;
+    m_cyclic_held = false;
+
+    // Intact unless the engine completed the previous BD again, i.e. moved on
+    // to this one, while it was held
+    int idx = channel.tail_idx;
+    int prev_idx = (idx + channel.num_bds - 1) % channel.num_bds;
+    int intact = !(channel.bd_chain[prev_idx].status & BD_STS_COMPLETE_MASK);
+    if (!intact)
+        m_cyclic_stats.blocks_corrupted++;
+
+    DMA_TRACE(DmaDirection::RECEIVE, AXI_DMA_TRACE_RELEASED, idx, 1, channel.num_bds);
+    channel.bd_chain[idx].status = 0;
+    channel.tail_idx = (idx + 1) % channel.num_bds;
+    return intact;
+}
+
+void AxiDmaController::setCyclicResyncGap(uint32_t bds)
+{
+    if (bds == 1)
+        throw std::runtime_error("setCyclicResyncGap: the resync gap must be at least 2 BDs.");
+    m_cyclic_gap = bds;
+}
+
+// Moves the reader to `gap` BDs ahead of the engine, onto data from the
+// previous lap that the engine has not reached yet. The BD at CURDESC and the
+// ones up to the reader get their stale status zeroed, nearest to the engine
+// first, so they only show complete once rewritten; the last of them re-arms
+// the lap check. A gap of at least 2 (a ring of at least 3) leaves one to zero.
+void AxiDmaController::cyclicResync(DmaChannel &channel)
+{
+    uint32_t n = channel.num_bds;
+    uint32_t gap = m_cyclic_gap ? m_cyclic_gap : ((n / 8 > 2) ? n / 8 : 2);
+    if (gap > n - 1)
+        gap = n - 1;
+
+    uint64_t curdesc = readReg(S2MM_CURDESC);
+    uint64_t offset = curdesc - (channel.bd_chain_phys_addr & 0xFFFFFFFF);
+    uint32_t hw_idx = (offset < (uint64_t)n * sizeof(AxiDmaBufferDescriptor)) ? offset / sizeof(AxiDmaBufferDescriptor)
+                                                                           : channel.tail_idx;
+    uint32_t target = (hw_idx + gap) % n;
+    for (uint32_t k = 0; k < gap; ++k)
+        channel.bd_chain[(hw_idx + k) % n].status = 0;
+    m_cyclic_guard_idx = hw_idx;
+
+    m_cyclic_stats.overruns++;
+    m_cyclic_stats.blocks_lost += (target + n - channel.tail_idx) % n;
+    channel.tail_idx = target;
+    if (debug_enabled)
+        std::cout << "[DEBUG] Cyclic overrun, resync from BD " << hw_idx << " to BD " << target << std::endl;
+}
+
+//-------------------------------------Error recovery--------------------------------------------------------
+
+int AxiDmaController::recover()
+{
+    std::lock_guard<std::mutex> lock(m_recover_mutex);
+    uint32_t mm2s_errors = getDmaErrors(DmaDirection::TRANSMIT);
+    uint32_t s2mm_errors = getDmaErrors(DmaDirection::RECEIVE);
+    if (!(mm2s_errors | s2mm_errors))
+        return 0;
+    if (debug_enabled)
+        std::cout << "[DEBUG] Recovering from DMA error, MM2S errors 0x" << std::hex << mm2s_errors
+                  << ", S2MM errors 0x" << s2mm_errors << std::dec << std::endl;
+
+    // Releases meanwhile only mark their blocks, the retire below picks them up
+    while (m_retire_lock.exchange(true, std::memory_order_seq_cst))
+        cpuRelax();
+    reset(DmaDirection::RECEIVE); // Resets both channels
+    rearmReceive();
+    rearmTransmit();
+    m_retire_lock.store(false, std::memory_order_seq_cst);
+    if (m_claim_seq.load(std::memory_order_relaxed))
+        retirePending();
+    return 1;
+}
+
+// Restarts S2MM after a soft reset. From the reader's position, the blocks
+// completed before the error keep their BDs; the rest of the ring gets fresh
+// descriptors and the engine starts on the first of them.
+void AxiDmaController::rearmReceive()
+{
+    DmaChannel &channel = m_s2mm_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return;
+    uint32_t n = channel.num_bds;
+    uint32_t first = m_claim_seq.load(std::memory_order_relaxed) ? m_release_seq.load(std::memory_order_relaxed) % n
+                                                                 : channel.tail_idx;
+    uint32_t kept = 0;
+    while (kept < n && bdDone(channel.bd_chain[(first + kept) % n].status))
+        kept++;
+    for (uint32_t k = kept; k < n; ++k)
+        setupBd(channel, (first + k) % n);
+    m_cyclic_guard_idx = -1;
+
+    uint32_t restart = (first + kept) % n;
+    writeReg(S2MM_CURDESC, (channel.bd_chain_phys_addr + restart * sizeof(AxiDmaBufferDescriptor)) & 0xFFFFFFFF);
+    writeReg(S2MM_DMACR, controlValue(channel));
+    // With every BD still held the engine waits for the next release to move TAILDESC
+    if (kept < n || channel.mode == DmaMode::CYCLIC)
+        writeReg(S2MM_TAILDESC, channel.bd_chain_phys_addr + ((first + n - 1) % n) * sizeof(AxiDmaBufferDescriptor));
+}
+
+// Restarts MM2S after a soft reset. Sent BDs stay complete for reclaiming;
+// the flushed BDs not sent yet are queued again from the start of their
+// packet (as far back as it is not reclaimed), so no half packet goes out.
+// Unflushed BDs are left to flushTransmit().
+void AxiDmaController::rearmTransmit()
+{
+    DmaChannel &channel = m_mm2s_channel;
+    if (channel.mode != DmaMode::SCATTER_GATHER && channel.mode != DmaMode::CYCLIC)
+        return;
+    uint32_t n = channel.num_bds;
+    uint32_t flushed = channel.in_flight - channel.unflushed;
+    uint32_t sent = 0;
+    while (sent < flushed && bdDone(channel.bd_chain[(channel.tail_idx + sent) % n].status))
+        sent++;
+    while (sent > 0 && sent < flushed && !(channel.bd_chain[(channel.tail_idx + sent) % n].control & BD_CTRL_TXSOF_MASK))
+        sent--;
+    if (sent == flushed)
+        return; // Halted until flushTransmit() restarts it
+    for (uint32_t k = sent; k < flushed; ++k)
+    {
+        uint32_t idx = (channel.tail_idx + k) % n;
+        uint32_t control = channel.bd_chain[idx].control;
+        setupBd(channel, idx);
+        channel.bd_chain[idx].control = control;
+    }
+
+    uint32_t restart = (channel.tail_idx + sent) % n;
+    uint32_t last = (channel.tail_idx + flushed - 1) % n;
+    writeReg(MM2S_CURDESC, (channel.bd_chain_phys_addr + restart * sizeof(AxiDmaBufferDescriptor)) & 0xFFFFFFFF);
+    writeReg(MM2S_DMACR, controlValue(channel));
+    writeReg(MM2S_TAILDESC, (channel.bd_chain_phys_addr + last * sizeof(AxiDmaBufferDescriptor)) & 0xFFFFFFFF);
+}
+
+//-------------------------------------Real-time readout-----------------------------------------------------
+
+void AxiDmaController::enterRealtime(const RealtimeConfig &config)
+{
+    if (config.lock_memory)
+        axi_dma_rt::lockMemory();
+    prefault();
+    axi_dma_rt::prefaultStack();
+    if (config.cpu >= 0)
+    {
+        axi_dma_rt::pinThread(config.cpu);
+        axi_dma_rt::CpuIsolation iso = axi_dma_rt::cpuIsolation(config.cpu);
+        if (!iso.isolated || !iso.nohz_full)
+            std::cerr << "Warning: readout " << axi_dma_rt::describeIsolation(config.cpu)
+                      << "; other tasks and the tick can still preempt it." << std::endl;
+        else if (debug_enabled)
+            std::cout << "[DEBUG] Readout " << axi_dma_rt::describeIsolation(config.cpu) << std::endl;
+    }
+    if (config.priority > 0)
+        axi_dma_rt::setFifo(config.priority);
+}
+
+void AxiDmaController::prefault()
+{
+    // Reads are enough: the buffers must not be written behind the DMA's back
+    const uint64_t page = 4096;
+    uint32_t sink = 0;
+    for (uint64_t offset = 0; offset < m_mem_size; offset += page)
+    {
+        sink += m_mem_region[offset];
+        if (m_data_region != m_mem_region)
+            sink += m_data_region[offset];
+    }
+    (void)sink;
+}
+
+//-------------------------------------Statistics------------------------------------------------------------
+
+AxiDmaController::ChannelStats AxiDmaController::getStats(DmaDirection dir) const
+{
+    const StatsSlot &slot = m_stats[dir == DmaDirection::TRANSMIT ? 0 : 1];
+    ChannelStats snapshot;
+    uint64_t full_since;
+    for (;;)
+    {
+        uint32_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            cpuRelax();
+            continue;
+        }
+        snapshot = slot.data;
+        full_since = slot.full_since_ns.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.seq.load(std::memory_order_relaxed) == seq)
+            break;
+    }
+    // A full stretch still going on counts up to now
+    if (full_since)
+        snapshot.ring_full_ns += nowNs() - full_since;
+    return snapshot;
+}
+
+void AxiDmaController::resetStats(DmaDirection dir)
+{
+    StatsSlot &slot = statsSlot(dir);
+    statsBegin(slot);
+    slot.data = ChannelStats();
+    slot.full_since_ns.store(0, std::memory_order_relaxed);
+    statsEnd(slot);
+}
+
+void AxiDmaController::statsBegin(StatsSlot &slot)
+{
+    uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        if (!(seq & 1) && slot.seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+            break;
+        cpuRelax();
+        seq = slot.seq.load(std::memory_order_relaxed);
+    }
+    // The odd sequence must be visible before any of the data changes
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void AxiDmaController::statsEnd(StatsSlot &slot)
+{
+    slot.seq.fetch_add(1, std::memory_order_release);
+}
+
+// occupancy = BDs held back right after this event, 0 = not tracked
+void AxiDmaController::noteBlocks(DmaDirection dir, uint32_t n, uint64_t bytes, uint32_t occupancy, uint32_t num_bds)
+{
+    StatsSlot &slot = statsSlot(dir);
+    bool rx = (dir == DmaDirection::RECEIVE);
+    if (rx && occupancy && occupancy < num_bds)
+        slot.free_seen_ns.store(nowNs(), std::memory_order_relaxed);
+    statsBegin(slot);
+    slot.data.blocks += n;
+    slot.data.bytes += bytes;
+    if (occupancy > slot.data.occupancy_hwm)
+        slot.data.occupancy_hwm = occupancy;
+    if (occupancy && occupancy >= num_bds && slot.full_since_ns.load(std::memory_order_relaxed) == 0)
+    {
+        slot.data.ring_full_count++;
+        // A commit fills the TX ring now. The RX ring filled when the engine
+        // completed its last free BD, after the reader last saw one free.
+        uint64_t since = rx ? slot.free_seen_ns.load(std::memory_order_relaxed) : 0;
+        slot.full_since_ns.store(since ? since : nowNs(), std::memory_order_relaxed);
+    }
+    statsEnd(slot);
+}
+
+// Ends a full stretch once BDs go back to the DMA. A receive release also
+// counts as seeing a free BD; a transmit one reads no clock otherwise.
+void AxiDmaController::noteRingFreed(DmaDirection dir)
+{
+    StatsSlot &slot = statsSlot(dir);
+    bool rx = (dir == DmaDirection::RECEIVE);
+    if (!rx && slot.full_since_ns.load(std::memory_order_relaxed) == 0)
+        return;
+    uint64_t now = nowNs();
+    if (rx)
+        slot.free_seen_ns.store(now, std::memory_order_relaxed);
+    if (slot.full_since_ns.load(std::memory_order_relaxed) == 0)
+        return;
+    statsBegin(slot);
+    uint64_t since = slot.full_since_ns.load(std::memory_order_relaxed);
+    if (since)
+    {
+        slot.data.ring_full_ns += now - since;
+        slot.full_since_ns.store(0, std::memory_order_relaxed);
+    }
+    statsEnd(slot);
+}
+
+void AxiDmaController::noteIrq(DmaDirection dir, bool spurious)
+{
+    StatsSlot &slot = statsSlot(dir);
+    statsBegin(slot);
+    slot.data.irqs++;
+    if (spurious)
+        slot.data.spurious_wakeups++;
+    statsEnd(slot);
+}
+
+void AxiDmaController::noteDmaStatus(DmaDirection dir, uint32_t dmasr)
+{
+    uint32_t errors = dmasr & DMA_SR_ANY_ERR_MASK;
+    if (!errors)
+        return;
+    const DmaChannel &channel = (dir == DmaDirection::TRANSMIT) ? m_mm2s_channel : m_s2mm_channel;
+    DMA_PROBE(dma_error, dir, channel.tail_idx, dmasr,
+              dir == DmaDirection::RECEIVE ? channel.counted : channel.in_flight);
+    StatsSlot &slot = statsSlot(dir);
+    statsBegin(slot);
+    slot.data.error_bits |= errors;
+    slot.data.error_reads++;
+    statsEnd(slot);
+}
+
+//-------------------------------------Latency tracing-------------------------------------------------------
+
+size_t AxiDmaController::dumpTrace(const std::string &path) const
+{
+    return m_trace ? m_trace->dump(path) : 0;
+}
+
+void AxiDmaController::clearTrace()
+{
+    if (m_trace)
+        m_trace->clear();
+}
+
+// Records n consecutive BDs from idx with one timestamp
+void AxiDmaController::traceEvent(DmaDirection dir, uint16_t kind, uint32_t idx, uint32_t n, uint32_t num_bds, uint64_t ts)
+{
+    if (!m_trace)
+        return;
+    uint16_t trace_dir = (dir == DmaDirection::TRANSMIT) ? 0 : 1;
+    for (uint32_t i = 0; i < n; ++i)
+        m_trace->record(kind, trace_dir, num_bds ? (idx + i) % num_bds : idx, ts);
+}
+
 
 // ------------------------------------Helper functions-------------------------------------------------------
 
-void AxiDmaController::resetIRQ(DmaDirection dir)
+void AxiDmaController::syncBuffers(bool for_cpu, DmaDirection dir, uint64_t virt, uint64_t len)
 {
-    unsigned int reenable = 1;
-    ssize_t write_return;
+    if (!m_sync_buffers || len == 0)
+        return;
+    uint64_t offset = virt - (uint64_t)m_data_region;
+    if (for_cpu)
+        m_backend->syncForCpu(dir, offset, len);
+    else
+        m_backend->syncForDevice(dir, offset, len);
+}
 
+// Syncs the buffers of `count` consecutive BDs starting at idx, with one call
+// per contiguous range (two when the range wraps around the ring)
+void AxiDmaController::syncRing(bool for_cpu, DmaDirection dir, const DmaChannel &channel, int idx, uint32_t count)
+{
+    if (!m_sync_buffers || count == 0)
+        return;
+    uint64_t base = (dir == DmaDirection::TRANSMIT) ? virt_tx_buf : virt_rx_buf;
+    uint32_t first = (count < channel.num_bds - idx) ? count : channel.num_bds - idx;
+    syncBuffers(for_cpu, dir, base + (uint64_t)idx * channel.buffer_size_per_bd, (uint64_t)first * channel.buffer_size_per_bd);
+    if (count > first)
+        syncBuffers(for_cpu, dir, base, (uint64_t)(count - first) * channel.buffer_size_per_bd);
+}
+
+// Acknowledges the channel interrupt and returns DMASR as it was before. The
+// error bits are read-only and survive the acknowledge, Err_Irq does not.
+uint32_t AxiDmaController::resetIRQ(DmaDirection dir)
+{
     uint32_t dmasr_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMASR : S2MM_DMASR;
-    int uid_fd = (dir == DmaDirection::TRANSMIT) ? m_uio_mm2s_fd : m_uio_s2mm_fd;
 
-    // 1. Write the register
-    m_dma_regs[dmasr_offset / 4] = 0xFFFFFFFF; // Clear all status bits (interrupts and errors)
+    // 1. Write the register, keeping note of error bits before Err_Irq is cleared
+    uint32_t dmasr = readReg(dmasr_offset);
+    noteDmaStatus(dir, dmasr);
+    writeReg(dmasr_offset, 0xFFFFFFFF); // Clear all interrupt bits
     // 2. Reset LINUX interrupt
-    write_return = write(uid_fd, &reenable, sizeof(reenable));
-    (void)write_return;
+    if (m_backend->hasIrq())
+        m_backend->enableIrq(dir);
+    return dmasr;
+}
+
+// Waits until BD idx of the channel is complete. Returns 1 when complete, 0 on
+// a spurious wake-up, DMA_ERROR when the channel halted on a DMA error and -1
+// when the wait itself failed. No syscall is made when the BD is already
+// complete or completes while spinning (WAIT_HYBRID); otherwise the interrupt is
+// acknowledged and re-armed once, the BD is checked again to close the race,
+// and only then does the thread block. A halted channel never completes the
+// BD, so DMASR is checked before sleeping and after a wake-up without data.
+int AxiDmaController::waitForBd(DmaDirection dir, DmaChannel &channel, int idx)
+{
+    const uint32_t done_mask = BD_STS_COMPLETE_MASK | BD_STS_ALL_ERR_MASK;
+    volatile AxiDmaBufferDescriptor &bd = channel.bd_chain[idx];
+    uint32_t status = bd.status;
+    if (status & done_mask)
+        return bdDone(status) ? 1 : DMA_ERROR;
+    uint32_t dmasr_offset = (dir == DmaDirection::TRANSMIT) ? MM2S_DMASR : S2MM_DMASR;
+
+    if (WAIT_METHOD == DmaWaitMode::WAIT_POLL)
+    {
+        // A register read costs far more than a BD read, check DMASR every 4096 spins
+        for (uint32_t i = 1; !((status = bd.status) & done_mask); ++i)
+        {
+            if ((i & 4095) == 0 && (readReg(dmasr_offset) & DMA_SR_ANY_ERR_MASK))
+                return DMA_ERROR;
+            cpuRelax();
+        }
+        return bdDone(status) ? 1 : DMA_ERROR;
+    }
+    if (WAIT_METHOD == DmaWaitMode::WAIT_HYBRID && spinForBd(bd))
+        return bdDone(bd.status) ? 1 : DMA_ERROR;
+
+    if (resetIRQ(dir) & DMA_SR_ANY_ERR_MASK)
+        return DMA_ERROR;
+    status = bd.status;
+    if (status & done_mask)
+        return bdDone(status) ? 1 : DMA_ERROR;
+    uint32_t occupancy = (dir == DmaDirection::RECEIVE) ? channel.counted : channel.in_flight;
+    DMA_PROBE(irq_wait_start, dir, idx, 0, occupancy);
+    if (m_backend->waitIrq(dir) < 0)
+        return -1;
+    DMA_TRACE(dir, AXI_DMA_TRACE_IRQ_WAKE, idx, 1, channel.num_bds);
+    status = bd.status;
+    bool complete = status & done_mask;
+    DMA_PROBE(irq_wait_end, dir, idx, complete ? (status & BD_LENGTH_MASK) : 0, occupancy);
+    noteIrq(dir, !complete);
+    if (!complete)
+    {
+        // Err_Irq, or a completion the BD does not show yet
+        uint32_t dmasr = readReg(dmasr_offset);
+        noteDmaStatus(dir, dmasr);
+        if (dmasr & DMA_SR_ANY_ERR_MASK)
+            return DMA_ERROR;
+        if (debug_enabled)
+            std::cout << "[DEBUG] Still no completed BD after IRQ." << std::endl;
+        return 0;
+    }
+    return bdDone(status) ? 1 : DMA_ERROR;
+}
+
+// Spins on the BD completion (or error) bits within the configured budget
+bool AxiDmaController::spinForBd(volatile AxiDmaBufferDescriptor &bd)
+{
+    if (m_spin_iterations == 0 && m_spin_us == 0)
+        return false;
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now() + std::chrono::microseconds(m_spin_us);
+    for (uint32_t i = 1; ; ++i)
+    {
+        if (bd.status & (BD_STS_COMPLETE_MASK | BD_STS_ALL_ERR_MASK))
+            return true;
+        if (m_spin_iterations && i >= m_spin_iterations)
+            return false;
+        // Reading the clock costs more than a status read, check it every 64 spins
+        if (m_spin_us && (i & 63) == 0 && Clock::now() >= deadline)
+            return false;
+        cpuRelax();
+    }
 }
 
-void AxiDmaController::checkDmaErrors()
+int AxiDmaController::getIrqFd(DmaDirection dir) const
 {
-    uint32_t s2mm_status = m_dma_regs[S2MM_DMASR / 4];
-    uint32_t mm2s_status = m_dma_regs[MM2S_DMASR / 4];
+    return m_backend->hasIrq() ? m_backend->irqFd(dir) : -1;
+}
 
-    if (s2mm_status & DMA_SR_ALL_ERR_MASK)
+int AxiDmaController::armIrq(DmaDirection dir)
+{
+    if (!m_backend->hasIrq())
+        return -1;
+    DmaChannel &channel = (dir == DmaDirection::TRANSMIT) ? m_mm2s_channel : m_s2mm_channel;
+    if (resetIRQ(dir) & DMA_SR_ANY_ERR_MASK)
+        return DMA_ERROR;
+    // Re-check after arming: a BD completed before the re-arm raises no new event.
+    // Consumers that claim blocks read from m_claim_seq, not from tail_idx.
+    if (!channel.num_bds)
+        return 0;
+    uint32_t next_idx = channel.tail_idx;
+    uint64_t seq = m_claim_seq.load(std::memory_order_relaxed);
+    if (dir == DmaDirection::RECEIVE && seq)
     {
-        throw std::runtime_error("S2MM DMA Error: status " + std::to_string(s2mm_status));
+        // Every BD still claimed: nothing to claim until a release
+        if (seq - m_release_seq.load(std::memory_order_acquire) >= channel.num_bds)
+            return 0;
+        next_idx = seq % channel.num_bds;
     }
-    if (mm2s_status & DMA_SR_ALL_ERR_MASK)
+    if (bdDone(channel.bd_chain[next_idx].status))
+        return 1;
+    return 0;
+}
+
+int AxiDmaController::consumeIrq(DmaDirection dir)
+{
+    if (!m_backend->hasIrq())
+        return -1;
+    int ret = m_backend->waitIrq(dir);
+    if (ret >= 0)
     {
-        throw std::runtime_error("MM2S DMA Error: status " + std::to_string(mm2s_status));
+        noteIrq(dir, false);
+        DMA_TRACE(dir, AXI_DMA_TRACE_IRQ_WAKE, (dir == DmaDirection::TRANSMIT ? m_mm2s_channel : m_s2mm_channel).tail_idx, 1, 0);
     }
+    return ret;
+}
+
+void AxiDmaController::setWaitMode(DmaWaitMode mode)
+{
+    if (mode != DmaWaitMode::WAIT_POLL && !m_backend->hasIrq())
+        throw std::runtime_error("Interrupt wait mode requested but no UIO devices are available.");
+    WAIT_METHOD = mode;
+}
+
+void AxiDmaController::setSpinBudget(uint32_t max_iterations, uint32_t max_us)
+{
+    m_spin_iterations = max_iterations;
+    m_spin_us = max_us;
+}
+
+uint32_t AxiDmaController::getDmaErrors(DmaDirection dir)
+{
+    uint32_t dmasr = readReg((dir == DmaDirection::TRANSMIT) ? MM2S_DMASR : S2MM_DMASR);
+    noteDmaStatus(dir, dmasr);
+    return dmasr & DMA_SR_ANY_ERR_MASK;
 }
 
 void AxiDmaController::checkDmaStatus()
 {
     if (!debug_enabled) return;
-    uint32_t s2mm_status = m_dma_regs[S2MM_DMASR / 4];
-    uint32_t mm2s_status = m_dma_regs[MM2S_DMASR / 4];
+    uint32_t s2mm_status = readReg(S2MM_DMASR);
+    uint32_t mm2s_status = readReg(MM2S_DMASR);
     printf("  * Memory-mapped to stream status (0x%08x@0x%02x):\n", mm2s_status, MM2S_DMASR);
     printf("      MM2S_STATUS_REGISTER status register values:\n       ");
     if (mm2s_status & 0x00000001)
@@ -10,13 +10,21 @@
 #ifndef AXI_DMA_CONTROLLER_HPP
 #define AXI_DMA_CONTROLLER_HPP
 
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <stdexcept>
 
 // Forward declaration of the Buffer Descriptor structure
 struct AxiDmaBufferDescriptor;
+// Register/memory backend, see axi_dma_backend.hpp
+class AxiDmaBackend;
+// Latency trace ring, see axi_dma_trace.hpp
+class AxiDmaTraceRing;
 
 class AxiDmaController {
 public:
@@ -33,13 +41,22 @@ public:
     };
 
     enum class DmaWaitMode {
-        WAIT_POLL,
-        WAIT_IRQ
+        WAIT_POLL,   // Busy-spin on the BD status word
+        WAIT_IRQ,    // Block on the UIO interrupt
+        WAIT_HYBRID  // Spin for the configured budget, then block on the UIO interrupt
     };    
 
+    // A completed block handed out by the batch receive API
+    struct DmaBlock {
+        void* data;
+        uint32_t len;
+    };
+
     // Constructor: Opens devices and maps memory. Throws on error.
     AxiDmaController(uint64_t dma_reg_addr, uint64_t mem_phys_addr, uint64_t mem_size);
     AxiDmaController(uint64_t dma_reg_addr, uint64_t mem_phys_addr, uint64_t mem_size, const std::string& uio_mm2s, const std::string& uio_s2mm);
+    // Constructor on an explicit backend (e.g. AxiDmaEmulator). Takes ownership.
+    explicit AxiDmaController(AxiDmaBackend* backend);
 
     // Destructor: Cleans up resources automatically (RAII).
     ~AxiDmaController();
@@ -54,14 +71,178 @@ public:
 
 
     // --- Control for SG/Cyclic Modes ----
+    // Memory layout of the SG rings. The region is split at tx_fraction (page
+    // aligned) into | MM2S BDs | MM2S buffers | S2MM BDs | S2MM buffers |.
+    // A channel with mode UNINITIALIZED is not set up and gets no memory, e.g.
+    // RX-only readout gives the whole region to S2MM. Each partition starts
+    // with its BD area (num_bds descriptors, page aligned); initSG throws if
+    // the BD area and buffers do not fit in the partition.
+    struct SgLayout {
+        DmaMode mode_mm2s = DmaMode::SCATTER_GATHER;
+        DmaMode mode_s2mm = DmaMode::SCATTER_GATHER;
+        uint32_t tx_num_bds = 0;
+        uint32_t tx_buffer_size = 0;
+        uint32_t rx_num_bds = 0;
+        uint32_t rx_buffer_size = 0;
+        double tx_fraction = 0.5;
+    };
+
     void initSG(DmaMode mode_mm2s, DmaMode mode_s2mm, uint32_t num_bds, uint32_t buffer_size);
+    void initSG(const SgLayout& layout);
     void startSG(DmaDirection dir);
+    // Interrupt coalescing: one IRQ per `threshold` completed packets, or after
+    // `delay` delay-timer periods without a new packet. Use a non-zero delay with
+    // threshold > 1, otherwise the last few packets of a burst never interrupt.
+    void setCoalescing(DmaDirection dir, uint8_t threshold, uint8_t delay);
     // Tx and Rx
     int sgTransmit(const void* data_ptr, uint32_t len);
     int sgReceive(void** data_ptr, uint32_t* len);
+    int sgReceiveBatch(DmaBlock* blocks, uint32_t max_blocks);
+    // Non-blocking variants: return 0 immediately when nothing is complete
+    int tryReceive(void** data_ptr, uint32_t* len);
+    int tryReceiveBatch(DmaBlock* blocks, uint32_t max_blocks);
     // Release Tx and Rx
     int waitForTransmitCompletionSG();
+    // Non-blocking: reclaims the oldest transmit BD if it is complete (1), 0 otherwise
+    int tryTransmitCompletionSG();
+    uint32_t transmitInFlight() const { return m_mm2s_channel.in_flight; }
+    // Receive: hands the n oldest blocks back to the DMA. Transmit: reclaims up
+    // to n BDs the engine has completed, as tryTransmitCompletionSG() does;
+    // BDs still in flight are left alone.
     void releaseBlock(DmaDirection dir);
+    void releaseBlocks(DmaDirection dir, uint32_t n);
+
+    // --- Multi-consumer receive ---
+    // Any number of threads claim completed S2MM blocks directly and release
+    // them in any order with the returned id. TAILDESC only advances over the
+    // contiguous prefix of released blocks. Do not mix with sgReceive*/tryReceive*
+    // /releaseBlock(s) on the receive channel. claimBlock() returns 1 (claimed),
+    // 0 (nothing complete) or -1; claimBlockWait() blocks instead of returning 0
+    // and returns DMA_ERROR if the channel halts on an error.
+    int claimBlock(DmaBlock* block, uint32_t* id);
+    int claimBlockWait(DmaBlock* block, uint32_t* id);
+    void releaseClaimed(uint32_t id);
+
+    // --- Cyclic S2MM capture ---
+    // In CYCLIC mode the engine never stops and overwrites blocks the reader
+    // has not consumed yet. The reader zeroes each BD status on release, so a
+    // previous BD that shows complete again means the engine has lapped it.
+    // cyclicReceive() then resynchronises behind the engine (CURDESC plus the
+    // resync gap) without stopping it and counts the loss, before returning
+    // the next block (1, 0 if none is complete and !wait, DMA_ERROR or -1 on
+    // error).
+    // cyclicRelease() returns 1 if the block stayed intact while it was held
+    // and 0 if the engine overwrote it meanwhile (discard what was decoded).
+    struct CyclicStats {
+        uint64_t blocks;            // blocks returned by cyclicReceive
+        uint64_t overruns;          // resynchronisations after the engine lapped the reader
+        uint64_t blocks_lost;       // blocks skipped by resynchronisation (lower bound)
+        uint64_t blocks_corrupted;  // blocks overwritten while held (cyclicRelease returned 0)
+    };
+    int cyclicReceive(DmaBlock* block, bool wait = true);
+    int cyclicRelease();
+    CyclicStats getCyclicStats() const { return m_cyclic_stats; }
+    // BDs left between the engine and the reader after a resync (default: an
+    // eighth of the ring, at least 2); more headroom, more data skipped.
+    // At least 2, so the BD before the reader's new position is one that was
+    // zeroed; a cyclic ring therefore needs at least 3 BDs. 0 restores the default.
+    void setCyclicResyncGap(uint32_t bds);
+
+    // --- Zero-copy SG transmit ---
+    // Fill the buffers in place, commit them, then flushTransmit() once.
+    int acquireTransmitBuffer(void** buf, uint32_t* capacity, uint32_t offset = 0);
+    int commitTransmitBlock(uint32_t len, bool sof, bool eof);
+    // Commits all n blocks or none: 0 without n free BDs, -1 if any length is invalid
+    int commitTransmitBlocks(const uint32_t* lens, uint32_t n, bool sof, bool eof);
+    void flushTransmit();
+
+    // --- Event loop integration ---
+    // getIrqFd() returns the pollable UIO fd of a channel (-1 without interrupts).
+    // armIrq() acknowledges and re-enables the interrupt; it returns 1 if the next
+    // block to receive (or to claim, with claimBlock) is already complete (do not
+    // sleep), 0 if the caller may now wait for the fd to become readable (with
+    // every block claimed, not before a release), DMA_ERROR if the channel halted
+    // on an error (the fd stays quiet until recover()). consumeIrq() reads the
+    // pending event once it has.
+    int getIrqFd(DmaDirection dir) const;
+    int armIrq(DmaDirection dir);
+    int consumeIrq(DmaDirection dir);
+
+    // --- Wait strategy for the SG receive/transmit waits ---
+    // WAIT_IRQ and WAIT_HYBRID need a backend with interrupts. Throws otherwise.
+    void setWaitMode(DmaWaitMode mode);
+    DmaWaitMode getWaitMode() const { return WAIT_METHOD; }
+    // Spin budget of WAIT_HYBRID: spinning stops after max_iterations status
+    // reads or max_us microseconds, whichever comes first (0 = no limit on that
+    // dimension). With both at 0 the hybrid mode does not spin at all.
+    void setSpinBudget(uint32_t max_iterations, uint32_t max_us);
+
+    // --- Error recovery ---
+    // A DMA error halts the channel until the core is reset. The SG waits
+    // (sgReceive*, claimBlockWait, cyclicReceive, waitForTransmitCompletionSG)
+    // and armIrq() then return DMA_ERROR instead of blocking, and
+    // getDmaErrors() returns the DMASR error bits (DMA_SR_*_ERR_MASK) of a
+    // channel. recover() resets the core and re-arms the rings in place:
+    // receive blocks completed before the error keep their BDs and are handed
+    // out as usual, flushed transmit BDs not sent yet are queued again from
+    // the start of their packet. The soft reset is shared by both channels,
+    // so both are restarted. Returns 1 after a reset and 0 if no channel had
+    // an error (e.g. another consumer recovered first). Call it from the
+    // receive thread, not concurrently with the single-consumer receive or
+    // the transmit calls; multi-consumer releases may go on meanwhile.
+    static const int DMA_ERROR = -2;
+    uint32_t getDmaErrors(DmaDirection dir);
+    int recover();
+
+    // --- Real-time readout ---
+    // Opt-in setup for the thread that runs the receive loop, call it from
+    // that thread after initSG(): locks all memory (lock_memory), prefaults
+    // the DMA mappings and the stack, pins the thread to `cpu` (-1 = keep)
+    // and switches it to SCHED_FIFO at `priority` (0 = keep the policy).
+    // Warns if the core is not isolated. Throws on error.
+    struct RealtimeConfig {
+        bool lock_memory = true;
+        int cpu = -1;
+        int priority = 0;
+    };
+    void enterRealtime(const RealtimeConfig& config);
+    // Touches every page of the BD/buffer mappings so the readout never faults
+    void prefault();
+
+    // --- Statistics ---
+    // Always-on counters per direction. The hot path updates them inside a
+    // per-direction sequence counter (seqlock); getStats() takes a consistent
+    // snapshot from any thread without blocking the readout. Occupancy and
+    // ring-full time count the BDs held back from the DMA: RX completed and
+    // not yet released, TX committed and not yet reclaimed. An RX ring that
+    // stays full means the FPGA FIFO is filling up. The reader cannot see when
+    // the engine completes the last free RX BD, so an RX full stretch counts
+    // from the last time the reader saw a free BD (a batch that left some
+    // free, or a release): ring_full_ns is an upper bound, close to the real
+    // time when the reader looks often. The count is of stretches the reader saw.
+    struct ChannelStats {
+        uint64_t bytes;             // Payload received (handed out) or committed for transmit
+        uint64_t blocks;
+        uint64_t irqs;              // Interrupts taken
+        uint64_t spurious_wakeups;  // Woken by an interrupt with the awaited BD still incomplete
+        uint32_t occupancy_hwm;     // Most BDs held back at once
+        uint64_t ring_full_count;   // Times every BD was held back
+        uint64_t ring_full_ns;      // Time every BD was held back, including a full stretch still going on
+        uint32_t error_bits;        // DMASR error bits ever seen
+        uint64_t error_reads;       // DMASR reads that showed error bits
+    };
+    ChannelStats getStats(DmaDirection dir) const;
+    void resetStats(DmaDirection dir);
+
+    // --- Latency tracing ---
+    // Built with AXI_DMA_TRACE (`make TRACE=1`), the receive path timestamps
+    // every BD it handles into a fixed-size ring: interrupt wake-up, BD seen
+    // complete, block handed out, block released (see axi_dma_trace.hpp).
+    // Without it the trace points compile away. dumpTrace() writes the ring
+    // to a file for dma_trace_dump and returns the number of events; it
+    // returns 0 and writes nothing when tracing is not built in.
+    size_t dumpTrace(const std::string& path) const;
+    void clearTrace();
 
     // Debug control
     static void setDebug(bool enable);
@@ -73,14 +254,16 @@ private:
 
     // --- Batch SG transmit helpers ---
     int prepareTransmitBlock(const void* data_ptr, uint32_t len, bool sof, bool eof);
-    void flushTransmit();    
+
+    // --- Register access through the backend ---
+    uint32_t readReg(uint32_t offset);
+    void writeReg(uint32_t offset, uint32_t value);
 
     // --- Private Members ---
     DmaWaitMode WAIT_METHOD;
-
-    int m_uio_mm2s_fd = -1;
-    int m_uio_s2mm_fd = -1;
-    int m_mem_fd = -1;
+    uint32_t m_spin_iterations = 0;
+    uint32_t m_spin_us = 50;
+    std::unique_ptr<AxiDmaBackend> m_backend;
 
 
     // Physical addresses
@@ -93,9 +276,10 @@ private:
     uint64_t phys_addr_rx_bd;
     uint64_t phys_addr_rx_buf;
 
-    // Memory mapped regions
-    volatile uint32_t* m_dma_regs = nullptr;
+    // Memory mapped regions (BDs live in m_mem_region, buffers in m_data_region)
     volatile uint8_t* m_mem_region = nullptr;
+    volatile uint8_t* m_data_region = nullptr;
+    bool m_sync_buffers = false;  // data buffers are cacheable and need explicit sync
     uint64_t virt_tx_buf;
     uint64_t virt_rx_buf;    
 
@@ -109,16 +293,74 @@ private:
         volatile AxiDmaBufferDescriptor* bd_chain = nullptr;
         int head_idx = 0;
         int tail_idx = 0;
+        uint8_t irq_threshold = 1;
+        uint8_t irq_delay = 0;
+        uint32_t in_flight = 0;   // TX: committed BDs not yet reclaimed
+        uint32_t unflushed = 0;   // TX: committed BDs not yet handed to the hardware
+        uint32_t counted = 0;     // RX: BDs from tail_idx already in the stats
         uint64_t bd_chain_phys_addr = 0;
     };
 
     DmaChannel m_mm2s_channel;
     DmaChannel m_s2mm_channel;
 
+    // Multi-consumer receive state. Sequence numbers count BDs since initSG;
+    // BD index = seq % num_bds. Claimable: m_release_seq <= seq < m_release_seq + num_bds.
+    std::atomic<uint64_t> m_claim_seq{0};     // next BD to claim
+    std::atomic<uint64_t> m_release_seq{0};   // first BD not yet handed back to the DMA
+    std::unique_ptr<std::atomic<uint32_t>[]> m_released_bitmap; // released, not yet retired
+    std::atomic<bool> m_retire_lock{false};
+    std::mutex m_claim_wait_mutex;            // one thread sleeps on the interrupt at a time
+    std::condition_variable m_claim_cv;       // ring fully claimed: wait for a release
+    std::atomic<bool> m_claim_full_waiting{false};
+    std::mutex m_recover_mutex;
+
+    // Statistics, one slot per direction. Writers take the sequence counter
+    // (odd while writing) with a CAS, so the multi-consumer paths can update
+    // the same slot; readers retry until they see the same even value twice.
+    struct StatsSlot {
+        std::atomic<uint32_t> seq{0};
+        ChannelStats data = ChannelStats();
+        std::atomic<uint64_t> full_since_ns{0};   // 0 = ring not full
+        std::atomic<uint64_t> free_seen_ns{0};    // RX: last time the reader saw a free BD
+    };
+    StatsSlot m_stats[2];
+    StatsSlot& statsSlot(DmaDirection dir) { return m_stats[dir == DmaDirection::TRANSMIT ? 0 : 1]; }
+    void statsBegin(StatsSlot& slot);
+    void statsEnd(StatsSlot& slot);
+    void noteBlocks(DmaDirection dir, uint32_t n, uint64_t bytes, uint32_t occupancy, uint32_t num_bds);
+    void noteRingFreed(DmaDirection dir);
+    void noteIrq(DmaDirection dir, bool spurious);
+    void noteDmaStatus(DmaDirection dir, uint32_t dmasr);
+
+    // Trace ring, only allocated when built with AXI_DMA_TRACE
+    std::unique_ptr<AxiDmaTraceRing> m_trace;
+    void traceEvent(DmaDirection dir, uint16_t kind, uint32_t idx, uint32_t n, uint32_t num_bds, uint64_t ts);
+
+    // Cyclic capture state
+    CyclicStats m_cyclic_stats = CyclicStats();
+    uint32_t m_cyclic_gap = 0;                // 0 = default
+    bool m_cyclic_held = false;               // a block is out between receive and release
+    int m_cyclic_guard_idx = -1;              // engine BD at the last resync, may still be in flight
+
     // Private helper methods
-    void resetIRQ(DmaDirection dir);
+    uint32_t resetIRQ(DmaDirection dir);
+    int waitForBd(DmaDirection dir, DmaChannel& channel, int idx);
+    uint32_t collectCompleted(DmaChannel& channel, DmaBlock* blocks, uint32_t max_blocks);
+    bool spinForBd(volatile AxiDmaBufferDescriptor& bd);
     void setupBdChain(DmaChannel& channel);
-    void checkDmaErrors();
+    void setupBd(DmaChannel& channel, uint32_t idx);
+    void setupChannel(DmaChannel& channel, DmaMode mode, uint32_t num_bds, uint32_t buffer_size, uint64_t offset);
+    void validateRing(const char* name, uint32_t num_bds, uint32_t buffer_size, uint64_t part_size) const;
+    uint32_t controlValue(const DmaChannel& channel) const;
+    void syncBuffers(bool for_cpu, DmaDirection dir, uint64_t virt, uint64_t len);
+    uint32_t retireReleased();
+    void retirePending();
+    void reclaimTransmitBd(DmaChannel& channel);
+    void cyclicResync(DmaChannel& channel);
+    void rearmReceive();
+    void rearmTransmit();
+    void syncRing(bool for_cpu, DmaDirection dir, const DmaChannel& channel, int idx, uint32_t count);
     void checkDmaStatus();
 };
 
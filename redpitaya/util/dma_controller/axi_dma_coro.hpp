@@ -0,0 +1,330 @@
+// =================================================================================
+// FILE: axi_dma_coro.hpp
+//
+// DESCRIPTION:
+// C++20 coroutine front end for AxiDmaController. Many DMA channels and the
+// stages behind them run as coroutines on one thread: a coroutine that waits
+// for a block suspends on the channel's UIO fd in a small epoll reactor
+// instead of blocking a thread, so there is no context switch per block.
+//
+//   DmaTask<T>   lazy coroutine returning T; co_await it from another task
+//   DmaReactor   epoll loop; spawn() top-level tasks, run() until all finish
+//   AsyncDma     awaitable receive/transmit on one AxiDmaController
+//
+// Usage:
+//   DmaTask<void> reader(AsyncDma& dma) {
+//       for (;;) {
+//           AxiDmaController::DmaBlock block = co_await dma.receive();
+//           co_await decode(block);          // another DmaTask
+//           dma.release();
+//       }
+//   }
+//   DmaReactor reactor;
+//   AsyncDma dma(reactor, ctrl);             // ctrl initialised and started
+//   reactor.spawn(reader(dma));
+//   reactor.run();
+//
+// Pass state to coroutines as parameters: a capturing lambda coroutine
+// refers to its closure, which is gone once spawn() returns.
+//
+// The waits follow the event-loop protocol of the controller: try, armIrq(),
+// and only suspend if nothing completed in between. Backends without
+// interrupts are polled by yielding to the other tasks. One coroutine per
+// direction may wait on an AsyncDma at a time. A DMA error that halts the
+// channel is thrown as std::runtime_error out of the waiting coroutine;
+// AxiDmaController::recover() re-arms the rings for the next one.
+//
+// Header only. Needs -std=c++20 (g++ >= 10); the library itself stays C++11.
+//
+// =================================================================================
+#ifndef AXI_DMA_CORO_HPP
+#define AXI_DMA_CORO_HPP
+
+#if __cplusplus < 202002L
+#error "axi_dma_coro.hpp needs C++20 (-std=c++20)"
+#endif
+
+#include "axi_dma_controller.hpp"
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace axi_dma_coro_detail {
+
+// Resumes whoever awaited the finished task (symmetric transfer)
+struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+    void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+} // namespace axi_dma_coro_detail
+
+template <typename T>
+class DmaTask {
+public:
+    struct promise_type : axi_dma_coro_detail::PromiseBase {
+        std::optional<T> value;
+        DmaTask get_return_object() { return DmaTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_value(T v) { value = std::move(v); }
+    };
+
+    DmaTask(DmaTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    DmaTask(const DmaTask&) = delete;
+    DmaTask& operator=(const DmaTask&) = delete;
+    ~DmaTask() { if (m_handle) m_handle.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    T await_resume() {
+        if (m_handle.promise().error)
+            std::rethrow_exception(m_handle.promise().error);
+        return std::move(*m_handle.promise().value);
+    }
+
+private:
+    explicit DmaTask(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <>
+class DmaTask<void> {
+public:
+    struct promise_type : axi_dma_coro_detail::PromiseBase {
+        DmaTask get_return_object() { return DmaTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        void return_void() {}
+    };
+
+    DmaTask(DmaTask&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    DmaTask(const DmaTask&) = delete;
+    DmaTask& operator=(const DmaTask&) = delete;
+    ~DmaTask() { if (m_handle) m_handle.destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().continuation = awaiting;
+        return m_handle;
+    }
+    void await_resume() {
+        if (m_handle.promise().error)
+            std::rethrow_exception(m_handle.promise().error);
+    }
+
+private:
+    explicit DmaTask(std::coroutine_handle<promise_type> h) : m_handle(h) {}
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+class DmaReactor {
+public:
+    DmaReactor() {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd < 0)
+            throw std::runtime_error("epoll_create1 failed: " + std::string(strerror(errno)));
+    }
+    ~DmaReactor() { close(m_epoll_fd); }
+    DmaReactor(const DmaReactor&) = delete;
+    DmaReactor& operator=(const DmaReactor&) = delete;
+
+    // Starts a top-level task; it runs until its first suspension point.
+    // An exception escaping it is printed and ends only that task.
+    void spawn(DmaTask<void> task) { detach(std::move(task)); }
+
+    // Runs until every spawned task has finished or stop() is called
+    void run() {
+        m_stopped = false;
+        while (!m_stopped && m_tasks > 0) {
+            while (!m_ready.empty() && !m_stopped) {
+                std::coroutine_handle<> h = m_ready.front();
+                m_ready.pop_front();
+                h.resume();
+            }
+            if (m_stopped || m_tasks == 0)
+                break;
+            struct epoll_event events[16];
+            int n = epoll_wait(m_epoll_fd, events, 16, m_ready.empty() ? -1 : 0);
+            if (n < 0 && errno != EINTR)
+                throw std::runtime_error("epoll_wait failed: " + std::string(strerror(errno)));
+            for (int i = 0; i < n; ++i)
+                m_ready.push_back(std::coroutine_handle<>::from_address(events[i].data.ptr));
+        }
+    }
+    void stop() { m_stopped = true; }
+
+    // co_await reactor.readable(fd): suspends until fd is readable (one waiter per fd)
+    auto readable(int fd) {
+        struct Awaiter {
+            DmaReactor& reactor;
+            int fd;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { reactor.watch(fd, h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this, fd};
+    }
+
+    // co_await reactor.yield(): lets the other ready tasks run first
+    auto yield() {
+        struct Awaiter {
+            DmaReactor& reactor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { reactor.m_ready.push_back(h); }
+            void await_resume() const noexcept {}
+        };
+        return Awaiter{*this};
+    }
+
+private:
+    // Top-level frame owning a spawned task, destroys itself when done
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() {}
+        };
+    };
+
+    Detached detach(DmaTask<void> task) {
+        m_tasks++;
+        try {
+            co_await task;
+        } catch (const std::exception& e) {
+            std::cerr << "DMA task failed: " << e.what() << std::endl;
+        }
+        m_tasks--;
+    }
+
+    void watch(int fd, std::coroutine_handle<> h) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.ptr = h.address();
+        // One-shot registrations stay in the set, later waits re-arm them
+        int op = m_registered.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(m_epoll_fd, op, fd, &ev) < 0)
+            throw std::runtime_error("epoll_ctl failed: " + std::string(strerror(errno)));
+        m_registered.insert(fd);
+    }
+
+    int m_epoll_fd = -1;
+    bool m_stopped = false;
+    uint32_t m_tasks = 0;
+    std::deque<std::coroutine_handle<> > m_ready;
+    std::unordered_set<int> m_registered;
+};
+
+class AsyncDma {
+public:
+    typedef AxiDmaController::DmaDirection DmaDirection;
+    typedef AxiDmaController::DmaBlock DmaBlock;
+
+    AsyncDma(DmaReactor& reactor, AxiDmaController& dma) : m_reactor(reactor), m_dma(dma) {}
+
+    // Next received block; hand it back with release() before the next receive()
+    DmaTask<DmaBlock> receive() {
+        DmaBlock block;
+        for (;;) {
+            int ret = m_dma.tryReceive(&block.data, &block.len);
+            if (ret < 0)
+                throw std::runtime_error("Receive failed: channel not in SG/cyclic mode.");
+            if (ret > 0)
+                co_return block;
+            co_await completion(DmaDirection::RECEIVE);
+        }
+    }
+
+    // Every block completed so far (at least one); release them with release(n)
+    DmaTask<uint32_t> receiveBatch(DmaBlock* blocks, uint32_t max_blocks) {
+        for (;;) {
+            int ret = m_dma.tryReceiveBatch(blocks, max_blocks);
+            if (ret < 0)
+                throw std::runtime_error("Receive failed: channel not in SG/cyclic mode.");
+            if (ret > 0)
+                co_return (uint32_t)ret;
+            co_await completion(DmaDirection::RECEIVE);
+        }
+    }
+
+    void release(uint32_t n = 1) { m_dma.releaseBlocks(DmaDirection::RECEIVE, n); }
+
+    // Copies and queues one packet, waiting for free transmit BDs if the ring is full.
+    // Returns the number of BDs used.
+    DmaTask<int> transmit(const void* data, uint32_t len) {
+        for (;;) {
+            int ret = m_dma.sgTransmit(data, len);
+            if (ret < 0)
+                throw std::runtime_error("Transmit failed: channel not in SG/cyclic mode.");
+            if (ret > 0 || len == 0)
+                co_return ret;
+            // Ring full: reclaim what has completed, wait if nothing has
+            if (m_dma.tryTransmitCompletionSG() > 0) {
+                while (m_dma.tryTransmitCompletionSG() > 0)
+                    ;
+                continue;
+            }
+            co_await completion(DmaDirection::TRANSMIT);
+        }
+    }
+
+    // Waits until every queued transmit BD has completed and is reclaimed
+    DmaTask<void> transmitDrain() {
+        while (m_dma.transmitInFlight() > 0) {
+            if (m_dma.tryTransmitCompletionSG() > 0)
+                continue;
+            co_await completion(DmaDirection::TRANSMIT);
+        }
+    }
+
+private:
+    // Suspends until the channel may have completed a BD
+    DmaTask<void> completion(DmaDirection dir) {
+        int fd = m_dma.getIrqFd(dir);
+        if (fd < 0) {
+            // Polled: no armIrq() to report a halt, read DMASR instead
+            if (m_dma.getDmaErrors(dir))
+                throw std::runtime_error("DMA error while waiting, call recover() before resuming");
+            co_await m_reactor.yield();
+            co_return;
+        }
+        // A BD that completed before the re-arm raises no new event
+        int armed = m_dma.armIrq(dir);
+        if (armed == 1)
+            co_return;
+        if (armed == AxiDmaController::DMA_ERROR)
+            throw std::runtime_error("DMA error while waiting, call recover() before resuming");
+        co_await m_reactor.readable(fd);
+        m_dma.consumeIrq(dir);
+    }
+
+    DmaReactor& m_reactor;
+    AxiDmaController& m_dma;
+};
+
+#endif // AXI_DMA_CORO_HPP
@@ -0,0 +1,554 @@
+// =================================================================================
+// FILE: axi_dma_emulator.cpp
+//
+// DESCRIPTION:
+// Implementation of the software AXI DMA model. Register semantics follow
+// PG021: DMASR interrupt bits are write-one-to-clear, a soft reset resets both
+// channels, a SG channel processes descriptors from CURDESC up to TAILDESC and
+// raises SGIntErr when it fetches a descriptor that is still marked complete.
+//
+// =================================================================================
+#include "axi_dma_emulator.hpp"
+#include "axi_dma_regs.hpp"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+constexpr uint32_t DMA_CR_RESET_VALUE = 0x00010000; // IRQThreshold = 1
+
+constexpr uint64_t AxiDmaEmulator::DEFAULT_REGS_ADDR;
+constexpr uint64_t AxiDmaEmulator::DEFAULT_MEM_ADDR;
+constexpr size_t AxiDmaEmulator::LOOPBACK_FIFO_PACKETS;
+constexpr uint32_t AxiDmaEmulator::DELAY_TIMER_UNIT_NS;
+
+static uint32_t irqThreshold(uint32_t dmacr)
+{
+    return (dmacr & DMA_CR_IRQ_THRESHOLD_MASK) >> DMA_CR_IRQ_THRESHOLD_SHIFT;
+}
+
+static uint32_t irqDelay(uint32_t dmacr)
+{
+    return (dmacr & DMA_CR_IRQ_DELAY_MASK) >> DMA_CR_IRQ_DELAY_SHIFT;
+}
+
+AxiDmaEmulator::AxiDmaEmulator(uint64_t mem_size, bool use_irq, uint64_t mem_phys_addr, uint64_t dma_regs_addr)
+    : m_dma_regs_addr(dma_regs_addr), m_mem_phys_addr(mem_phys_addr), m_mem_size(mem_size), m_use_irq(use_irq)
+{
+    void *mem = mmap(NULL, m_mem_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::runtime_error("Emulator memory allocation failed.");
+    m_mem = static_cast<volatile uint8_t *>(mem);
+
+    if (m_use_irq)
+    {
+        m_mm2s.event_fd = eventfd(0, EFD_CLOEXEC);
+        m_s2mm.event_fd = eventfd(0, EFD_CLOEXEC);
+        if (m_mm2s.event_fd < 0 || m_s2mm.event_fd < 0)
+        {
+            if (m_mm2s.event_fd >= 0)
+                close(m_mm2s.event_fd);
+            if (m_s2mm.event_fd >= 0)
+                close(m_s2mm.event_fd);
+            munmap(mem, m_mem_size);
+            throw std::runtime_error("Failed to create emulated UIO eventfd.");
+        }
+    }
+
+    resetCore();
+    m_thread = std::thread(&AxiDmaEmulator::run, this);
+}
+
+AxiDmaEmulator::~AxiDmaEmulator()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    if (m_mm2s.event_fd >= 0)
+        close(m_mm2s.event_fd);
+    if (m_s2mm.event_fd >= 0)
+        close(m_s2mm.event_fd);
+    munmap((void *)m_mem, m_mem_size);
+}
+
+// ------------------------------------Register interface-------------------------------------------------
+
+uint32_t AxiDmaEmulator::readReg(uint32_t offset)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Channel &ch = (offset < S2MM_DMACR) ? m_mm2s : m_s2mm;
+    switch (offset)
+    {
+    case MM2S_DMACR:
+    case S2MM_DMACR:
+        return ch.dmacr;
+    case MM2S_DMASR:
+    case S2MM_DMASR:
+    {
+        uint32_t sr = ch.dmasr | DMA_SR_SG_INCLD_MASK;
+        if (!(sr & DMA_SR_HALTED_MASK) && ch.idle && !ch.direct_pending)
+            sr |= DMA_SR_IDLE_MASK;
+        return sr;
+    }
+    case MM2S_CURDESC:
+    case S2MM_CURDESC:
+        return ch.lastdesc & 0xFFFFFFFF;
+    case MM2S_TAILDESC:
+    case S2MM_TAILDESC:
+        return ch.taildesc & 0xFFFFFFFF;
+    case MM2S_SA:
+    case S2MM_DA:
+        return ch.addr & 0xFFFFFFFF;
+    case MM2S_LENGTH:
+    case S2MM_LENGTH:
+        return ch.length;
+    default:
+        return 0;
+    }
+}
+
+void AxiDmaEmulator::writeReg(uint32_t offset, uint32_t value)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Channel &ch = (offset < S2MM_DMACR) ? m_mm2s : m_s2mm;
+        switch (offset)
+        {
+        case MM2S_DMACR:
+        case S2MM_DMACR:
+            writeControl(ch, value);
+            break;
+        case MM2S_DMASR:
+        case S2MM_DMASR:
+            // Interrupt bits are write-one-to-clear, everything else is read-only
+            ch.dmasr &= ~(value & DMA_SR_ALL_IRQ_MASK);
+            break;
+        case MM2S_CURDESC:
+        case S2MM_CURDESC:
+            // Only writable while the channel is halted
+            if (ch.dmasr & DMA_SR_HALTED_MASK)
+                ch.curdesc = ch.lastdesc = value;
+            break;
+        case MM2S_TAILDESC:
+        case S2MM_TAILDESC:
+            ch.taildesc = value;
+            ch.idle = false;
+            break;
+        case MM2S_SA:
+        case S2MM_DA:
+            ch.addr = value;
+            break;
+        case MM2S_LENGTH:
+        case S2MM_LENGTH:
+            if ((ch.dmacr & DMA_CR_RUN_STOP_MASK) && !(ch.dmasr & DMA_SR_HALTED_MASK))
+            {
+                ch.length = value & BD_LENGTH_MASK;
+                ch.direct_pending = true;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    m_cv.notify_all();
+}
+
+int AxiDmaEmulator::irqFd(DmaDirection dir) const
+{
+    return (dir == DmaDirection::TRANSMIT) ? m_mm2s.event_fd : m_s2mm.event_fd;
+}
+
+int AxiDmaEmulator::waitIrq(DmaDirection dir)
+{
+    uint64_t count;
+    ssize_t nbytes = read(irqFd(dir), &count, sizeof(count));
+    if (nbytes != sizeof(count))
+        return -1;
+    return (int)count;
+}
+
+void AxiDmaEmulator::enableIrq(DmaDirection dir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Channel &ch = channel(dir);
+    ch.irq_enabled = true;
+    // The interrupt line is level triggered: re-arming with an unacknowledged
+    // status bit fires again immediately, as with the real UIO device.
+    updateIrq(ch);
+}
+
+void AxiDmaEmulator::setStreamSource(StreamSource source, double packets_per_sec)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_source = std::make_shared<StreamSource>(source);
+    m_source_period = (packets_per_sec > 0)
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / packets_per_sec))
+        : Clock::duration::zero();
+    m_next_packet = Clock::now();
+    m_fifo.clear();
+    m_cv.notify_all();
+}
+
+void AxiDmaEmulator::setLoopback()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_source.reset();
+    m_cv.notify_all();
+}
+
+void AxiDmaEmulator::injectError(DmaDirection dir, uint32_t err_bits)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    channel(dir).inject_error = err_bits & DMA_SR_ANY_ERR_MASK;
+    m_cv.notify_all();
+}
+
+// ------------------------------------Engine model (m_mutex held)----------------------------------------
+
+uint8_t *AxiDmaEmulator::toVirt(uint64_t phys, uint64_t len)
+{
+    if (phys < m_mem_phys_addr || phys + len > m_mem_phys_addr + m_mem_size)
+        return nullptr;
+    return (uint8_t *)m_mem + (phys - m_mem_phys_addr);
+}
+
+void AxiDmaEmulator::resetCore()
+{
+    // A soft reset on either channel resets the whole core
+    Channel *channels[2] = {&m_mm2s, &m_s2mm};
+    for (Channel *ch : channels)
+    {
+        ch->dmacr = DMA_CR_RESET_VALUE;
+        ch->dmasr = DMA_SR_HALTED_MASK;
+        ch->curdesc = ch->lastdesc = ch->taildesc = 0;
+        ch->idle = true;
+        ch->addr = 0;
+        ch->length = 0;
+        ch->direct_pending = false;
+        ch->irq_countdown = 1;
+        ch->delay_armed = false;
+    }
+    m_fifo.clear();
+    m_reset_count++;
+}
+
+void AxiDmaEmulator::writeControl(Channel &ch, uint32_t value)
+{
+    if (value & DMA_CR_RESET_MASK)
+    {
+        resetCore();
+        return;
+    }
+    // Writing an IRQThreshold of zero has no effect
+    if (irqThreshold(value) == 0)
+        value = (value & ~DMA_CR_IRQ_THRESHOLD_MASK) | (ch.dmacr & DMA_CR_IRQ_THRESHOLD_MASK);
+    if (irqThreshold(value) != irqThreshold(ch.dmacr))
+        ch.irq_countdown = irqThreshold(value);
+    ch.dmacr = value;
+    if (!(value & DMA_CR_RUN_STOP_MASK))
+        ch.dmasr |= DMA_SR_HALTED_MASK;
+    else if (!(ch.dmasr & DMA_SR_ANY_ERR_MASK))
+        ch.dmasr &= ~DMA_SR_HALTED_MASK; // An errored channel stays halted until reset
+    updateIrq(ch);
+}
+
+bool AxiDmaEmulator::sgReady(const Channel &ch) const
+{
+    if (!(ch.dmacr & DMA_CR_RUN_STOP_MASK) || (ch.dmasr & DMA_SR_HALTED_MASK))
+        return false;
+    return (ch.dmacr & DMA_CR_CYCLIC_EN_MASK) || !ch.idle;
+}
+
+volatile AxiDmaBufferDescriptor *AxiDmaEmulator::fetchDescriptor(Channel &ch)
+{
+    volatile AxiDmaBufferDescriptor *bd =
+        reinterpret_cast<volatile AxiDmaBufferDescriptor *>(toVirt(ch.curdesc, sizeof(AxiDmaBufferDescriptor)));
+    if (!bd)
+    {
+        raiseError(ch, DMA_SR_SG_DEC_ERR_MASK);
+        return nullptr;
+    }
+    // Outside cyclic mode the engine refuses descriptors it has already completed
+    if (!(ch.dmacr & DMA_CR_CYCLIC_EN_MASK) && (bd->status & BD_STS_COMPLETE_MASK))
+    {
+        raiseError(ch, DMA_SR_SG_INT_ERR_MASK);
+        return nullptr;
+    }
+    if (ch.inject_error)
+    {
+        // DMAIntErr/SlvErr/DecErr map onto the BD status error bits
+        bd->status = (ch.inject_error & DMA_SR_ALL_ERR_MASK) << 24;
+        raiseError(ch, ch.inject_error);
+        ch.inject_error = 0;
+        return nullptr;
+    }
+    return bd;
+}
+
+void AxiDmaEmulator::completeDescriptor(Channel &ch, volatile AxiDmaBufferDescriptor *bd, uint32_t status)
+{
+    // Data must be visible before the completion bit
+    std::atomic_thread_fence(std::memory_order_release);
+    bd->status = status;
+
+    ch.lastdesc = ch.curdesc;
+    if (!(ch.dmacr & DMA_CR_CYCLIC_EN_MASK) && ch.curdesc == ch.taildesc)
+        ch.idle = true;
+    ch.curdesc = ((uint64_t)bd->next_desc_ptr_MSB << 32) | bd->next_desc_ptr;
+
+    if (status & (BD_STS_RXEOF_MASK | BD_CTRL_TXEOF_MASK))
+    {
+        if (--ch.irq_countdown == 0)
+        {
+            ch.irq_countdown = irqThreshold(ch.dmacr);
+            ch.delay_armed = false;
+            ch.dmasr |= DMA_SR_IOC_IRQ_MASK;
+            updateIrq(ch);
+        }
+        else if (irqDelay(ch.dmacr))
+        {
+            // (Re)start the delay timer on every packet below the threshold
+            ch.delay_armed = true;
+            ch.delay_deadline = Clock::now() + std::chrono::nanoseconds((uint64_t)irqDelay(ch.dmacr) * DELAY_TIMER_UNIT_NS);
+        }
+    }
+}
+
+bool AxiDmaEmulator::checkDelayTimer(Channel &ch, Clock::time_point now)
+{
+    if (!ch.delay_armed || now < ch.delay_deadline)
+        return false;
+    ch.delay_armed = false;
+    ch.irq_countdown = irqThreshold(ch.dmacr);
+    ch.dmasr |= DMA_SR_DLY_IRQ_MASK;
+    updateIrq(ch);
+    return true;
+}
+
+void AxiDmaEmulator::raiseError(Channel &ch, uint32_t err_bits)
+{
+    ch.dmasr |= err_bits | DMA_SR_ERR_IRQ_MASK | DMA_SR_HALTED_MASK;
+    updateIrq(ch);
+}
+
+void AxiDmaEmulator::updateIrq(Channel &ch)
+{
+    if (!m_use_irq)
+        return;
+    bool asserted = (ch.dmasr & ch.dmacr & DMA_SR_ALL_IRQ_MASK) != 0;
+    if (asserted && ch.irq_enabled)
+    {
+        // UIO masks the line until user space re-enables it
+        ch.irq_enabled = false;
+        uint64_t one = 1;
+        ssize_t n = write(ch.event_fd, &one, sizeof(one));
+        (void)n;
+    }
+}
+
+bool AxiDmaEmulator::stepMm2s()
+{
+    Channel &ch = m_mm2s;
+    bool loopback = !m_source;
+    if (loopback && m_fifo.size() >= LOOPBACK_FIFO_PACKETS)
+        return false; // Back-pressure from the stream side
+
+    if (ch.direct_pending)
+    {
+        uint8_t *src = toVirt(ch.addr, ch.length);
+        ch.direct_pending = false;
+        if (!src)
+        {
+            raiseError(ch, DMA_SR_DMA_DEC_ERR_MASK);
+            return true;
+        }
+        if (loopback)
+        {
+            m_fifo.emplace_back();
+            m_fifo.back().data.assign(src, src + ch.length);
+            m_fifo.back().complete = true;
+        }
+        m_mm2s_packets.fetch_add(1, std::memory_order_relaxed);
+        ch.dmasr |= DMA_SR_IOC_IRQ_MASK;
+        updateIrq(ch);
+        return true;
+    }
+
+    if (!sgReady(ch))
+        return false;
+    volatile AxiDmaBufferDescriptor *bd = fetchDescriptor(ch);
+    if (!bd)
+        return true;
+    uint32_t control = bd->control;
+    uint32_t len = control & BD_LENGTH_MASK;
+    uint8_t *src = toVirt(((uint64_t)bd->buffer_addr_MSB << 32) | bd->buffer_addr, len);
+    if (!src)
+    {
+        bd->status = BD_STS_DEC_ERR_MASK;
+        raiseError(ch, DMA_SR_DMA_DEC_ERR_MASK);
+        return true;
+    }
+
+    bool eof = control & BD_CTRL_TXEOF_MASK;
+    if (loopback)
+    {
+        if (m_fifo.empty() || m_fifo.back().complete)
+            m_fifo.emplace_back();
+        Packet &pkt = m_fifo.back();
+        pkt.data.insert(pkt.data.end(), src, src + len);
+        pkt.complete = eof;
+    }
+    if (eof)
+        m_mm2s_packets.fetch_add(1, std::memory_order_relaxed);
+    completeDescriptor(ch, bd, BD_STS_COMPLETE_MASK | (eof ? BD_CTRL_TXEOF_MASK : 0) | len);
+    return true;
+}
+
+bool AxiDmaEmulator::stepS2mmLoopback()
+{
+    Channel &ch = m_s2mm;
+    if (m_fifo.empty() || !m_fifo.front().complete)
+        return false;
+    Packet &pkt = m_fifo.front();
+    size_t remaining = pkt.data.size() - pkt.offset;
+
+    if (ch.direct_pending)
+    {
+        uint8_t *dst = toVirt(ch.addr, ch.length);
+        ch.direct_pending = false;
+        if (!dst)
+        {
+            raiseError(ch, DMA_SR_DMA_DEC_ERR_MASK);
+            return true;
+        }
+        uint32_t n = (uint32_t)std::min<size_t>(remaining, ch.length);
+        memcpy(dst, pkt.data.data() + pkt.offset, n);
+        ch.length = n; // LENGTH reads back the number of bytes received
+        m_fifo.pop_front();
+        m_s2mm_packets.fetch_add(1, std::memory_order_relaxed);
+        m_s2mm_bytes.fetch_add(n, std::memory_order_relaxed);
+        ch.dmasr |= DMA_SR_IOC_IRQ_MASK;
+        updateIrq(ch);
+        return true;
+    }
+
+    if (!sgReady(ch))
+        return false;
+    volatile AxiDmaBufferDescriptor *bd = fetchDescriptor(ch);
+    if (!bd)
+        return true;
+    uint32_t cap = bd->control & BD_LENGTH_MASK;
+    uint8_t *dst = toVirt(((uint64_t)bd->buffer_addr_MSB << 32) | bd->buffer_addr, cap);
+    if (!dst)
+    {
+        bd->status = BD_STS_DEC_ERR_MASK;
+        raiseError(ch, DMA_SR_DMA_DEC_ERR_MASK);
+        return true;
+    }
+
+    uint32_t n = (uint32_t)std::min<size_t>(remaining, cap);
+    uint32_t status = BD_STS_COMPLETE_MASK | n;
+    if (pkt.offset == 0)
+        status |= BD_STS_RXSOF_MASK;
+    memcpy(dst, pkt.data.data() + pkt.offset, n);
+    pkt.offset += n;
+    if (pkt.offset == pkt.data.size())
+    {
+        status |= BD_STS_RXEOF_MASK;
+        m_fifo.pop_front();
+        m_s2mm_packets.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_s2mm_bytes.fetch_add(n, std::memory_order_relaxed);
+    completeDescriptor(ch, bd, status);
+    return true;
+}
+
+bool AxiDmaEmulator::stepS2mmSource(std::unique_lock<std::mutex> &lock)
+{
+    Channel &ch = m_s2mm;
+    bool timed = m_source_period != Clock::duration::zero();
+    if (timed && Clock::now() < m_next_packet)
+        return false;
+
+    std::shared_ptr<StreamSource> source = m_source;
+    if (!sgReady(ch))
+    {
+        if (!timed)
+            return false; // Free-running source simply waits for a descriptor
+        // No free descriptor when the packet is due: the FPGA FIFO drops it
+        if (m_scratch.size() < 0x10000)
+            m_scratch.resize(0x10000);
+        lock.unlock();
+        uint32_t n = (*source)(m_scratch.data(), (uint32_t)m_scratch.size());
+        lock.lock();
+        if (n == 0)
+            return false;
+        m_next_packet += m_source_period;
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    volatile AxiDmaBufferDescriptor *bd = fetchDescriptor(ch);
+    if (!bd)
+        return true;
+    uint32_t cap = bd->control & BD_LENGTH_MASK;
+    uint8_t *dst = toVirt(((uint64_t)bd->buffer_addr_MSB << 32) | bd->buffer_addr, cap);
+    if (!dst)
+    {
+        bd->status = BD_STS_DEC_ERR_MASK;
+        raiseError(ch, DMA_SR_DMA_DEC_ERR_MASK);
+        return true;
+    }
+
+    // Generate straight into the DMA buffer without holding the register lock
+    uint64_t reset_count = m_reset_count;
+    lock.unlock();
+    uint32_t n = std::min((*source)(dst, cap), cap);
+    lock.lock();
+    if (n == 0 || reset_count != m_reset_count)
+        return false; // Nothing produced, or the core was reset meanwhile
+    if (timed)
+        m_next_packet += m_source_period;
+    m_s2mm_packets.fetch_add(1, std::memory_order_relaxed);
+    m_s2mm_bytes.fetch_add(n, std::memory_order_relaxed);
+    completeDescriptor(ch, bd, BD_STS_COMPLETE_MASK | BD_STS_RXSOF_MASK | BD_STS_RXEOF_MASK | n);
+    return true;
+}
+
+void AxiDmaEmulator::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+        bool progress = stepMm2s();
+        progress |= m_source ? stepS2mmSource(lock) : stepS2mmLoopback();
+        Clock::time_point now = Clock::now();
+        progress |= checkDelayTimer(m_mm2s, now);
+        progress |= checkDelayTimer(m_s2mm, now);
+        if (progress)
+            continue;
+
+        // Sleep until a register write, the next packet or the next delay timeout
+        Clock::time_point wake = Clock::time_point::max();
+        if (m_source)
+        {
+            bool timed = m_source_period != Clock::duration::zero();
+            wake = (timed && m_next_packet > now) ? m_next_packet : now + std::chrono::microseconds(100);
+        }
+        if (m_mm2s.delay_armed)
+            wake = std::min(wake, m_mm2s.delay_deadline);
+        if (m_s2mm.delay_armed)
+            wake = std::min(wake, m_s2mm.delay_deadline);
+
+        if (wake == Clock::time_point::max())
+            m_cv.wait(lock);
+        else
+            m_cv.wait_until(lock, wake);
+    }
+}
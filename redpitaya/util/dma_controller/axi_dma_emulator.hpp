@@ -0,0 +1,161 @@
+// =================================================================================
+// FILE: axi_dma_emulator.hpp
+//
+// DESCRIPTION:
+// Software model of the AXI DMA engine, implementing the AxiDmaBackend
+// interface. The register block and the reserved memory live in process
+// memory; a worker thread walks the buffer descriptor chains between CURDESC
+// and TAILDESC (or forever in cyclic mode), writes completion status and
+// length into each BD and raises emulated UIO interrupts through eventfds.
+//
+// The S2MM stream is fed either by the MM2S channel (loopback, the default,
+// like the FPGA loopback design) or by a user supplied packet source that
+// stands in for the TDC packetiser. With a packet rate set, packets that find
+// no free S2MM descriptor are dropped and counted, like the FPGA FIFO.
+//
+// Interrupt coalescing follows DMACR: IOC_Irq is raised once per IRQThreshold
+// completed packets, Dly_Irq when IRQDelay timer periods pass without a new
+// packet while completions are pending.
+//
+// Usage:
+//   AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+//   AxiDmaController dma(emu);   // the controller takes ownership
+//
+// =================================================================================
+#ifndef AXI_DMA_EMULATOR_HPP
+#define AXI_DMA_EMULATOR_HPP
+
+#include "axi_dma_backend.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class AxiDmaEmulator : public AxiDmaBackend {
+public:
+    // Fills dst with one packet of at most max_len bytes and returns its length.
+    // Returning 0 means no packet is ready yet.
+    typedef std::function<uint32_t(uint8_t* dst, uint32_t max_len)> StreamSource;
+
+    // Default addresses match the Red Pitaya design used by the examples
+    static constexpr uint64_t DEFAULT_REGS_ADDR = 0x40400000;
+    static constexpr uint64_t DEFAULT_MEM_ADDR = 0x1000000;
+
+    explicit AxiDmaEmulator(uint64_t mem_size, bool use_irq = true,
+                            uint64_t mem_phys_addr = DEFAULT_MEM_ADDR,
+                            uint64_t dma_regs_addr = DEFAULT_REGS_ADDR);
+    ~AxiDmaEmulator();
+
+    // --- AxiDmaBackend interface ---
+    uint32_t readReg(uint32_t offset);
+    void writeReg(uint32_t offset, uint32_t value);
+
+    volatile uint8_t* memRegion() { return m_mem; }
+    uint64_t memPhysAddr() const { return m_mem_phys_addr; }
+    uint64_t memSize() const { return m_mem_size; }
+    uint64_t regsPhysAddr() const { return m_dma_regs_addr; }
+
+    bool hasIrq() const { return m_use_irq; }
+    int irqFd(DmaDirection dir) const;
+    int waitIrq(DmaDirection dir);
+    void enableIrq(DmaDirection dir);
+
+    // --- Stream configuration ---
+    // Replace the loopback with a packet source. packets_per_sec = 0 runs the
+    // source as fast as the S2MM ring accepts packets (no drops).
+    void setStreamSource(StreamSource source, double packets_per_sec = 0);
+    void setLoopback();
+
+    // --- Fault injection ---
+    // The next descriptor the channel fetches fails with the given DMASR error
+    // bits (DMA_SR_*_ERR_MASK): a data error also lands in the BD status, as
+    // on hardware, and the channel halts with Err_Irq until the core is reset.
+    void injectError(DmaDirection dir, uint32_t err_bits);
+
+    // --- Model counters ---
+    uint64_t packetsReceived() const { return m_s2mm_packets.load(std::memory_order_relaxed); }
+    uint64_t bytesReceived() const { return m_s2mm_bytes.load(std::memory_order_relaxed); }
+    uint64_t packetsTransmitted() const { return m_mm2s_packets.load(std::memory_order_relaxed); }
+    uint64_t packetsDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Channel {
+        uint32_t dmacr = 0;
+        uint32_t dmasr = 0;
+        uint64_t curdesc = 0;      // next descriptor to fetch
+        uint64_t lastdesc = 0;     // last descriptor processed (CURDESC readback)
+        uint64_t taildesc = 0;
+        bool idle = true;          // SG: reached TAILDESC, waiting for a new one
+        uint64_t addr = 0;         // Direct register mode SA/DA
+        uint32_t length = 0;       // Direct register mode LENGTH
+        bool direct_pending = false;
+        bool irq_enabled = true;   // UIO mask state
+        int event_fd = -1;
+        uint32_t irq_countdown = 1;    // packets left before the next IOC interrupt
+        bool delay_armed = false;      // delay timer running
+        Clock::time_point delay_deadline;
+        uint32_t inject_error = 0;     // DMASR error bits for the next fetch
+    };
+
+    struct Packet {
+        std::vector<uint8_t> data;
+        size_t offset = 0;
+        bool complete = false;
+    };
+
+    static constexpr size_t LOOPBACK_FIFO_PACKETS = 64;
+    // Delay timer period: C_DLYTMR_RESOLUTION = 125 cycles of a 125 MHz SG clock
+    static constexpr uint32_t DELAY_TIMER_UNIT_NS = 1000;
+
+    Channel& channel(DmaDirection dir) { return (dir == DmaDirection::TRANSMIT) ? m_mm2s : m_s2mm; }
+    uint8_t* toVirt(uint64_t phys, uint64_t len);
+    void resetCore();
+    void writeControl(Channel& ch, uint32_t value);
+    bool sgReady(const Channel& ch) const;
+    void completeDescriptor(Channel& ch, volatile AxiDmaBufferDescriptor* bd, uint32_t status);
+    void raiseError(Channel& ch, uint32_t err_bits);
+    void updateIrq(Channel& ch);
+    bool checkDelayTimer(Channel& ch, Clock::time_point now);
+
+    volatile AxiDmaBufferDescriptor* fetchDescriptor(Channel& ch);
+    bool stepMm2s();
+    bool stepS2mmLoopback();
+    bool stepS2mmSource(std::unique_lock<std::mutex>& lock);
+    void run();
+
+    uint64_t m_dma_regs_addr;
+    uint64_t m_mem_phys_addr;
+    uint64_t m_mem_size;
+    bool m_use_irq;
+    volatile uint8_t* m_mem = nullptr;
+
+    Channel m_mm2s;
+    Channel m_s2mm;
+    std::deque<Packet> m_fifo;
+
+    std::shared_ptr<StreamSource> m_source;
+    Clock::duration m_source_period = Clock::duration::zero();
+    Clock::time_point m_next_packet;
+    std::vector<uint8_t> m_scratch;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+    uint64_t m_reset_count = 0;
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_s2mm_packets{0};
+    std::atomic<uint64_t> m_s2mm_bytes{0};
+    std::atomic<uint64_t> m_mm2s_packets{0};
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+#endif // AXI_DMA_EMULATOR_HPP
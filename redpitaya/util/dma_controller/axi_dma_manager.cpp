@@ -0,0 +1,269 @@
+// =================================================================================
+// FILE: axi_dma_manager.cpp
+//
+// DESCRIPTION:
+// Implementation of AxiDmaManager: per-engine readout threads feeding one
+// shared block queue.
+//
+// =================================================================================
+#include "axi_dma_manager.hpp"
+#include "axi_dma_rt.hpp"
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdexcept>
+#include <iostream>
+
+// Blocks claimed per pass before handing them to the queue
+static const uint32_t READOUT_BATCH = 16;
+
+AxiDmaManager::AxiDmaManager()
+{
+}
+
+AxiDmaManager::~AxiDmaManager()
+{
+    stop();
+    for (size_t i = 0; i < m_engines.size(); ++i)
+        if (m_engines[i]->wake_fd >= 0)
+            close(m_engines[i]->wake_fd);
+}
+
+uint32_t AxiDmaManager::addEngine(const EngineConfig &config)
+{
+    std::unique_ptr<AxiDmaController> dma;
+    if (config.uio_mm2s.empty() || config.uio_s2mm.empty())
+        dma.reset(new AxiDmaController(config.dma_regs_addr, config.mem_phys_addr, config.mem_size));
+    else
+        dma.reset(new AxiDmaController(config.dma_regs_addr, config.mem_phys_addr, config.mem_size,
+                                       config.uio_mm2s, config.uio_s2mm));
+    return setupEngine(std::move(dma), config);
+}
+
+uint32_t AxiDmaManager::addEngine(AxiDmaBackend *backend, const EngineConfig &config)
+{
+    std::unique_ptr<AxiDmaController> dma(new AxiDmaController(backend));
+    return setupEngine(std::move(dma), config);
+}
+
+uint32_t AxiDmaManager::setupEngine(std::unique_ptr<AxiDmaController> dma, const EngineConfig &config)
+{
+    if (m_running)
+        throw std::runtime_error("Cannot add an engine while the manager is running.");
+
+    // RX-only readout: the whole window goes to the S2MM ring
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.mode_s2mm = AxiDmaController::DmaMode::SCATTER_GATHER;
+    layout.rx_num_bds = config.num_bds;
+    layout.rx_buffer_size = config.buffer_size;
+    dma->initSG(layout);
+    dma->setCoalescing(AxiDmaController::DmaDirection::RECEIVE, config.irq_threshold, config.irq_delay);
+
+    std::unique_ptr<Engine> engine(new Engine);
+    engine->config = config;
+    engine->dma = std::move(dma);
+    engine->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (engine->wake_fd < 0)
+        throw std::runtime_error("Failed to create wake eventfd: " + std::string(strerror(errno)));
+    m_engines.push_back(std::move(engine));
+    return m_engines.size() - 1;
+}
+
+void AxiDmaManager::start()
+{
+    if (m_running)
+        return;
+    if (m_engines.empty())
+        throw std::runtime_error("No engines to start.");
+
+    // Room for every BD of every engine: readout threads never wait on the queue
+    size_t capacity = 0;
+    for (size_t i = 0; i < m_engines.size(); ++i)
+        capacity += m_engines[i]->config.num_bds;
+    m_queue.reset(new MpmcQueue<Block>(capacity));
+
+    m_stop.store(false);
+    for (size_t i = 0; i < m_engines.size(); ++i)
+        m_engines[i]->dma->startSG(AxiDmaController::DmaDirection::RECEIVE);
+    for (size_t i = 0; i < m_engines.size(); ++i)
+    {
+        Engine &engine = *m_engines[i];
+        engine.thread = std::thread(&AxiDmaManager::readoutLoop, this, std::ref(engine), (uint32_t)i);
+    }
+    m_running = true;
+}
+
+void AxiDmaManager::stop()
+{
+    if (!m_running)
+        return;
+    m_stop.store(true, std::memory_order_seq_cst);
+    for (size_t i = 0; i < m_engines.size(); ++i)
+        wake(*m_engines[i]);
+    for (size_t i = 0; i < m_engines.size(); ++i)
+        if (m_engines[i]->thread.joinable())
+            m_engines[i]->thread.join();
+    m_queue->close();
+    m_running = false;
+}
+
+size_t AxiDmaManager::receive(Block *blocks, size_t max_blocks, bool wait)
+{
+    if (!m_queue)
+        return 0;
+    return wait ? m_queue->popWait(blocks, max_blocks) : m_queue->tryPop(blocks, max_blocks);
+}
+
+void AxiDmaManager::release(const Block &block)
+{
+    if (block.engine >= m_engines.size())
+        return;
+    Engine &engine = *m_engines[block.engine];
+    engine.dma->releaseClaimed(block.id);
+    engine.outstanding.fetch_sub(1, std::memory_order_seq_cst);
+    // Pairs with the store/re-check in readoutLoop
+    if (engine.full_waiting.load(std::memory_order_seq_cst))
+        wake(engine);
+}
+
+AxiDmaManager::EngineStats AxiDmaManager::getStats(uint32_t index) const
+{
+    const Engine &engine = *m_engines.at(index);
+    EngineStats stats;
+    stats.blocks = engine.blocks.load(std::memory_order_relaxed);
+    stats.bytes = engine.bytes.load(std::memory_order_relaxed);
+    stats.ring_full = engine.ring_full.load(std::memory_order_relaxed);
+    stats.wakeups = engine.wakeups.load(std::memory_order_relaxed);
+    stats.errors = engine.errors.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void AxiDmaManager::wake(Engine &engine)
+{
+    uint64_t one = 1;
+    if (write(engine.wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        std::cerr << "Failed to wake readout thread: " << strerror(errno) << std::endl;
+}
+
+void AxiDmaManager::readoutLoop(Engine &engine, uint32_t index)
+{
+    AxiDmaController &dma = *engine.dma;
+    try
+    {
+        if (engine.config.rt_priority > 0)
+        {
+            AxiDmaController::RealtimeConfig rt;
+            rt.cpu = engine.config.cpu;
+            rt.priority = engine.config.rt_priority;
+            dma.enterRealtime(rt);
+        }
+        else if (engine.config.cpu >= 0)
+            axi_dma_rt::pinThread(engine.config.cpu);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Warning: readout thread " << index << ": " << e.what() << std::endl;
+    }
+
+    int irq_fd = dma.getIrqFd(AxiDmaController::DmaDirection::RECEIVE);
+    Block batch[READOUT_BATCH];
+    bool armed = false;
+    while (!m_stop.load(std::memory_order_acquire))
+    {
+        uint32_t n = 0;
+        int ret = 0;
+        try
+        {
+            AxiDmaController::DmaBlock block;
+            uint32_t id;
+            while (n < READOUT_BATCH && (ret = dma.claimBlock(&block, &id)) == 1)
+            {
+                batch[n].engine = index;
+                batch[n].id = id;
+                batch[n].data = block.data;
+                batch[n].len = block.len;
+                engine.bytes.fetch_add(block.len, std::memory_order_relaxed);
+                n++;
+            }
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Readout of engine " << index << " failed: " << e.what() << std::endl;
+            ret = -1;
+        }
+        if (n)
+        {
+            engine.outstanding.fetch_add(n, std::memory_order_relaxed);
+            engine.blocks.fetch_add(n, std::memory_order_relaxed);
+            m_queue->pushWait(batch, n);
+            armed = false;
+            continue;
+        }
+        if (ret < 0)
+        {
+            engine.errors.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = engine.wake_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        if (engine.outstanding.load(std::memory_order_seq_cst) >= engine.config.num_bds)
+        {
+            // Every BD is with the consumers: nothing completes before a release
+            engine.full_waiting.store(true, std::memory_order_seq_cst);
+            if (engine.outstanding.load(std::memory_order_seq_cst) >= engine.config.num_bds &&
+                !m_stop.load(std::memory_order_seq_cst))
+            {
+                engine.ring_full.fetch_add(1, std::memory_order_relaxed);
+                poll(fds, 1, -1);
+            }
+            engine.full_waiting.store(false, std::memory_order_relaxed);
+        }
+        else if (irq_fd < 0)
+        {
+            // Polling engine: a halted ring completes nothing, look at DMASR while idle
+            if (dma.getDmaErrors(AxiDmaController::DmaDirection::RECEIVE))
+            {
+                engine.errors.fetch_add(1, std::memory_order_relaxed);
+                dma.recover();
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        else if (!armed)
+        {
+            // Arm, then claim once more: a BD that completed before the re-arm raises no event
+            if (dma.armIrq(AxiDmaController::DmaDirection::RECEIVE) == AxiDmaController::DMA_ERROR)
+            {
+                // Blocks already claimed stay with the consumers, the ring restarts behind them
+                engine.errors.fetch_add(1, std::memory_order_relaxed);
+                dma.recover();
+                continue;
+            }
+            armed = true;
+            continue;
+        }
+        else
+        {
+            fds[1].fd = irq_fd;
+            fds[1].events = POLLIN;
+            engine.wakeups.fetch_add(1, std::memory_order_relaxed);
+            if (poll(fds, 2, -1) > 0 && (fds[1].revents & POLLIN))
+            {
+                dma.consumeIrq(AxiDmaController::DmaDirection::RECEIVE);
+                armed = false;
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t count;
+            if (read(engine.wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+                std::cerr << "Failed to read wake eventfd: " << strerror(errno) << std::endl;
+        }
+    }
+}
@@ -0,0 +1,107 @@
+// =================================================================================
+// FILE: axi_dma_manager.hpp
+//
+// DESCRIPTION:
+// Readout of several AXI DMA engines (several Red Pitaya DMA instances, or
+// several boards' worth of emulators) through one consumer interface. The
+// manager owns one AxiDmaController per engine, runs its S2MM ring as an
+// RX-only readout and drives it from a dedicated readout thread pinned to a
+// chosen core. Readout threads claim completed blocks and push them into one
+// shared queue; any number of consumer threads pop blocks tagged with their
+// engine and release them back to it in any order.
+//
+// =================================================================================
+#ifndef AXI_DMA_MANAGER_HPP
+#define AXI_DMA_MANAGER_HPP
+
+#include "axi_dma_controller.hpp"
+#include "axi_dma_queue.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class AxiDmaManager {
+public:
+    // One engine: register block, reserved memory window and UIO pair
+    // (empty UIO paths: the readout thread polls), plus its readout setup.
+    struct EngineConfig {
+        uint64_t dma_regs_addr = 0;
+        uint64_t mem_phys_addr = 0;
+        uint64_t mem_size = 0;
+        std::string uio_mm2s;
+        std::string uio_s2mm;
+        int cpu = -1;                   // Core the readout thread is pinned to, -1 = not pinned
+        int rt_priority = 0;            // > 0: readout thread enters real-time mode at this SCHED_FIFO priority
+        uint32_t num_bds = 64;
+        uint32_t buffer_size = 4096;
+        uint8_t irq_threshold = 16;     // Interrupt coalescing, see AxiDmaController::setCoalescing
+        uint8_t irq_delay = 50;
+    };
+
+    // A block handed to the consumers; release it with release()
+    struct Block {
+        uint32_t engine;
+        uint32_t id;
+        void* data;
+        uint32_t len;
+    };
+
+    struct EngineStats {
+        uint64_t blocks;        // Blocks handed to the consumers
+        uint64_t bytes;
+        uint64_t ring_full;     // Times the readout thread waited for consumers to release
+        uint64_t wakeups;       // Times the readout thread slept waiting for data
+        uint64_t errors;        // DMA errors recovered in place, or the failure that stopped the readout
+    };
+
+    AxiDmaManager();
+    // Stops the readout threads and destroys the engines
+    ~AxiDmaManager();
+
+    // Adds an engine on /dev/mem (+ UIO). Returns its index. Throws on error.
+    uint32_t addEngine(const EngineConfig& config);
+    // Adds an engine on an explicit backend (e.g. AxiDmaEmulator). Takes ownership.
+    uint32_t addEngine(AxiDmaBackend* backend, const EngineConfig& config);
+
+    uint32_t numEngines() const { return m_engines.size(); }
+    // Direct access, e.g. to change the wait mode before start()
+    AxiDmaController& engine(uint32_t index) { return *m_engines[index]->dma; }
+
+    // Starts every S2MM channel and its readout thread
+    void start();
+    // Stops the readout threads. Blocks still queued can be received, and
+    // received blocks released, until the manager is destroyed.
+    void stop();
+
+    // Pops up to max_blocks blocks of any engine. With wait, blocks until at
+    // least one is available; returns 0 once stopped and drained.
+    size_t receive(Block* blocks, size_t max_blocks, bool wait = true);
+    void release(const Block& block);
+
+    EngineStats getStats(uint32_t index) const;
+
+private:
+    struct Engine {
+        EngineConfig config;
+        std::unique_ptr<AxiDmaController> dma;
+        std::thread thread;
+        int wake_fd = -1;                       // eventfd: stop, or a release into a full ring
+        std::atomic<uint32_t> outstanding{0};   // Claimed and not yet released
+        std::atomic<bool> full_waiting{false};
+        std::atomic<uint64_t> blocks{0}, bytes{0}, ring_full{0}, wakeups{0}, errors{0};
+    };
+
+    uint32_t setupEngine(std::unique_ptr<AxiDmaController> dma, const EngineConfig& config);
+    void readoutLoop(Engine& engine, uint32_t index);
+    void wake(Engine& engine);
+
+    std::vector<std::unique_ptr<Engine> > m_engines;
+    std::unique_ptr<MpmcQueue<Block> > m_queue;
+    std::atomic<bool> m_stop{false};
+    bool m_running = false;
+};
+
+#endif // AXI_DMA_MANAGER_HPP
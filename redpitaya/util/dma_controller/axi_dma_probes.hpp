@@ -0,0 +1,53 @@
+// =================================================================================
+// FILE: axi_dma_probes.hpp
+//
+// DESCRIPTION:
+// USDT (static user-space) probes in the controller hot path, for perf and
+// bpftrace on a live readout. With <sys/sdt.h> available (systemtap-sdt-dev)
+// each probe is a single nop plus an ELF note, there is no runtime
+// dependency and nothing is called. Without the header, or with
+// AXI_DMA_NO_PROBES defined, the probes compile to nothing.
+//
+// Provider "axi_dma". Every probe carries four arguments:
+//
+//   probe                 arg0  arg1       arg2                  arg3
+//   start_sg              dir   0          buffer size           BDs in the ring
+//   sg_receive_entry      dir   BD index   0                     occupancy
+//   sg_receive_return     dir   BD index   length                occupancy
+//   sg_receive_batch      dir   first BD   blocks returned       occupancy
+//   irq_wait_start        dir   BD index   0                     occupancy
+//   irq_wait_end          dir   BD index   length (0: spurious)  occupancy
+//   release_blocks        dir   first BD   blocks released       occupancy
+//   prepare_transmit      dir   BD index   length                occupancy
+//   flush_transmit        dir   first BD   BDs flushed           occupancy
+//   dma_error             dir   BD index   DMASR                 occupancy
+//
+// dir is 0 for MM2S and 1 for S2MM. Occupancy is the number of BDs held back
+// from the DMA: receive blocks handed out and not released, transmit BDs
+// committed and not reclaimed. sg_receive_return fires on success only.
+//
+// Usage:
+//   bpftrace -e 'usdt:./example_emulator:axi_dma:irq_wait_end { @[arg2 == 0] = count(); }'
+//   perf probe -x ./example_emulator sdt_axi_dma:sg_receive_return && perf record -e sdt_axi_dma:* ...
+//
+// =================================================================================
+#ifndef AXI_DMA_PROBES_HPP
+#define AXI_DMA_PROBES_HPP
+
+#if !defined(AXI_DMA_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define AXI_DMA_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef AXI_DMA_HAVE_PROBES
+#define AXI_DMA_PROBE(name, dir, bd, len, occupancy) \
+    DTRACE_PROBE4(axi_dma, name, (unsigned)(dir), (unsigned)(bd), (unsigned)(len), (unsigned)(occupancy))
+#else
+// Arguments are not evaluated, the sizeof only keeps their variables "used"
+#define AXI_DMA_PROBE(name, dir, bd, len, occupancy) \
+    do { (void)sizeof((dir) + (bd) + (len) + (occupancy)); } while (0)
+#endif
+
+#endif // AXI_DMA_PROBES_HPP
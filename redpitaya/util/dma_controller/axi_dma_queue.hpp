@@ -0,0 +1,357 @@
+// =================================================================================
+// FILE: axi_dma_queue.hpp
+//
+// DESCRIPTION:
+// Lock-free bounded queues for handing received blocks (DmaBlock_t, or any
+// trivially copyable handle) from the DMA reader thread to worker threads.
+//
+//   SpscQueue<T>  one producer, one consumer. Head and tail live on separate
+//                 cache lines and each side caches the other's index, so a
+//                 push or pop touches shared state only when the cached view
+//                 runs out.
+//   MpmcQueue<T>  any number of producers and consumers (bounded queue with
+//                 per-cell sequence numbers).
+//
+// The try*/batch calls never block and make no system call. The *Wait calls
+// block on a futex when the queue is empty (full); the other side only enters
+// the kernel to wake someone if a thread is actually sleeping, and a batch
+// push or pop costs at most one wake-up. close() releases all waiters.
+//
+// Usage:
+//   MpmcQueue<DmaBlock_t> queue(256);
+//   reader:  queue.pushWait(blocks, n);            // n blocks, one wake-up
+//   worker:  while ((n = queue.popWait(out, 16)) > 0) process(out, n);
+//   reader:  queue.close();                        // workers drain and exit
+//
+// Header only, Linux (futex).
+//
+// =================================================================================
+#ifndef AXI_DMA_QUEUE_HPP
+#define AXI_DMA_QUEUE_HPP
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace axi_dma_queue_detail {
+
+constexpr size_t CACHE_LINE = 64;
+
+inline size_t roundUpPow2(size_t n)
+{
+    size_t p = 2;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+// Wait/notify on a 32-bit futex word. Notifiers skip the syscall unless a
+// waiter has registered, so the uncontended path stays in user space.
+class FutexEvent {
+public:
+    // Waiter side: call prepare(), re-check the condition, then wait(key)
+    // unless it became true; always finish with done().
+    uint32_t prepare()
+    {
+        m_waiters.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return m_seq.load(std::memory_order_seq_cst);
+    }
+    void wait(uint32_t key)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_seq), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+    }
+    void done() { m_waiters.fetch_sub(1, std::memory_order_relaxed); }
+
+    // Notifier side: call after publishing the state change
+    void notify(int count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+        m_seq.fetch_add(1, std::memory_order_seq_cst);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_seq), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+    void notifyAll() { notify(INT_MAX); }
+
+private:
+    std::atomic<uint32_t> m_seq{0};
+    std::atomic<uint32_t> m_waiters{0};
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32-bit integer");
+
+// Blocking wrappers shared by both queues. Q provides tryPush/tryPop batch
+// calls, the two events and the closed flag.
+template <typename Q, typename T>
+size_t pushWait(Q& q, const T* items, size_t n)
+{
+    size_t done = 0;
+    while (done < n)
+    {
+        done += q.tryPush(items + done, n - done);
+        if (done == n || q.isClosed())
+            break;
+        uint32_t key = q.m_not_full.prepare();
+        size_t more = q.tryPush(items + done, n - done);
+        if (more == 0 && !q.isClosed())
+            q.m_not_full.wait(key);
+        q.m_not_full.done();
+        done += more;
+    }
+    return done;
+}
+
+template <typename Q, typename T>
+size_t popWait(Q& q, T* items, size_t max)
+{
+    for (;;)
+    {
+        size_t n = q.tryPop(items, max);
+        if (n > 0 || q.isClosed())
+            return n ? n : q.tryPop(items, max); // drain what was pushed before close()
+        uint32_t key = q.m_not_empty.prepare();
+        n = q.tryPop(items, max);
+        if (n == 0 && !q.isClosed())
+            q.m_not_empty.wait(key);
+        q.m_not_empty.done();
+        if (n > 0)
+            return n;
+    }
+}
+
+} // namespace axi_dma_queue_detail
+
+
+template <typename T>
+class SpscQueue {
+public:
+    // The capacity is rounded up to a power of two
+    explicit SpscQueue(size_t capacity)
+        : m_mask(axi_dma_queue_detail::roundUpPow2(capacity) - 1), m_items(m_mask + 1) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // --- Non-blocking (no system call) ---
+    bool tryPush(const T& item) { return tryPush(&item, 1) == 1; }
+    bool tryPop(T& item) { return tryPop(&item, 1) == 1; }
+
+    // Pushes up to n items, returns the number pushed
+    size_t tryPush(const T* items, size_t n)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t room = capacity() - (head - m_tail_cache);
+        if (room < n)
+        {
+            m_tail_cache = m_tail.load(std::memory_order_acquire);
+            room = capacity() - (head - m_tail_cache);
+        }
+        if (n > room)
+            n = room;
+        if (n == 0)
+            return 0;
+        for (size_t i = 0; i < n; ++i)
+            m_items[(head + i) & m_mask] = items[i];
+        m_head.store(head + n, std::memory_order_release);
+        m_not_empty.notify(1);
+        return n;
+    }
+
+    // Pops up to max items, returns the number popped
+    size_t tryPop(T* items, size_t max)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t avail = m_head_cache - tail;
+        if (avail < max)
+        {
+            m_head_cache = m_head.load(std::memory_order_acquire);
+            avail = m_head_cache - tail;
+        }
+        if (max > avail)
+            max = avail;
+        if (max == 0)
+            return 0;
+        for (size_t i = 0; i < max; ++i)
+            items[i] = m_items[(tail + i) & m_mask];
+        m_tail.store(tail + max, std::memory_order_release);
+        m_not_full.notify(1);
+        return max;
+    }
+
+    // --- Blocking (futex) ---
+    // pushWait returns fewer than n items only if the queue was closed.
+    // popWait returns 0 only once the queue is closed and drained.
+    bool pushWait(const T& item) { return pushWait(&item, 1) == 1; }
+    size_t pushWait(const T* items, size_t n) { return axi_dma_queue_detail::pushWait(*this, items, n); }
+    size_t popWait(T* items, size_t max) { return axi_dma_queue_detail::popWait(*this, items, max); }
+
+    // Wakes all waiters; later pushes fail, pops drain the remaining items
+    void close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        m_not_empty.notifyAll();
+        m_not_full.notifyAll();
+    }
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+    size_t capacity() const { return m_mask + 1; }
+    size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+
+private:
+    template <typename Q, typename U> friend size_t axi_dma_queue_detail::pushWait(Q&, const U*, size_t);
+    template <typename Q, typename U> friend size_t axi_dma_queue_detail::popWait(Q&, U*, size_t);
+    static constexpr size_t PAD = axi_dma_queue_detail::CACHE_LINE;
+
+    const size_t m_mask;
+    std::vector<T> m_items;
+    std::atomic<bool> m_closed{false};
+    char m_pad0[PAD];
+
+    // Producer line
+    std::atomic<size_t> m_head{0};
+    size_t m_tail_cache = 0;
+    axi_dma_queue_detail::FutexEvent m_not_full;   // producer waits here
+    char m_pad1[PAD];
+
+    // Consumer line
+    std::atomic<size_t> m_tail{0};
+    size_t m_head_cache = 0;
+    axi_dma_queue_detail::FutexEvent m_not_empty;  // consumer waits here
+    char m_pad2[PAD];
+};
+
+
+template <typename T>
+class MpmcQueue {
+public:
+    // The capacity is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity)
+        : m_mask(axi_dma_queue_detail::roundUpPow2(capacity) - 1), m_cells(m_mask + 1)
+    {
+        for (size_t i = 0; i <= m_mask; ++i)
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    // --- Non-blocking (no system call) ---
+    bool tryPush(const T& item) { return tryPush(&item, 1) == 1; }
+    bool tryPop(T& item) { return tryPop(&item, 1) == 1; }
+
+    // Pushes up to n items (one slot claim each, one wake-up for the batch)
+    size_t tryPush(const T* items, size_t n)
+    {
+        size_t done = 0;
+        while (done < n && pushOne(items[done]))
+            done++;
+        if (done)
+            m_not_empty.notify((int)done);
+        return done;
+    }
+
+    // Pops up to max items (one slot claim each, one wake-up for the batch)
+    size_t tryPop(T* items, size_t max)
+    {
+        size_t done = 0;
+        while (done < max && popOne(items[done]))
+            done++;
+        if (done)
+            m_not_full.notify((int)done);
+        return done;
+    }
+
+    // --- Blocking (futex), same contract as SpscQueue ---
+    bool pushWait(const T& item) { return pushWait(&item, 1) == 1; }
+    size_t pushWait(const T* items, size_t n) { return axi_dma_queue_detail::pushWait(*this, items, n); }
+    size_t popWait(T* items, size_t max) { return axi_dma_queue_detail::popWait(*this, items, max); }
+
+    void close()
+    {
+        m_closed.store(true, std::memory_order_release);
+        m_not_empty.notifyAll();
+        m_not_full.notifyAll();
+    }
+    bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+    size_t capacity() const { return m_mask + 1; }
+
+private:
+    template <typename Q, typename U> friend size_t axi_dma_queue_detail::pushWait(Q&, const U*, size_t);
+    template <typename Q, typename U> friend size_t axi_dma_queue_detail::popWait(Q&, U*, size_t);
+    static constexpr size_t PAD = axi_dma_queue_detail::CACHE_LINE;
+
+    // A cell is free for the producer claiming position pos when seq == pos,
+    // and holds data for the consumer claiming pos when seq == pos + 1
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    bool pushOne(const T& item)
+    {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = item;
+                    cell.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // Full
+            else
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool popOne(T& item)
+    {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = m_cells[pos & m_mask];
+            intptr_t diff = (intptr_t)cell.seq.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = cell.data;
+                    cell.seq.store(pos + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false; // Empty
+            else
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    const size_t m_mask;
+    std::vector<Cell> m_cells;
+    std::atomic<bool> m_closed{false};
+    char m_pad0[PAD];
+
+    std::atomic<size_t> m_enqueue_pos{0};
+    axi_dma_queue_detail::FutexEvent m_not_full;
+    char m_pad1[PAD];
+
+    std::atomic<size_t> m_dequeue_pos{0};
+    axi_dma_queue_detail::FutexEvent m_not_empty;
+    char m_pad2[PAD];
+};
+
+#endif // AXI_DMA_QUEUE_HPP
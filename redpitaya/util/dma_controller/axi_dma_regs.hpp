@@ -0,0 +1,97 @@
+// =================================================================================
+// FILE: axi_dma_regs.hpp
+//
+// DESCRIPTION:
+// AXI DMA register map, control/status bits and the Scatter-Gather buffer
+// descriptor layout. Shared by the controller and the register/memory
+// backends (including the software emulator). Internal header.
+//
+// =================================================================================
+#ifndef AXI_DMA_REGS_HPP
+#define AXI_DMA_REGS_HPP
+
+#include <cstdint>
+
+// --- AXI DMA Register Offsets ---
+constexpr uint32_t DMA_REG_SIZE = 0x10000;
+constexpr uint32_t MM2S_DMACR = 0x00;
+constexpr uint32_t MM2S_DMASR = 0x04;
+constexpr uint32_t MM2S_SA = 0x18;
+constexpr uint32_t MM2S_SA_MSB = 0x1C;
+constexpr uint32_t MM2S_LENGTH = 0x28;
+constexpr uint32_t MM2S_CURDESC = 0x08;
+constexpr uint32_t MM2S_TAILDESC = 0x10;
+
+constexpr uint32_t S2MM_DMACR = 0x30;
+constexpr uint32_t S2MM_DMASR = 0x34;
+constexpr uint32_t S2MM_DA = 0x48;
+constexpr uint32_t S2MM_DA_MSB = 0x4C;
+constexpr uint32_t S2MM_LENGTH = 0x58;
+constexpr uint32_t S2MM_CURDESC = 0x38;
+constexpr uint32_t S2MM_TAILDESC = 0x40;
+
+// --- DMA Control/Status Register Bits ---
+constexpr uint32_t DMA_CR_RUN_STOP_MASK = 0x00000001;
+constexpr uint32_t DMA_CR_RESET_MASK = 0x00000004;
+constexpr uint32_t DMA_CR_IOC_IRQ_EN_MASK = 0x00001000;
+constexpr uint32_t DMA_CR_DLY_IRQ_EN_MASK = 0x00002000;
+constexpr uint32_t DMA_CR_ERR_IRQ_EN_MASK = 0x00004000;
+constexpr uint32_t DMA_CR_CYCLIC_EN_MASK = 0x00000010;
+constexpr uint32_t DMA_CR_IRQ_THRESHOLD_MASK = 0x00FF0000;
+constexpr uint32_t DMA_CR_IRQ_THRESHOLD_SHIFT = 16;
+constexpr uint32_t DMA_CR_IRQ_DELAY_MASK = 0xFF000000;
+constexpr uint32_t DMA_CR_IRQ_DELAY_SHIFT = 24;
+
+constexpr uint32_t DMA_SR_HALTED_MASK = 0x00000001;
+constexpr uint32_t DMA_SR_IDLE_MASK = 0x00000002;
+constexpr uint32_t DMA_SR_SG_INCLD_MASK = 0x00000008;
+constexpr uint32_t DMA_SR_DMA_INT_ERR_MASK = 0x00000010;
+constexpr uint32_t DMA_SR_DMA_SLV_ERR_MASK = 0x00000020;
+constexpr uint32_t DMA_SR_DMA_DEC_ERR_MASK = 0x00000040;
+constexpr uint32_t DMA_SR_SG_INT_ERR_MASK = 0x00000100;
+constexpr uint32_t DMA_SR_SG_SLV_ERR_MASK = 0x00000200;
+constexpr uint32_t DMA_SR_SG_DEC_ERR_MASK = 0x00000400;
+constexpr uint32_t DMA_SR_IOC_IRQ_MASK = 0x00001000;
+constexpr uint32_t DMA_SR_DLY_IRQ_MASK = 0x00002000;
+constexpr uint32_t DMA_SR_ERR_IRQ_MASK = 0x00004000;
+constexpr uint32_t DMA_SR_ALL_IRQ_MASK = 0x00007000;
+constexpr uint32_t DMA_SR_ALL_ERR_MASK = 0x00000070;
+constexpr uint32_t DMA_SR_SG_ERR_MASK = 0x00000700;
+constexpr uint32_t DMA_SR_ANY_ERR_MASK = DMA_SR_ALL_ERR_MASK | DMA_SR_SG_ERR_MASK;
+
+// --- Buffer Descriptor control/status bits ---
+constexpr uint32_t BD_LENGTH_MASK = 0x03FFFFFF;
+constexpr uint32_t BD_CTRL_TXEOF_MASK = 0x04000000;
+constexpr uint32_t BD_CTRL_TXSOF_MASK = 0x08000000;
+constexpr uint32_t BD_STS_RXEOF_MASK = 0x04000000;
+constexpr uint32_t BD_STS_RXSOF_MASK = 0x08000000;
+constexpr uint32_t BD_STS_INT_ERR_MASK = 0x10000000;
+constexpr uint32_t BD_STS_SLV_ERR_MASK = 0x20000000;
+constexpr uint32_t BD_STS_DEC_ERR_MASK = 0x40000000;
+constexpr uint32_t BD_STS_COMPLETE_MASK = 0x80000000;
+constexpr uint32_t BD_STS_ALL_ERR_MASK = 0x70000000;
+
+// --- Buffer Descriptor Structure ---
+constexpr uint64_t PAGE_ALIGN = 0x1000; // Partition boundaries in the reserved region
+struct AxiDmaBufferDescriptor
+{
+    uint32_t next_desc_ptr;
+    uint32_t next_desc_ptr_MSB;
+    uint32_t buffer_addr;
+    uint32_t buffer_addr_MSB;
+    uint32_t reserved3;
+    uint32_t reserved4;
+    uint32_t control;
+    uint32_t status;
+    uint32_t app[5];
+    uint32_t unused[3]; // Placeholder to make it aligned to 0x40
+};
+
+// Size of the BD area of a ring: the descriptors rounded up to a page, so the
+// buffers that follow stay page aligned
+inline uint64_t sgBdAreaSize(uint32_t num_bds)
+{
+    return ((uint64_t)num_bds * sizeof(AxiDmaBufferDescriptor) + PAGE_ALIGN - 1) & ~(PAGE_ALIGN - 1);
+}
+
+#endif // AXI_DMA_REGS_HPP
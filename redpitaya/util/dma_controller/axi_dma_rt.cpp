@@ -0,0 +1,105 @@
+// =================================================================================
+// FILE: axi_dma_rt.cpp
+//
+// DESCRIPTION:
+// Implementation of the real-time helpers in axi_dma_rt.hpp.
+//
+// =================================================================================
+#include "axi_dma_rt.hpp"
+#include <alloca.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <string.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace axi_dma_rt {
+
+static std::string readFirstLine(const char *path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+void lockMemory()
+{
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+        throw std::runtime_error("mlockall failed: " + std::string(strerror(errno)));
+}
+
+void prefaultStack(size_t bytes)
+{
+    volatile unsigned char *stack = static_cast<volatile unsigned char *>(alloca(bytes));
+    for (size_t i = 0; i < bytes; i += 4096)
+        stack[i] = 0;
+}
+
+void pinThread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0)
+        throw std::runtime_error("Failed to pin thread to CPU " + std::to_string(cpu) + ": " + strerror(rc));
+}
+
+void setFifo(int priority)
+{
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc != 0)
+        throw std::runtime_error("Failed to set SCHED_FIFO priority " + std::to_string(priority) + ": " + strerror(rc));
+}
+
+bool cpuInList(const std::string &list, int cpu)
+{
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ','))
+    {
+        // Skip isolcpus= flags such as "domain" or "managed_irq"
+        if (range.empty() || range[0] < '0' || range[0] > '9')
+            continue;
+        char *end;
+        long first = strtol(range.c_str(), &end, 10);
+        long last = (*end == '-') ? strtol(end + 1, NULL, 10) : first;
+        if (cpu >= first && cpu <= last)
+            return true;
+    }
+    return false;
+}
+
+CpuIsolation cpuIsolation(int cpu)
+{
+    CpuIsolation info;
+    info.isolated = cpuInList(readFirstLine("/sys/devices/system/cpu/isolated"), cpu);
+    info.nohz_full = cpuInList(readFirstLine("/sys/devices/system/cpu/nohz_full"), cpu);
+
+    // rcu_nocbs has no sysfs file, take it from the command line
+    std::stringstream cmdline(readFirstLine("/proc/cmdline"));
+    std::string arg;
+    while (cmdline >> arg)
+        if (arg.compare(0, 10, "rcu_nocbs=") == 0)
+            info.rcu_nocbs = cpuInList(arg.substr(10), cpu);
+    return info;
+}
+
+std::string describeIsolation(int cpu)
+{
+    CpuIsolation info = cpuIsolation(cpu);
+    std::string s = "CPU " + std::to_string(cpu) + ": isolcpus " + (info.isolated ? "yes" : "no") +
+                    ", nohz_full " + (info.nohz_full ? "yes" : "no") +
+                    ", rcu_nocbs " + (info.rcu_nocbs ? "yes" : "no");
+    return s;
+}
+
+} // namespace axi_dma_rt
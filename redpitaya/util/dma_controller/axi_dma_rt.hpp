@@ -0,0 +1,47 @@
+// =================================================================================
+// FILE: axi_dma_rt.hpp
+//
+// DESCRIPTION:
+// Real-time helpers for the readout thread: lock the process memory, prefault
+// the stack, pin the calling thread to a core, switch it to SCHED_FIFO, and
+// report whether the core is isolated from the scheduler (isolcpus), the tick
+// (nohz_full) and RCU callbacks (rcu_nocbs). All calls act on the calling
+// process/thread and throw std::runtime_error on failure. Mostly needs root
+// or CAP_SYS_NICE / CAP_IPC_LOCK. AxiDmaController::enterRealtime() combines
+// them with prefaulting the DMA mappings. Internal header.
+//
+// =================================================================================
+#ifndef AXI_DMA_RT_HPP
+#define AXI_DMA_RT_HPP
+
+#include <cstddef>
+#include <string>
+
+namespace axi_dma_rt {
+
+// Kernel settings that keep a core free for the readout thread
+struct CpuIsolation {
+    bool isolated = false;     // in isolcpus (/sys/devices/system/cpu/isolated)
+    bool nohz_full = false;    // in nohz_full (/sys/devices/system/cpu/nohz_full)
+    bool rcu_nocbs = false;    // in rcu_nocbs= on the kernel command line
+};
+
+// mlockall(MCL_CURRENT | MCL_FUTURE): no page of the process is ever swapped
+// out or faulted back in, including later allocations
+void lockMemory();
+// Touches `bytes` of stack so the pages are resident before the hot loop
+void prefaultStack(size_t bytes = 256 * 1024);
+// Pins the calling thread to one core
+void pinThread(int cpu);
+// SCHED_FIFO at `priority` (1..99) for the calling thread
+void setFifo(int priority);
+
+CpuIsolation cpuIsolation(int cpu);
+// One line such as "CPU 2: isolcpus yes, nohz_full no, rcu_nocbs no"
+std::string describeIsolation(int cpu);
+// True if `cpu` is in a kernel CPU list such as "1,3-5"
+bool cpuInList(const std::string& list, int cpu);
+
+} // namespace axi_dma_rt
+
+#endif // AXI_DMA_RT_HPP
@@ -0,0 +1,141 @@
+// =================================================================================
+// FILE: axi_dma_trace.hpp
+//
+// DESCRIPTION:
+// Fixed-size in-memory ring of per-BD timestamps for latency tracing. The
+// controller records into it only when built with AXI_DMA_TRACE defined
+// (`make TRACE=1`); otherwise the trace points compile to nothing. Each
+// event is one step a block goes through on the receive path:
+//
+//   IRQ_WAKE     the waiting thread returned from the interrupt (bd = awaited BD)
+//   OBSERVED     the reader saw the BD complete
+//   HANDED       the block was handed to the user (after the cache sync)
+//   RELEASED     the user gave the block back
+//
+// The ring keeps the newest events; older ones are overwritten. Dump it to a
+// file with AxiDmaController::dumpTrace() and read the file with
+// dma_trace_dump, which prints percentile histograms of the stages.
+//
+// File format: AxiDmaTraceHeader followed by `count` AxiDmaTraceEvent, oldest
+// first, in host byte order.
+//
+// =================================================================================
+#ifndef AXI_DMA_TRACE_HPP
+#define AXI_DMA_TRACE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <errno.h>
+
+// Events kept per controller, rounded up to a power of two
+#ifndef AXI_DMA_TRACE_EVENTS
+#define AXI_DMA_TRACE_EVENTS 65536
+#endif
+
+enum AxiDmaTraceKind {
+    AXI_DMA_TRACE_IRQ_WAKE = 0,
+    AXI_DMA_TRACE_OBSERVED = 1,
+    AXI_DMA_TRACE_HANDED = 2,
+    AXI_DMA_TRACE_RELEASED = 3
+};
+
+struct AxiDmaTraceEvent {
+    uint64_t ts_ns;     // steady_clock (CLOCK_MONOTONIC)
+    uint32_t bd;        // BD index in the ring
+    uint16_t kind;      // AxiDmaTraceKind
+    uint16_t dir;       // 0 = MM2S, 1 = S2MM
+};
+
+struct AxiDmaTraceHeader {
+    char magic[8];      // "AXIDMATR"
+    uint32_t version;
+    uint32_t event_size;
+    uint64_t count;     // events in the file
+    uint64_t overwritten;
+};
+
+class AxiDmaTraceRing {
+public:
+    explicit AxiDmaTraceRing(uint32_t capacity = AXI_DMA_TRACE_EVENTS) {
+        uint32_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        m_mask = size - 1;
+        // Value-initialised: the pages are touched now, not on the hot path
+        m_slots.reset(new Slot[size]());
+    }
+
+    // Lock-free, any number of writers
+    void record(uint16_t kind, uint16_t dir, uint32_t bd, uint64_t ts_ns) {
+        uint64_t n = m_head.fetch_add(1, std::memory_order_relaxed);
+        Slot& slot = m_slots[n & m_mask];
+        slot.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.event.ts_ns = ts_ns;
+        slot.event.bd = bd;
+        slot.event.kind = kind;
+        slot.event.dir = dir;
+        slot.seq.store(n + 1, std::memory_order_release);
+    }
+
+    // Copies the events still in the ring, oldest first. Slots being
+    // rewritten while copying are skipped. Returns the events overwritten
+    // before the oldest one.
+    uint64_t snapshot(std::vector<AxiDmaTraceEvent>& out) const {
+        uint64_t head = m_head.load(std::memory_order_acquire);
+        uint64_t size = (uint64_t)m_mask + 1;
+        uint64_t first = (head > size) ? head - size : 0;
+        out.clear();
+        out.reserve(head - first);
+        for (uint64_t n = first; n < head; ++n) {
+            const Slot& slot = m_slots[n & m_mask];
+            if (slot.seq.load(std::memory_order_acquire) != n + 1)
+                continue;
+            AxiDmaTraceEvent event = slot.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.seq.load(std::memory_order_relaxed) == n + 1)
+                out.push_back(event);
+        }
+        return first;
+    }
+
+    // Writes the snapshot to a trace file, returns the number of events. Throws on error.
+    size_t dump(const std::string& path) const {
+        std::vector<AxiDmaTraceEvent> events;
+        AxiDmaTraceHeader header;
+        memcpy(header.magic, "AXIDMATR", 8);
+        header.version = 1;
+        header.event_size = sizeof(AxiDmaTraceEvent);
+        header.overwritten = snapshot(events);
+        header.count = events.size();
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            throw std::runtime_error("Failed to open trace file " + path + ": " + strerror(errno));
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  (events.empty() || fwrite(events.data(), sizeof(AxiDmaTraceEvent), events.size(), file) == events.size());
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+            throw std::runtime_error("Failed to write trace file " + path);
+        return events.size();
+    }
+
+    void clear() { m_head.store(0, std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> seq;   // event number + 1 once written, 0 while writing
+        AxiDmaTraceEvent event;
+    };
+    std::unique_ptr<Slot[]> m_slots;
+    uint32_t m_mask = 0;
+    std::atomic<uint64_t> m_head{0};
+};
+
+#endif // AXI_DMA_TRACE_HPP
@@ -0,0 +1,146 @@
+// =================================================================================
+// FILE: bench_queue.cpp
+//
+// DESCRIPTION:
+// Block handoff throughput from one reader thread to worker threads:
+// the std::queue + mutex + condition_variable pattern of example2 (one
+// notify per block) against SpscQueue and MpmcQueue from axi_dma_queue.hpp
+// with blocking batch pops. No DMA involved, runs on any Linux machine.
+//
+// USAGE:
+//   ./bench_queue [blocks] [batch]      (default: 2000000 blocks, batch 16)
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "axi_dma_api.h"
+#include "axi_dma_queue.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <sys/time.h>
+
+
+const uint32_t QUEUE_SIZE = 256;
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static DmaBlock_t make_block(uint64_t i) {
+    DmaBlock_t b;
+    b.data = (void*)(uintptr_t)(0x1000 + (i % 64) * 4096);
+    b.len = (uint32_t)i;
+    return b;
+}
+
+// Sum of all block lengths handed over
+static uint64_t expected_checksum(uint64_t n) {
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i < n; ++i)
+        sum += (uint32_t)i;
+    return sum;
+}
+
+static void report(const char* name, int workers, uint64_t n, double elapsed, uint64_t checksum, uint64_t expected) {
+    std::cout << std::left << std::setw(26) << name << std::right << std::setw(2) << workers << " workers: "
+              << std::fixed << std::setprecision(2) << std::setw(8) << n / elapsed / 1e6 << " M blocks/s"
+              << (checksum == expected ? "" : "  CHECKSUM MISMATCH") << std::endl;
+}
+
+// The example2 pattern: one lock + notify per block
+static void bench_mutex(uint64_t n, int workers) {
+    std::mutex m;
+    std::condition_variable cv;
+    std::queue<DmaBlock_t> q;
+    bool done = false;
+    std::atomic<uint64_t> checksum{0};
+    std::vector<std::thread> threads;
+    double t0 = now_sec();
+    for (int w = 0; w < workers; ++w)
+        threads.emplace_back([&]() {
+            uint64_t sum = 0;
+            for (;;) {
+                DmaBlock_t b;
+                {
+                    std::unique_lock<std::mutex> lock(m);
+                    cv.wait(lock, [&] { return !q.empty() || done; });
+                    if (q.empty() && done) break;
+                    b = q.front();
+                    q.pop();
+                }
+                sum += b.len;
+            }
+            checksum += sum;
+        });
+    for (uint64_t i = 0; i < n; ++i) {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            q.push(make_block(i));
+        }
+        cv.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m);
+        done = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) t.join();
+    report("mutex + condvar", workers, n, now_sec() - t0, checksum, expected_checksum(n));
+}
+
+template <typename Queue>
+static void bench_lock_free(const char* name, uint64_t n, int workers, uint32_t batch) {
+    Queue q(QUEUE_SIZE);
+    std::atomic<uint64_t> checksum{0};
+    std::vector<std::thread> threads;
+    double t0 = now_sec();
+    for (int w = 0; w < workers; ++w)
+        threads.emplace_back([&]() {
+            std::vector<DmaBlock_t> out(batch);
+            uint64_t sum = 0;
+            size_t got;
+            while ((got = q.popWait(out.data(), batch)) > 0)
+                for (size_t k = 0; k < got; ++k)
+                    sum += out[k].len;
+            checksum += sum;
+        });
+    // The reader hands over blocks the way sgReceiveBatch returns them
+    std::vector<DmaBlock_t> in(batch);
+    for (uint64_t i = 0; i < n; i += batch) {
+        uint32_t k = (n - i < batch) ? (uint32_t)(n - i) : batch;
+        for (uint32_t j = 0; j < k; ++j)
+            in[j] = make_block(i + j);
+        q.pushWait(in.data(), k);
+    }
+    q.close();
+    for (auto& t : threads) t.join();
+    report(name, workers, n, now_sec() - t0, checksum, expected_checksum(n));
+}
+
+int main(int argc, char** argv) {
+    uint64_t n = (argc > 1) ? strtoull(argv[1], NULL, 0) : 2000000;
+    uint32_t batch = (argc > 2) ? (uint32_t)atoi(argv[2]) : 16;
+    if (batch == 0) batch = 1;
+    int max_workers = (int)std::thread::hardware_concurrency();
+    if (max_workers < 1) max_workers = 1;
+
+    std::cout << "Handing " << n << " blocks from one reader, batch " << batch << std::endl;
+    bench_mutex(n, 1);
+    bench_lock_free<SpscQueue<DmaBlock_t> >("SpscQueue", n, 1, batch);
+    bench_lock_free<MpmcQueue<DmaBlock_t> >("MpmcQueue", n, 1, batch);
+    if (max_workers > 1) {
+        bench_mutex(n, max_workers);
+        bench_lock_free<MpmcQueue<DmaBlock_t> >("MpmcQueue", n, max_workers, batch);
+    }
+    return 0;
+}
@@ -0,0 +1,152 @@
+// =================================================================================
+// FILE: bench_ring_depth.cpp
+//
+// DESCRIPTION:
+// Sustained-rate headroom versus S2MM ring depth. The emulated TDC source
+// pushes 4 KB packets at a fixed rate and drops them, like the FPGA FIFO,
+// when no descriptor is free. The reader decodes every word and is stalled
+// periodically (standing in for preemption, disk flushes, ...). For each
+// ring depth and offered rate the table shows the fraction of packets
+// dropped; the deeper the ring, the longer the stall it rides out.
+//
+// USAGE:
+//   ./bench_ring_depth [-t seconds] [-s stall_ms] [-p stall_period_ms] [-c cpu] [-r priority]
+//   (default: 1 s per cell, 5 ms stall every 50 ms)
+//   -c/-r run the reader in real-time mode (mlockall, prefault, pinned to
+//   `cpu`, SCHED_FIFO at `priority`); with -s 0 the table then shows what
+//   the rest of the system still costs the reader.
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "axi_dma_controller.hpp"
+#include "axi_dma_emulator.hpp"
+#include "axi_dma_rt.hpp"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+// --- Configuration ---
+const uint64_t MEM_SIZE = 0x4000000; // 64 MB, RX-only
+const uint32_t PACKET_SIZE = 4096;
+const uint32_t WORD_SIZE = 8;
+const uint32_t DEPTHS[] = {16, 64, 128, 512, 2048, 8192};
+const double RATES_MSPS[] = {10, 25, 50, 100};
+
+static volatile uint64_t g_checksum; // Keeps the decode loop
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool g_rt_enabled = false; // -c/-r given
+
+// Returns the fraction of offered packets that were dropped
+static double run_cell(uint32_t depth, double msps, double duration, double stall_ms, double period_ms) {
+    AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController dma(emu);
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.rx_num_bds = depth;
+    layout.rx_buffer_size = PACKET_SIZE;
+    dma.initSG(layout);
+    if (g_rt_enabled)
+        dma.prefault();
+    dma.setCoalescing(AxiDmaController::DmaDirection::RECEIVE, 16, 50);
+    dma.setWaitMode(AxiDmaController::DmaWaitMode::WAIT_HYBRID);
+    dma.setSpinBudget(0, 20);
+    dma.startSG(AxiDmaController::DmaDirection::RECEIVE);
+
+    uint64_t next_word = 0;
+    emu->setStreamSource([&next_word](uint8_t* dst, uint32_t max_len) -> uint32_t {
+        uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+        uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+        for (uint32_t i = 0; i < n; ++i)
+            words[i] = next_word++;
+        return n * WORD_SIZE;
+    }, msps * 1e6 * WORD_SIZE / PACKET_SIZE);
+
+    std::vector<AxiDmaController::DmaBlock> blocks(depth);
+    uint64_t checksum = 0;
+    double t_start = now_sec();
+    double next_stall = t_start + period_ms / 1e3;
+    for (;;) {
+        double t = now_sec();
+        if (t - t_start >= duration)
+            break;
+        if (stall_ms > 0 && t >= next_stall) {
+            usleep((useconds_t)(stall_ms * 1e3));
+            next_stall = now_sec() + period_ms / 1e3;
+        }
+        int n_blocks = dma.sgReceiveBatch(blocks.data(), depth);
+        if (n_blocks <= 0)
+            continue;
+        for (int b = 0; b < n_blocks; ++b) {
+            const uint64_t* rx = static_cast<const uint64_t*>(blocks[b].data);
+            for (uint32_t i = 0; i < blocks[b].len / WORD_SIZE; ++i)
+                checksum += rx[i];
+        }
+        dma.releaseBlocks(AxiDmaController::DmaDirection::RECEIVE, n_blocks);
+    }
+    uint64_t received = emu->packetsReceived();
+    uint64_t dropped = emu->packetsDropped();
+    g_checksum = checksum;
+    return (received + dropped) ? (double)dropped / (received + dropped) : 0;
+}
+
+int main(int argc, char** argv) {
+    double duration = 1.0, stall_ms = 5.0, period_ms = 50.0;
+    int cpu = -1, priority = 0;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "-t")) duration = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-s")) stall_ms = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-p")) period_ms = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "-c")) { cpu = atoi(argv[i + 1]); g_rt_enabled = true; }
+        else if (!strcmp(argv[i], "-r")) { priority = atoi(argv[i + 1]); g_rt_enabled = true; }
+    }
+
+    // The reader is this thread; the DMA mappings are prefaulted per cell
+    if (g_rt_enabled) {
+        try {
+            axi_dma_rt::lockMemory();
+            axi_dma_rt::prefaultStack();
+            if (cpu >= 0) {
+                axi_dma_rt::pinThread(cpu);
+                std::cout << "Reader " << axi_dma_rt::describeIsolation(cpu) << std::endl;
+            }
+            if (priority > 0)
+                axi_dma_rt::setFifo(priority);
+        } catch (const std::exception& e) {
+            std::cerr << "Real-time mode: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Dropped packets vs S2MM ring depth (" << PACKET_SIZE << " B packets, reader stalled "
+              << stall_ms << " ms every " << period_ms << " ms)" << std::endl;
+    std::cout << std::setw(8) << "BDs" << std::setw(12) << "buffer";
+    for (double r : RATES_MSPS)
+        std::cout << std::setw(9) << r << " MS/s";
+    std::cout << std::setw(14) << "ring time" << std::endl;
+
+    for (uint32_t depth : DEPTHS) {
+        std::cout << std::setw(8) << depth << std::setw(9) << depth * PACKET_SIZE / 1024 << " KB" << std::flush;
+        for (double r : RATES_MSPS)
+            std::cout << std::fixed << std::setprecision(2) << std::setw(13)
+                      << 100.0 * run_cell(depth, r, duration, stall_ms, period_ms) << "%" << std::flush;
+        // Ring depth in time at the highest rate: the longest stall it rides out
+        double packet_us = PACKET_SIZE / WORD_SIZE / RATES_MSPS[sizeof(RATES_MSPS) / sizeof(RATES_MSPS[0]) - 1];
+        std::cout << std::setw(11) << std::setprecision(1) << depth * packet_us / 1e3 << " ms" << std::endl;
+    }
+    std::cout << "ring time: time to fill the empty ring at " << RATES_MSPS[sizeof(RATES_MSPS) / sizeof(RATES_MSPS[0]) - 1]
+              << " MS/s" << std::endl;
+    return 0;
+}
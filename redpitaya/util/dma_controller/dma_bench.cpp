@@ -0,0 +1,431 @@
+// =================================================================================
+// FILE: dma_bench.cpp
+//
+// DESCRIPTION:
+// Parameterised SG loopback benchmark. Sweeps block size, ring depth, wait
+// mode, interrupt coalescing and the number of consumer threads; each point
+// runs for a warm-up and then a fixed measuring time. A producer thread
+// stamps the send time into every MM2S block (zero-copy transmit) and the
+// consumers read every word of each S2MM block back, standing in for the
+// decode. One consumer uses sgReceiveBatch/releaseBlocks, several share the
+// ring with claimBlockWait/releaseClaimed.
+//
+// Reported per point: throughput, per-block latency (transmit commit to
+// receive hand-out) percentiles, CPU time of the consumer threads and of
+// the whole process (with the emulator this includes its engine thread),
+// interrupts per block and the time the receive ring was full (an upper
+// bound, see ChannelStats).
+// Without -r the producer sends as fast as the rings allow, so latency then
+// includes the time blocks queue in both rings.
+//
+// Runs against the AXI DMA emulator (default) or the Red Pitaya loopback
+// design (--hw, root). Progress goes to stderr, results as CSV or JSON to
+// stdout or the -o file.
+//
+// USAGE:
+//   ./dma_bench [--hw] [-t seconds] [-w warmup_seconds] [-f csv|json] [-o file]
+//               [-b block sizes] [-d ring depths] [-m poll,irq,hybrid]
+//               [-c coalescing thresholds] [-n consumer counts] [-r blocks/s]
+//   Lists are comma separated. Defaults: 1 s per point after 0.2 s warm-up,
+//   -b 4096,32768 -d 16,64,256 -m poll,irq -c 1,16 -n 1,2, unpaced.
+//   `make bench BENCH_ARGS="..."` builds and runs it.
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "axi_dma_controller.hpp"
+#include "axi_dma_emulator.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+
+// --- Configuration ---
+// Interrupt lines of the loopback design: S2MM on uio1, MM2S on uio2
+// (as in ../dma/dma_loop_simple-interrupt.c). The constructors take MM2S first.
+const char* UIO_DEVICE_S2MM = "/dev/uio1";
+const char* UIO_DEVICE_MM2S = "/dev/uio2";
+const uint64_t DMA_PHYS_ADDR = 0x40400000;
+const uint64_t MEM_PHYS_ADDR = 0x1000000;
+const uint64_t HW_MEM_SIZE = 0x2000000;    // 32 MB reserved on the board
+const uint64_t EMU_MEM_SIZE = 0x4000000;   // 64 MB
+const uint8_t COALESCE_DELAY = 50;         // Delay timer with threshold > 1
+const size_t MAX_SAMPLES = 1 << 22;        // Latency samples kept per consumer
+
+enum Phase { WARMUP, MEASURE, STOP };
+
+struct BenchPoint {
+    uint32_t block_size;
+    uint32_t depth;
+    AxiDmaController::DmaWaitMode mode;
+    uint8_t threshold;
+    uint32_t consumers;
+};
+
+struct BenchResult {
+    uint64_t blocks = 0;
+    uint64_t bytes = 0;
+    double seconds = 0;
+    std::vector<uint64_t> latency_ns;
+    double rx_cpu_s = 0;
+    double process_cpu_s = 0;
+    AxiDmaController::ChannelStats rx_stats = AxiDmaController::ChannelStats();
+    uint64_t errors = 0;
+};
+
+struct Consumer {
+    uint64_t blocks = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+    uint64_t checksum = 0;
+    double cpu_start = 0, cpu_end = 0;
+    std::vector<uint64_t> latency_ns;
+};
+
+static volatile uint64_t g_checksum; // Keeps the decode loop
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double thread_cpu_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double process_cpu_sec() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static const char* mode_name(AxiDmaController::DmaWaitMode mode) {
+    switch (mode) {
+    case AxiDmaController::DmaWaitMode::WAIT_POLL: return "poll";
+    case AxiDmaController::DmaWaitMode::WAIT_IRQ: return "irq";
+    default: return "hybrid";
+    }
+}
+
+static std::vector<uint32_t> parse_list(const char* arg) {
+    std::vector<uint32_t> values;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            values.push_back((uint32_t)strtoul(item.c_str(), NULL, 0));
+    return values;
+}
+
+// Reads the send time and every word of the block, records the latency
+static void consume(Consumer& c, const AxiDmaController::DmaBlock& block, uint32_t expected_len, bool measuring) {
+    const uint64_t* words = static_cast<const uint64_t*>(block.data);
+    uint64_t received_ns = now_ns();
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < block.len / 8; ++i)
+        sum += words[i];
+    c.checksum += sum;
+    if (!measuring)
+        return;
+    c.blocks++;
+    c.bytes += block.len;
+    if (block.len != expected_len) {
+        c.errors++;
+        return;
+    }
+    if (c.latency_ns.size() < MAX_SAMPLES && received_ns >= words[0])
+        c.latency_ns.push_back(received_ns - words[0]);
+}
+
+static void consumer_loop(AxiDmaController& dma, Consumer& c, const BenchPoint& p, bool shared,
+                          const std::atomic<int>& phase) {
+    AxiDmaController::DmaDirection rx = AxiDmaController::DmaDirection::RECEIVE;
+    std::vector<AxiDmaController::DmaBlock> blocks(p.depth);
+    c.latency_ns.reserve(1 << 16);
+    bool measured = false;
+    for (;;) {
+        int ph = phase.load(std::memory_order_relaxed);
+        if (ph != WARMUP && !measured) {
+            c.cpu_start = thread_cpu_sec();
+            measured = true;
+        }
+        if (ph == STOP)
+            break;
+        if (shared) {
+            AxiDmaController::DmaBlock block;
+            uint32_t id;
+            if (dma.claimBlockWait(&block, &id) <= 0) {
+                c.errors++;
+                continue;
+            }
+            consume(c, block, p.block_size, ph == MEASURE);
+            dma.releaseClaimed(id);
+        } else {
+            int n = dma.sgReceiveBatch(blocks.data(), p.depth);
+            if (n <= 0) {
+                c.errors++;
+                continue;
+            }
+            for (int i = 0; i < n; ++i)
+                consume(c, blocks[i], p.block_size, ph == MEASURE);
+            dma.releaseBlocks(rx, n);
+        }
+    }
+    c.cpu_end = thread_cpu_sec();
+}
+
+// Sends timestamped blocks until every consumer has stopped; they may be
+// waiting for one more block
+static void producer_loop(AxiDmaController& dma, const BenchPoint& p, double rate,
+                          const std::atomic<uint32_t>& consumers_running) {
+    AxiDmaController::DmaDirection tx = AxiDmaController::DmaDirection::TRANSMIT;
+    int irq_fd = (p.mode == AxiDmaController::DmaWaitMode::WAIT_POLL) ? -1 : dma.getIrqFd(tx);
+    uint64_t interval_ns = rate > 0 ? (uint64_t)(1e9 / rate) : 0;
+    uint64_t next_send = now_ns();
+    while (consumers_running.load(std::memory_order_relaxed) > 0) {
+        while (dma.tryTransmitCompletionSG() > 0)
+            ;
+        if (interval_ns) {
+            uint64_t t = now_ns();
+            if (t < next_send) {
+                if (next_send - t > 100000)
+                    usleep((useconds_t)((next_send - t) / 1000 - 50));
+                else
+                    sched_yield();
+                continue;
+            }
+            next_send += interval_ns;
+        }
+        void* buf;
+        uint32_t capacity;
+        int ret = dma.acquireTransmitBuffer(&buf, &capacity);
+        if (ret < 0)
+            return;
+        if (ret > 0) {
+            static_cast<uint64_t*>(buf)[0] = now_ns();
+            dma.commitTransmitBlock(p.block_size, true, true);
+            dma.flushTransmit();
+            continue;
+        }
+        // Transmit ring full: wait for a completion, waking up now and then
+        // to notice the consumers stopping
+        if (irq_fd >= 0 && dma.armIrq(tx) == 0) {
+            struct pollfd pfd = {irq_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 10) > 0)
+                dma.consumeIrq(tx);
+        } else if (irq_fd < 0) {
+            sched_yield();
+        }
+    }
+}
+
+static void run_point(bool hw, const BenchPoint& p, double warmup, double duration, double rate, BenchResult& r) {
+    AxiDmaController* dma;
+    if (hw)
+        dma = new AxiDmaController(DMA_PHYS_ADDR, MEM_PHYS_ADDR, HW_MEM_SIZE, UIO_DEVICE_MM2S, UIO_DEVICE_S2MM);
+    else
+        dma = new AxiDmaController(new AxiDmaEmulator(EMU_MEM_SIZE));
+    std::unique_ptr<AxiDmaController> owner(dma);
+
+    AxiDmaController::DmaDirection tx = AxiDmaController::DmaDirection::TRANSMIT;
+    AxiDmaController::DmaDirection rx = AxiDmaController::DmaDirection::RECEIVE;
+    dma->initSG(AxiDmaController::DmaMode::SCATTER_GATHER, AxiDmaController::DmaMode::SCATTER_GATHER,
+                p.depth, p.block_size);
+    dma->setWaitMode(p.mode);
+    uint8_t delay = p.threshold > 1 ? COALESCE_DELAY : 0;
+    dma->setCoalescing(tx, p.threshold, delay);
+    dma->setCoalescing(rx, p.threshold, delay);
+    dma->startSG(tx);
+    dma->startSG(rx);
+
+    std::atomic<int> phase(WARMUP);
+    std::atomic<uint32_t> consumers_running(p.consumers);
+    std::vector<Consumer> consumers(p.consumers);
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < p.consumers; ++i)
+        threads.push_back(std::thread([&, i]() {
+            consumer_loop(*dma, consumers[i], p, p.consumers > 1, phase);
+            consumers_running.fetch_sub(1);
+        }));
+    std::thread producer(producer_loop, std::ref(*dma), std::cref(p), rate, std::cref(consumers_running));
+
+    usleep((useconds_t)(warmup * 1e6));
+    dma->resetStats(rx);
+    double cpu_start = process_cpu_sec();
+    uint64_t t_start = now_ns();
+    phase = MEASURE;
+    usleep((useconds_t)(duration * 1e6));
+    phase = STOP;
+    uint64_t t_end = now_ns();
+    double cpu_end = process_cpu_sec();
+    r.rx_stats = dma->getStats(rx);
+
+    for (size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    producer.join();
+
+    r.seconds = (t_end - t_start) / 1e9;
+    r.process_cpu_s = cpu_end - cpu_start;
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < consumers.size(); ++i) {
+        const Consumer& c = consumers[i];
+        r.blocks += c.blocks;
+        r.bytes += c.bytes;
+        r.errors += c.errors;
+        r.rx_cpu_s += c.cpu_end - c.cpu_start;
+        r.latency_ns.insert(r.latency_ns.end(), c.latency_ns.begin(), c.latency_ns.end());
+        checksum += c.checksum;
+    }
+    g_checksum = checksum;
+}
+
+static double percentile_us(std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty())
+        return 0;
+    return sorted[(size_t)(p / 100.0 * (sorted.size() - 1) + 0.5)] / 1e3;
+}
+
+static const char* COLUMNS[] = {
+    "backend", "block_size", "ring_depth", "wait_mode", "coalesce", "consumers", "seconds", "blocks",
+    "mb_per_s", "blocks_per_s", "lat_p50_us", "lat_p90_us", "lat_p99_us", "lat_p999_us", "lat_max_us",
+    "rx_cpu_pct", "process_cpu_pct", "irqs_per_block", "ring_full_pct", "errors"};
+
+static std::vector<std::string> format_row(bool hw, const BenchPoint& p, BenchResult& r) {
+    std::sort(r.latency_ns.begin(), r.latency_ns.end());
+    double s = r.seconds > 0 ? r.seconds : 1;
+    std::vector<double> numbers = {
+        (double)p.block_size, (double)p.depth, 0, (double)p.threshold, (double)p.consumers, r.seconds,
+        (double)r.blocks, r.bytes / s / 1e6, r.blocks / s,
+        percentile_us(r.latency_ns, 50), percentile_us(r.latency_ns, 90), percentile_us(r.latency_ns, 99),
+        percentile_us(r.latency_ns, 99.9), r.latency_ns.empty() ? 0 : r.latency_ns.back() / 1e3,
+        100 * r.rx_cpu_s / s, 100 * r.process_cpu_s / s,
+        r.blocks ? (double)r.rx_stats.irqs / r.blocks : 0, 100 * r.rx_stats.ring_full_ns / 1e9 / s,
+        (double)r.errors};
+    std::vector<std::string> row;
+    row.push_back(hw ? "hw" : "emulator");
+    for (size_t i = 0; i < numbers.size(); ++i) {
+        std::ostringstream os;
+        if (i == 2)
+            os << mode_name(p.mode);
+        else if (numbers[i] == (double)(uint64_t)numbers[i] && i != 5)
+            os << (uint64_t)numbers[i];
+        else
+            os << std::fixed << std::setprecision(3) << numbers[i];
+        row.push_back(os.str());
+    }
+    return row;
+}
+
+int main(int argc, char** argv) {
+    bool hw = false;
+    bool json = false;
+    double duration = 1.0, warmup = 0.2, rate = 0;
+    std::string out_path;
+    std::vector<uint32_t> sizes = {4096, 32768}, depths = {16, 64, 256}, thresholds = {1, 16}, consumer_counts = {1, 2};
+    std::vector<AxiDmaController::DmaWaitMode> modes = {AxiDmaController::DmaWaitMode::WAIT_POLL,
+                                                        AxiDmaController::DmaWaitMode::WAIT_IRQ};
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = argv[i];
+        if (!strcmp(opt, "--hw")) { hw = true; continue; }
+        if (i + 1 >= argc) {
+            std::cerr << "Missing value for " << opt << std::endl;
+            return 1;
+        }
+        const char* val = argv[++i];
+        if (!strcmp(opt, "-t")) duration = atof(val);
+        else if (!strcmp(opt, "-w")) warmup = atof(val);
+        else if (!strcmp(opt, "-r")) rate = atof(val);
+        else if (!strcmp(opt, "-o")) out_path = val;
+        else if (!strcmp(opt, "-f")) json = !strcmp(val, "json");
+        else if (!strcmp(opt, "-b")) sizes = parse_list(val);
+        else if (!strcmp(opt, "-d")) depths = parse_list(val);
+        else if (!strcmp(opt, "-c")) thresholds = parse_list(val);
+        else if (!strcmp(opt, "-n")) consumer_counts = parse_list(val);
+        else if (!strcmp(opt, "-m")) {
+            modes.clear();
+            std::stringstream ss(val);
+            std::string m;
+            while (std::getline(ss, m, ',')) {
+                if (m == "poll") modes.push_back(AxiDmaController::DmaWaitMode::WAIT_POLL);
+                else if (m == "irq") modes.push_back(AxiDmaController::DmaWaitMode::WAIT_IRQ);
+                else if (m == "hybrid") modes.push_back(AxiDmaController::DmaWaitMode::WAIT_HYBRID);
+                else { std::cerr << "Unknown wait mode " << m << std::endl; return 1; }
+            }
+        } else {
+            std::cerr << "Unknown option " << opt << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+    if (!out_path.empty()) {
+        file.open(out_path.c_str());
+        if (!file) {
+            std::cerr << "Cannot open " << out_path << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = out_path.empty() ? std::cout : file;
+    const size_t ncols = sizeof(COLUMNS) / sizeof(COLUMNS[0]);
+    if (json) {
+        out << "[";
+    } else {
+        for (size_t i = 0; i < ncols; ++i)
+            out << (i ? "," : "") << COLUMNS[i];
+        out << std::endl;
+    }
+
+    bool first = true;
+    for (uint32_t size : sizes)
+        for (uint32_t depth : depths)
+            for (AxiDmaController::DmaWaitMode mode : modes)
+                for (uint32_t threshold : thresholds)
+                    for (uint32_t n : consumer_counts) {
+                        BenchPoint p = {size, depth, mode, (uint8_t)threshold, n ? n : 1};
+                        std::cerr << "block " << size << " B, " << depth << " BDs, " << mode_name(mode)
+                                  << ", coalesce " << threshold << ", " << p.consumers << " consumer(s): " << std::flush;
+                        BenchResult r;
+                        try {
+                            run_point(hw, p, warmup, duration, rate, r);
+                        } catch (const std::exception& e) {
+                            std::cerr << "skipped (" << e.what() << ")" << std::endl;
+                            continue;
+                        }
+                        std::vector<std::string> row = format_row(hw, p, r);
+                        std::cerr << row[8] << " MB/s, p99 " << row[12] << " us" << std::endl;
+                        if (json) {
+                            out << (first ? "\n  {" : ",\n  {");
+                            for (size_t i = 0; i < ncols; ++i) {
+                                bool text = (i == 0 || i == 3);
+                                out << (i ? ", " : "") << "\"" << COLUMNS[i] << "\": "
+                                    << (text ? "\"" : "") << row[i] << (text ? "\"" : "");
+                            }
+                            out << "}";
+                        } else {
+                            for (size_t i = 0; i < ncols; ++i)
+                                out << (i ? "," : "") << row[i];
+                            out << std::endl;
+                        }
+                        first = false;
+                    }
+    if (json)
+        out << "\n]" << std::endl;
+    return 0;
+}
@@ -0,0 +1,168 @@
+// =================================================================================
+// FILE: dma_trace_dump.cpp
+//
+// DESCRIPTION:
+// Reads a latency trace written by AxiDmaController::dumpTrace() (library
+// built with `make TRACE=1`) and prints, per direction, percentiles and a
+// log2 histogram of each stage a block goes through:
+//   IRQ wake -> observed    interrupt return until the reader sees the next BD complete
+//   observed -> handed      cache sync and bookkeeping before the user gets the block
+//   handed   -> released    time the user held the block
+//   observed -> released    whole pickup-to-release span
+// A long first stage points at IRQ delivery or scheduling, a long hold at the
+// consumer; blocks arriving late with short stages point at the FPGA side.
+//
+// USAGE:
+//   ./dma_trace_dump <trace file> [-r]     (-r: also print the raw events as CSV)
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "axi_dma_trace.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+
+static const char *KIND_NAMES[] = {"irq_wake", "observed", "handed", "released"};
+
+static std::string format_ns(uint64_t ns) {
+    char buf[32];
+    if (ns < 1000)
+        snprintf(buf, sizeof(buf), "%llu ns", (unsigned long long)ns);
+    else if (ns < 1000000)
+        snprintf(buf, sizeof(buf), "%.1f us", ns / 1e3);
+    else if (ns < 1000000000)
+        snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+    else
+        snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+    return buf;
+}
+
+static uint64_t percentile(const std::vector<uint64_t> &sorted, double p) {
+    size_t i = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static void print_stage(const char *name, std::vector<uint64_t> samples) {
+    std::cout << "  " << name << " (" << samples.size() << " samples)" << std::endl;
+    if (samples.empty())
+        return;
+    std::sort(samples.begin(), samples.end());
+    std::cout << "    p50 " << format_ns(percentile(samples, 50))
+              << "   p90 " << format_ns(percentile(samples, 90))
+              << "   p99 " << format_ns(percentile(samples, 99))
+              << "   p99.9 " << format_ns(percentile(samples, 99.9))
+              << "   max " << format_ns(samples.back()) << std::endl;
+
+    // log2 buckets: [2^b, 2^(b+1)) ns, bucket 0 also holds 0
+    uint64_t counts[64] = {0};
+    int lo = 63, hi = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        int b = samples[i] ? 63 - __builtin_clzll(samples[i]) : 0;
+        counts[b]++;
+        lo = std::min(lo, b);
+        hi = std::max(hi, b);
+    }
+    uint64_t peak = *std::max_element(counts + lo, counts + hi + 1);
+    const int WIDTH = 40;
+    for (int b = lo; b <= hi; ++b) {
+        int bar = (int)((counts[b] * WIDTH + peak - 1) / peak);
+        std::cout << "    " << std::setw(9) << format_ns(b ? (1ULL << b) : 0) << " - "
+                  << std::setw(9) << format_ns(1ULL << (b + 1)) << " |"
+                  << std::string(bar, '#') << std::string(WIDTH - bar, ' ') << "| " << counts[b] << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <trace file> [-r]" << std::endl;
+        return 1;
+    }
+    bool raw = (argc > 2 && strcmp(argv[2], "-r") == 0);
+
+    FILE *file = fopen(argv[1], "rb");
+    if (!file) {
+        std::cerr << "Cannot open " << argv[1] << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    AxiDmaTraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, "AXIDMATR", 8) != 0 ||
+        header.version != 1 || header.event_size != sizeof(AxiDmaTraceEvent)) {
+        std::cerr << argv[1] << " is not a version 1 DMA trace" << std::endl;
+        fclose(file);
+        return 1;
+    }
+    std::vector<AxiDmaTraceEvent> events(header.count);
+    size_t n = events.empty() ? 0 : fread(events.data(), sizeof(AxiDmaTraceEvent), events.size(), file);
+    fclose(file);
+    events.resize(n);
+
+    std::cout << "Trace " << argv[1] << ": " << n << " events";
+    if (header.overwritten)
+        std::cout << " (" << header.overwritten << " older events overwritten)";
+    if (n > 1)
+        std::cout << " over " << format_ns(events.back().ts_ns - events.front().ts_ns);
+    std::cout << std::endl;
+
+    if (raw) {
+        std::cout << "ts_ns,dir,bd,event" << std::endl;
+        for (size_t i = 0; i < n; ++i)
+            std::cout << events[i].ts_ns << "," << (events[i].dir ? "s2mm" : "mm2s") << "," << events[i].bd << ","
+                      << (events[i].kind < 4 ? KIND_NAMES[events[i].kind] : "?") << std::endl;
+    }
+
+    for (uint16_t dir = 0; dir < 2; ++dir) {
+        std::vector<uint64_t> wake_to_observed, observed_to_handed, held, observed_to_released;
+        // Per BD: timestamps of the current pass through the ring, 0 = not seen
+        std::map<uint32_t, std::pair<uint64_t, uint64_t> > pending;
+        uint64_t last_wake = 0;
+        size_t dir_events = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const AxiDmaTraceEvent &e = events[i];
+            if (e.dir != dir)
+                continue;
+            dir_events++;
+            switch (e.kind) {
+            case AXI_DMA_TRACE_IRQ_WAKE:
+                last_wake = e.ts_ns;
+                break;
+            case AXI_DMA_TRACE_OBSERVED:
+                if (last_wake) {
+                    wake_to_observed.push_back(e.ts_ns - last_wake);
+                    last_wake = 0;
+                }
+                pending[e.bd] = std::make_pair(e.ts_ns, 0);
+                break;
+            case AXI_DMA_TRACE_HANDED:
+                if (pending.count(e.bd) && pending[e.bd].first) {
+                    pending[e.bd].second = e.ts_ns;
+                    observed_to_handed.push_back(e.ts_ns - pending[e.bd].first);
+                }
+                break;
+            case AXI_DMA_TRACE_RELEASED:
+                if (pending.count(e.bd) && pending[e.bd].second) {
+                    held.push_back(e.ts_ns - pending[e.bd].second);
+                    observed_to_released.push_back(e.ts_ns - pending[e.bd].first);
+                }
+                pending.erase(e.bd);
+                break;
+            }
+        }
+        if (dir_events == 0)
+            continue;
+        std::cout << "\n" << (dir ? "S2MM" : "MM2S") << ": " << dir_events << " events" << std::endl;
+        print_stage("IRQ wake -> observed", wake_to_observed);
+        print_stage("observed -> handed", observed_to_handed);
+        print_stage("handed -> released", held);
+        print_stage("observed -> released", observed_to_released);
+    }
+    return 0;
+}
@@ -3,6 +3,8 @@
 //
 // DESCRIPTION:
 // An example application demonstrating how to use the AXI DMA C API.
+// The timings printed are a single 32 x 32 KB pass; for throughput and
+// latency across block sizes, ring depths and wait modes use dma_bench.
 //
 // HOW TO COMPILE:
 // See the provided Makefile. Run `make`.
@@ -3,6 +3,7 @@
 //
 // DESCRIPTION:
 // An example application demonstrating how to use the AXI DMA C API.
+// To compare consumer thread counts over many blocks, see dma_bench -n.
 //
 // HOW TO COMPILE:
 // See the provided Makefile. Run `make`.
@@ -20,6 +21,9 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <memory>
+#include "axi_dma_queue.hpp"
 
 
 // --- Configuration ---
@@ -105,7 +109,7 @@ void run_direct_register_loopback_test() {
 }
 
 void run_sg_loopback_test() {
-    std::cout << "\n--- Running Scatter-Gather Loopback Test ---" << std::endl;
+    std::cout << "\n--- Running Scatter-Gather Loopback Test (mutex queue) ---" << std::endl;
     AxiDmaHandle_t dma = dma_create_irq(DMA_PHYS_ADDR, MEM_PHYS_ADDR, MEM_SIZE, UIO_DEVICE_S2MM, UIO_DEVICE_MM2S);
     if (!dma) return;
 
@@ -227,9 +231,128 @@ void run_sg_loopback_test() {
     dma_destroy(dma);
 }
 
+// Same test, handing blocks to the workers through the lock-free MpmcQueue in
+// batches instead of a mutex/condvar queue with one notify per block
+void run_sg_loopback_test_lock_free() {
+    std::cout << "\n--- Running Scatter-Gather Loopback Test (lock-free queue) ---" << std::endl;
+    AxiDmaHandle_t dma = dma_create_irq(DMA_PHYS_ADDR, MEM_PHYS_ADDR, MEM_SIZE, UIO_DEVICE_S2MM, UIO_DEVICE_MM2S);
+    if (!dma) return;
+
+    const int NUM_BLOCKS = 32;
+    const int BLOCK_SIZE = 32*1024;
+
+    dma_init_channel(dma, DMA_MODE_SG, DMA_MODE_SG, NUM_BLOCKS, BLOCK_SIZE);
+    dma_start(dma, DMA_TRANSMIT);
+    dma_start(dma, DMA_RECEIVE);
+
+    int tx_length = BLOCK_SIZE*NUM_BLOCKS;
+    std::vector<uint8_t> test_data(BLOCK_SIZE*NUM_BLOCKS);
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        for(int j = 0; j < BLOCK_SIZE; ++j) {
+            test_data[j + i*BLOCK_SIZE] = (uint8_t)(i + j);
+        }
+    }
+    while (dma_submit_transmit_block(dma, test_data.data(), tx_length) == 0) {
+        usleep(1000);
+    }
+
+    struct timeval t_start, t_end;
+    gettimeofday(&t_start, NULL);
+
+    // The main thread claims completed blocks and hands them over in batches,
+    // each with its claim order. The workers finish out of order and release
+    // their own blocks; the controller gives the BDs back to the engine in
+    // ring order once every older claimed block is released too.
+    struct Work {
+        DmaBlock_t block;
+        uint32_t id;
+        int seq;
+    };
+    MpmcQueue<Work> block_queue(NUM_BLOCKS);
+    std::unique_ptr<std::atomic<int>[]> seen(new std::atomic<int>[NUM_BLOCKS]);
+    for (int i = 0; i < NUM_BLOCKS; ++i)
+        seen[i].store(0);
+    std::atomic<int> total_errors{0};
+    std::atomic<int> blocks_processed{0};
+    const int NUM_THREADS = std::thread::hardware_concurrency();
+    std::vector<std::thread> workers;
+
+    auto worker = [&]() {
+        Work work[8];
+        size_t n;
+        // Returns 0 once the queue is closed and drained
+        while ((n = block_queue.popWait(work, 8)) > 0) {
+            for (size_t b = 0; b < n; ++b) {
+                uint8_t* rx_data = static_cast<uint8_t*>(work[b].block.data);
+                int local_errors = 0;
+                // Block i of the packet starts with byte i: a block handed out
+                // twice, or out of order, fails here
+                int block_idx = work[b].seq;
+                for(uint32_t j = 0; j < work[b].block.len; ++j) {
+                    if (rx_data[j] != (uint8_t)(block_idx + j))
+                        local_errors++;
+                }
+                total_errors += local_errors;
+                seen[block_idx].fetch_add(1);
+                dma_release_claimed_block(dma, work[b].id);
+            }
+            blocks_processed += (int)n;
+        }
+    };
+
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        workers.emplace_back(worker);
+    }
+
+    // Main thread: wait for one block, claim whatever else has completed and
+    // hand it all over as one batch
+    int received = 0;
+    while (received < NUM_BLOCKS) {
+        Work work[NUM_BLOCKS];
+        int n = 0;
+        int result = dma_claim_block(dma, &work[0].block, &work[0].id, 1);
+        while (result > 0) {
+            work[n].seq = received + n;
+            if (++n == NUM_BLOCKS - received)
+                break;
+            result = dma_claim_block(dma, &work[n].block, &work[n].id, 0);
+        }
+        if (result < 0 || n == 0) {
+            std::cerr << "Error receiving block." << std::endl;
+            break;
+        }
+        block_queue.pushWait(work, n);
+        received += n;
+    }
+    block_queue.close();
+    for (auto& t : workers) t.join();
+
+    int distinct = 0;
+    for (int i = 0; i < NUM_BLOCKS; ++i)
+        distinct += (seen[i].load() == 1);
+
+    gettimeofday(&t_end, NULL);
+    double elapsed = (t_end.tv_sec - t_start.tv_sec) + (t_end.tv_usec - t_start.tv_usec) / 1e6;
+    double mb = tx_length / (1024.0 * 1024.0);
+    double mbps = mb / elapsed;
+    std::cout << "\nDMA transfer time: " << elapsed << " s, throughput: " << mbps << " MB/s" << std::endl;
+    std::cout << "Blocks processed: " << blocks_processed << " (" << distinct << " distinct), total errors: "
+              << total_errors << std::endl;
+
+    if (total_errors == 0 && blocks_processed == NUM_BLOCKS && distinct == NUM_BLOCKS) {
+        std::cout << "\n*** SG Test SUCCESS ***" << std::endl;
+    } else {
+        std::cout << "\n*** SG Test FAILURE ***" << std::endl;
+    }
+
+    dma_destroy(dma);
+}
+
 
 int main() {
     // run_direct_register_loopback_test();
+    // Both variants for a throughput comparison, see also bench_queue
     run_sg_loopback_test();
+    run_sg_loopback_test_lock_free();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,482 @@
+// =================================================================================
+// FILE: example_emulator.cpp
+//
+// DESCRIPTION:
+// Runs the SG loopback test, the zero-copy replay test, an S2MM readout load
+// test, a multi-consumer decode test, a free-running cyclic capture test and
+// an in-place DMA error recovery test against the software AXI DMA emulator,
+// so the readout path can be exercised and timed on any Linux machine.
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`, then `./example_emulator [MS/s]`.
+// Built with `make TRACE=1` the load test also writes s2mm_trace.bin.
+//
+// =================================================================================
+#include "axi_dma_api.h"
+#include "axi_dma_controller.hpp"
+#include "axi_dma_emulator.hpp"
+#include "axi_dma_regs.hpp"
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+// --- Configuration ---
+const uint64_t MEM_SIZE = 0x2000000; // 32 * 1024 * 1024 =  32 MB
+const uint32_t PACKET_SIZE = 4096;   // FIFO_AXI4_Stream_Wrap packet size
+const uint32_t WORD_SIZE = 8;        // One 64-bit TDC word per hit
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void run_sg_loopback_test() {
+    std::cout << "\n--- Running Scatter-Gather Loopback Test (emulated) ---" << std::endl;
+    AxiDmaHandle_t dma = dma_create_emulated(MEM_SIZE, 1);
+    if (!dma) return;
+
+    const int NUM_BLOCKS = 32;
+    const int BLOCK_SIZE = 32*1024;
+
+    dma_init_channel(dma, DMA_MODE_SG, DMA_MODE_SG, NUM_BLOCKS, BLOCK_SIZE);
+    dma_start(dma, DMA_TRANSMIT);
+    dma_start(dma, DMA_RECEIVE);
+
+    int tx_length = BLOCK_SIZE*NUM_BLOCKS;
+    std::vector<uint8_t> test_data(tx_length);
+    for (int i = 0; i < NUM_BLOCKS; ++i)
+        for (int j = 0; j < BLOCK_SIZE; ++j)
+            test_data[j + i*BLOCK_SIZE] = (uint8_t)(i + j);
+    dma_submit_transmit_block(dma, test_data.data(), tx_length);
+
+    int total_errors = 0;
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        void* data_ptr = nullptr;
+        uint32_t len = 0;
+        int result = dma_get_completed_block(dma, DMA_RECEIVE, &data_ptr, &len);
+        if (result <= 0) {
+            std::cerr << "Error receiving block." << std::endl;
+            total_errors++;
+            break;
+        }
+        uint8_t* rx_data = static_cast<uint8_t*>(data_ptr);
+        for (uint32_t j = 0; j < len; ++j)
+            total_errors += (((i + j) & 0xFF) != rx_data[j]);
+        dma_release_completed_block(dma, DMA_RECEIVE);
+    }
+
+    std::cout << ((total_errors == 0) ? "*** SG Test SUCCESS ***" : "*** SG Test FAILURE ***") << std::endl;
+    dma_destroy(dma);
+}
+
+void run_zero_copy_replay_test() {
+    std::cout << "\n--- Running Zero-Copy Transmit Replay Test (emulated) ---" << std::endl;
+    AxiDmaHandle_t dma = dma_create_emulated(MEM_SIZE, 1);
+    if (!dma) return;
+
+    const uint32_t NUM_BDS = 16;
+    const uint32_t NUM_PACKETS = 1000; // Wraps the TX and RX rings many times
+    const uint32_t BATCH = 4;
+    dma_init_channel(dma, DMA_MODE_SG, DMA_MODE_SG, NUM_BDS, PACKET_SIZE);
+    dma_start(dma, DMA_TRANSMIT);
+    dma_start(dma, DMA_RECEIVE);
+
+    uint32_t sent = 0, received = 0, errors = 0;
+    while (received < NUM_PACKETS) {
+        // Fill up to BATCH buffers in place and hand them over with one TAILDESC write
+        uint32_t lens[BATCH];
+        uint32_t n = 0;
+        while (n < BATCH && sent + n < NUM_PACKETS) {
+            uint32_t capacity;
+            uint64_t* buf = (uint64_t*)dma_acquire_transmit_buffer(dma, n, &capacity);
+            if (!buf) break;
+            for (uint32_t w = 0; w < PACKET_SIZE / WORD_SIZE; ++w)
+                buf[w] = ((uint64_t)(sent + n) << 32) | w;
+            lens[n++] = PACKET_SIZE;
+        }
+        for (uint32_t i = 0; i < n; ++i)
+            dma_commit_transmit_blocks(dma, &lens[i], 1, 1, 1); // One packet per buffer
+        dma_flush_transmit(dma);
+        sent += n;
+
+        DmaBlock_t blocks[NUM_BDS];
+        int n_rx = dma_get_completed_blocks(dma, DMA_RECEIVE, blocks, NUM_BDS);
+        for (int b = 0; b < n_rx; ++b) {
+            const uint64_t* rx = (const uint64_t*)blocks[b].data;
+            errors += (blocks[b].len != PACKET_SIZE) || ((rx[0] >> 32) != received + b);
+        }
+        if (n_rx > 0) {
+            dma_release_completed_blocks(dma, DMA_RECEIVE, n_rx);
+            received += n_rx;
+        }
+        // Reclaim the transmitted buffers
+        while (dma_wait_for_transmit_completion_sg(dma) > 0)
+            ;
+    }
+
+    std::cout << "Replayed " << received << " packets, " << errors << " errors" << std::endl;
+    std::cout << ((errors == 0) ? "*** Replay Test SUCCESS ***" : "*** Replay Test FAILURE ***") << std::endl;
+    dma_destroy(dma);
+}
+
+void run_readout_load_test(double msps) {
+    std::cout << "\n--- Running S2MM Readout Load Test (emulated, " << msps << " MS/s offered) ---" << std::endl;
+
+    AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController dma(emu);
+    // RX-only readout: no transmit ring, the whole region is available to S2MM
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.rx_num_bds = 64;
+    layout.rx_buffer_size = PACKET_SIZE;
+    dma.initSG(layout);
+    // One interrupt per 16 packets, the delay timer flushes the tail at low rates
+    dma.setCoalescing(AxiDmaController::DmaDirection::RECEIVE, 16, 50);
+    // Spin up to 20 us before sleeping on the interrupt
+    dma.setWaitMode(AxiDmaController::DmaWaitMode::WAIT_HYBRID);
+    dma.setSpinBudget(0, 20);
+    dma.startSG(AxiDmaController::DmaDirection::RECEIVE);
+
+    // The packet source stands in for the TDC: full packets of sequential words
+    uint64_t next_word = 0;
+    emu->setStreamSource([&next_word](uint8_t* dst, uint32_t max_len) -> uint32_t {
+        uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+        uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+        for (uint32_t i = 0; i < n; ++i)
+            words[i] = next_word++;
+        return n * WORD_SIZE;
+    }, msps * 1e6 * WORD_SIZE / PACKET_SIZE);
+
+    // A monitor thread samples the counters while the readout runs, as an
+    // alarm on the ring filling up would
+    std::atomic<bool> running{true};
+    uint32_t max_occupancy_seen = 0;
+    std::thread monitor([&]() {
+        while (running.load()) {
+            AxiDmaController::ChannelStats s = dma.getStats(AxiDmaController::DmaDirection::RECEIVE);
+            if (s.occupancy_hwm > max_occupancy_seen)
+                max_occupancy_seen = s.occupancy_hwm;
+            usleep(10000);
+        }
+    });
+
+    const double DURATION = 2.0;
+    uint64_t words = 0, expected = 0, gaps = 0;
+    double t_start = now_sec();
+    AxiDmaController::DmaBlock blocks[64];
+    while (now_sec() - t_start < DURATION) {
+        // Drain everything completed since the last call, release with one TAILDESC write
+        int n_blocks = dma.sgReceiveBatch(blocks, 64);
+        if (n_blocks <= 0)
+            continue;
+        for (int b = 0; b < n_blocks; ++b) {
+            const uint64_t* rx = static_cast<const uint64_t*>(blocks[b].data);
+            uint32_t n = blocks[b].len / WORD_SIZE;
+            if (n && rx[0] != expected)
+                gaps++;
+            expected = n ? rx[n - 1] + 1 : expected;
+            words += n;
+        }
+        dma.releaseBlocks(AxiDmaController::DmaDirection::RECEIVE, n_blocks);
+    }
+    double elapsed = now_sec() - t_start;
+
+    std::cout << "Received " << words << " words in " << elapsed << " s: "
+              << words / elapsed / 1e6 << " MS/s, "
+              << words * WORD_SIZE / elapsed / (1024.0 * 1024.0) << " MB/s" << std::endl;
+    std::cout << "Packets dropped by the emulated FIFO: " << emu->packetsDropped()
+              << ", gaps seen by the reader: " << gaps << std::endl;
+    running = false;
+    monitor.join();
+    AxiDmaController::ChannelStats s = dma.getStats(AxiDmaController::DmaDirection::RECEIVE);
+    std::cout << "Stats: " << s.blocks << " blocks, " << s.irqs << " IRQs (" << s.spurious_wakeups
+              << " spurious), occupancy high-water " << s.occupancy_hwm << "/64 (monitor saw " << max_occupancy_seen
+              << "), ring full " << s.ring_full_count << " times for " << s.ring_full_ns / 1e6 << " ms" << std::endl;
+    // Built with `make TRACE=1`: per-BD timestamps of the newest blocks
+    size_t traced = dma.dumpTrace("s2mm_trace.bin");
+    if (traced)
+        std::cout << "Latency trace: " << traced << " events, run ./dma_trace_dump s2mm_trace.bin" << std::endl;
+}
+
+void run_multi_consumer_test(int num_workers) {
+    std::cout << "\n--- Running Multi-Consumer Claim/Release Test (emulated, " << num_workers << " workers) ---" << std::endl;
+
+    const uint32_t NUM_BDS = 32;
+    const uint64_t NUM_PACKETS = 20000;
+    AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController dma(emu);
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.rx_num_bds = NUM_BDS;
+    layout.rx_buffer_size = PACKET_SIZE;
+    dma.initSG(layout);
+    dma.startSG(AxiDmaController::DmaDirection::RECEIVE);
+
+    // Each packet holds its sequence number in every word
+    uint64_t next_packet = 0;
+    emu->setStreamSource([&next_packet, NUM_PACKETS](uint8_t* dst, uint32_t max_len) -> uint32_t {
+        if (next_packet >= NUM_PACKETS)
+            return 0;
+        uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+        uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+        for (uint32_t i = 0; i < n; ++i)
+            words[i] = next_packet;
+        next_packet++;
+        return n * WORD_SIZE;
+    });
+
+    // Workers decode straight out of DMA memory and release in whatever order they finish
+    std::atomic<uint64_t> packets{0}, errors{0}, seq_sum{0};
+    std::vector<std::thread> workers;
+    for (int w = 0; w < num_workers; ++w)
+        workers.emplace_back([&]() {
+            while (packets.load() < NUM_PACKETS) {
+                AxiDmaController::DmaBlock block;
+                uint32_t id;
+                int ret = dma.claimBlock(&block, &id);
+                if (ret == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (ret < 0) {
+                    errors++;
+                    break;
+                }
+                const uint64_t* rx = static_cast<const uint64_t*>(block.data);
+                uint32_t n = block.len / WORD_SIZE;
+                for (uint32_t i = 1; i < n; ++i)
+                    errors += (rx[i] != rx[0]);
+                seq_sum += rx[0];
+                dma.releaseClaimed(id);
+                packets++;
+            }
+        });
+    for (auto& t : workers) t.join();
+
+    // Every packet exactly once: the sequence numbers add up to 0 + 1 + ... + N-1
+    bool ok = (errors == 0) && (seq_sum == NUM_PACKETS * (NUM_PACKETS - 1) / 2);
+    std::cout << "Processed " << packets << " packets, " << errors << " errors" << std::endl;
+    std::cout << (ok ? "*** Multi-Consumer Test SUCCESS ***" : "*** Multi-Consumer Test FAILURE ***") << std::endl;
+}
+
+
+void run_cyclic_capture_test(double msps) {
+    std::cout << "\n--- Running Cyclic Capture Overrun Test (emulated, " << msps << " MS/s offered) ---" << std::endl;
+
+    const uint32_t NUM_BDS = 64;
+    AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController dma(emu);
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.mode_s2mm = AxiDmaController::DmaMode::CYCLIC;
+    layout.rx_num_bds = NUM_BDS;
+    layout.rx_buffer_size = PACKET_SIZE;
+    dma.initSG(layout);
+    dma.setWaitMode(AxiDmaController::DmaWaitMode::WAIT_HYBRID);
+    dma.setSpinBudget(0, 20);
+    dma.startSG(AxiDmaController::DmaDirection::RECEIVE);
+
+    // The engine never stops: every packet lands, overwriting unread ones.
+    // Each packet holds its sequence number in every word.
+    uint64_t next_packet = 0;
+    emu->setStreamSource([&next_packet](uint8_t* dst, uint32_t max_len) -> uint32_t {
+        uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+        uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+        for (uint32_t i = 0; i < n; ++i)
+            words[i] = next_packet;
+        next_packet++;
+        return n * WORD_SIZE;
+    }, msps * 1e6 * WORD_SIZE / PACKET_SIZE);
+
+    // The reader stalls for longer than the ring lasts now and then
+    const double DURATION = 2.0, STALL_S = 0.005, PERIOD_S = 0.05;
+    uint64_t intact = 0, missing = 0, torn = 0, expected = 0;
+    double t_start = now_sec(), next_stall = t_start + PERIOD_S;
+    while (now_sec() - t_start < DURATION) {
+        if (now_sec() >= next_stall) {
+            usleep((useconds_t)(STALL_S * 1e6));
+            next_stall = now_sec() + PERIOD_S;
+        }
+        AxiDmaController::DmaBlock block;
+        if (dma.cyclicReceive(&block) < 0)
+            break;
+        const uint64_t* rx = static_cast<const uint64_t*>(block.data);
+        uint32_t n = block.len / WORD_SIZE;
+        uint64_t seq = n ? rx[0] : expected;
+        bool same = true;
+        for (uint32_t i = 1; i < n; ++i)
+            same &= (rx[i] == seq);
+        // Only trust what was decoded if the block survived until release
+        if (dma.cyclicRelease() != 1)
+            continue;
+        intact++;
+        torn += !same;
+        if (seq > expected)
+            missing += seq - expected;
+        expected = seq + 1;
+    }
+
+    AxiDmaController::CyclicStats stats = dma.getCyclicStats();
+    std::cout << "Packets produced: " << next_packet << ", read intact: " << intact
+              << ", missing from the sequence: " << missing << std::endl;
+    std::cout << "Overruns: " << stats.overruns << ", blocks skipped (lower bound): " << stats.blocks_lost
+              << ", overwritten while held: " << stats.blocks_corrupted << std::endl;
+    // Loss is allowed, torn data passed off as intact is not
+    bool ok = (torn == 0) && (missing >= stats.blocks_lost);
+    std::cout << (ok ? "*** Cyclic Capture Test SUCCESS ***" : "*** Cyclic Capture Test FAILURE ***") << std::endl;
+}
+
+void run_error_recovery_test() {
+    std::cout << "\n--- Running DMA Error Recovery Test (emulated) ---" << std::endl;
+    typedef AxiDmaController::DmaDirection Dir;
+
+    // Receive: errors hit a full ring, recovery must keep the unread blocks
+    const uint32_t NUM_BDS = 32;
+    const uint64_t NUM_PACKETS = 20000, INJECT_EVERY = 1000;
+    AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController dma(emu);
+    AxiDmaController::SgLayout layout;
+    layout.mode_mm2s = AxiDmaController::DmaMode::UNINITIALIZED;
+    layout.rx_num_bds = NUM_BDS;
+    layout.rx_buffer_size = PACKET_SIZE;
+    dma.initSG(layout);
+    dma.setWaitMode(AxiDmaController::DmaWaitMode::WAIT_IRQ);
+    dma.startSG(Dir::RECEIVE);
+
+    // Each packet holds its sequence number in every word
+    uint64_t next_packet = 0;
+    emu->setStreamSource([&next_packet, NUM_PACKETS](uint8_t* dst, uint32_t max_len) -> uint32_t {
+        if (next_packet >= NUM_PACKETS)
+            return 0;
+        uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+        uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+        for (uint32_t i = 0; i < n; ++i)
+            words[i] = next_packet;
+        next_packet++;
+        return n * WORD_SIZE;
+    });
+
+    // Alternate data and descriptor errors
+    const uint32_t INJECTED[2] = {DMA_SR_DMA_SLV_ERR_MASK, DMA_SR_SG_DEC_ERR_MASK};
+    uint64_t received = 0, bad = 0, injected = 0, recoveries = 0;
+    uint32_t error_bits = 0;
+    double recover_s = 0, recover_max_s = 0;
+    AxiDmaController::DmaBlock blocks[NUM_BDS];
+    while (received < NUM_PACKETS) {
+        int n_blocks = dma.sgReceiveBatch(blocks, NUM_BDS);
+        if (n_blocks == AxiDmaController::DMA_ERROR) {
+            error_bits |= dma.getDmaErrors(Dir::RECEIVE);
+            double t0 = now_sec();
+            if (dma.recover() != 1)
+                break;
+            double t = now_sec() - t0;
+            recover_s += t;
+            recover_max_s = (t > recover_max_s) ? t : recover_max_s;
+            recoveries++;
+            continue;
+        }
+        if (n_blocks < 0)
+            break;
+        for (int b = 0; b < n_blocks; ++b) {
+            const uint64_t* rx = static_cast<const uint64_t*>(blocks[b].data);
+            uint32_t n = blocks[b].len / WORD_SIZE;
+            bool same = (n == PACKET_SIZE / WORD_SIZE);
+            for (uint32_t i = 0; same && i < n; ++i)
+                same = (rx[i] == received);
+            bad += !same;
+            received++;
+            if (received % INJECT_EVERY == 0 && received < NUM_PACKETS - INJECT_EVERY)
+                emu->injectError(Dir::RECEIVE, INJECTED[injected++ % 2]);
+        }
+        dma.releaseBlocks(Dir::RECEIVE, n_blocks);
+    }
+    std::cout << "Received " << received << "/" << NUM_PACKETS << " packets in order, " << bad << " bad, "
+              << recoveries << "/" << injected << " errors recovered (DMASR bits 0x" << std::hex << error_bits
+              << std::dec << "), recover() " << (recoveries ? recover_s / recoveries * 1e6 : 0) << " us avg, "
+              << recover_max_s * 1e6 << " us max" << std::endl;
+    bool ok = (received == NUM_PACKETS) && (bad == 0) && (recoveries == injected) &&
+              (error_bits == (DMA_SR_DMA_SLV_ERR_MASK | DMA_SR_SG_DEC_ERR_MASK));
+
+    // Transmit loopback: a packet cut by an error is sent again as a whole
+    const uint32_t TX_BD_SIZE = PACKET_SIZE / 4, TX_PACKETS = 500;
+    AxiDmaEmulator* loop_emu = new AxiDmaEmulator(MEM_SIZE);
+    AxiDmaController loop(loop_emu);
+    AxiDmaController::SgLayout loop_layout;
+    loop_layout.tx_num_bds = 16;
+    loop_layout.tx_buffer_size = TX_BD_SIZE;
+    loop_layout.rx_num_bds = 16;
+    loop_layout.rx_buffer_size = PACKET_SIZE;
+    loop.initSG(loop_layout);
+    loop.setWaitMode(AxiDmaController::DmaWaitMode::WAIT_IRQ);
+    loop.startSG(Dir::TRANSMIT);
+    loop.startSG(Dir::RECEIVE);
+    std::vector<uint64_t> packet(PACKET_SIZE / WORD_SIZE);
+    uint64_t tx_injected = 0, tx_recoveries = 0, tx_bad = 0;
+    for (uint32_t p = 0; p < TX_PACKETS && ok; ++p) {
+        for (size_t i = 0; i < packet.size(); ++i)
+            packet[i] = p;
+        if (loop.sgTransmit(packet.data(), PACKET_SIZE) <= 0) {
+            ok = false;
+            break;
+        }
+        // Lands before, inside or after the packet, depending on the engine
+        if (p % 10 == 5) {
+            loop_emu->injectError(Dir::TRANSMIT, DMA_SR_DMA_SLV_ERR_MASK);
+            tx_injected++;
+        }
+        while (loop.transmitInFlight() > 0) {
+            int ret = loop.waitForTransmitCompletionSG();
+            if (ret == AxiDmaController::DMA_ERROR) {
+                tx_recoveries += loop.recover();
+                continue;
+            }
+            if (ret < 0) {
+                ok = false;
+                break;
+            }
+        }
+        void* data;
+        uint32_t len;
+        int ret;
+        while ((ret = loop.sgReceive(&data, &len)) == 0)
+            ;
+        if (ret == AxiDmaController::DMA_ERROR) {
+            // The injection hit the fetch after this packet: it is already home
+            tx_recoveries += loop.recover();
+            while ((ret = loop.sgReceive(&data, &len)) == 0)
+                ;
+        }
+        if (ret != 1) {
+            ok = false;
+            break;
+        }
+        const uint64_t* rx = static_cast<const uint64_t*>(data);
+        bool same = (len == PACKET_SIZE);
+        for (uint32_t i = 0; same && i < len / WORD_SIZE; ++i)
+            same = (rx[i] == p);
+        tx_bad += !same;
+        loop.releaseBlock(Dir::RECEIVE);
+    }
+    std::cout << "Looped back " << TX_PACKETS << " packets, " << tx_bad << " bad, " << tx_recoveries
+              << " transmit errors recovered (" << tx_injected << " injected)" << std::endl;
+    ok = ok && (tx_bad == 0) && (tx_recoveries <= tx_injected) && (tx_recoveries > 0);
+    std::cout << (ok ? "*** Error Recovery Test SUCCESS ***" : "*** Error Recovery Test FAILURE ***") << std::endl;
+}
+
+int main(int argc, char** argv) {
+    double msps = (argc > 1) ? atof(argv[1]) : 30.0;
+    run_sg_loopback_test();
+    run_zero_copy_replay_test();
+    run_readout_load_test(msps);
+    run_multi_consumer_test(4);
+    run_cyclic_capture_test(msps);
+    run_error_recovery_test();
+    return 0;
+}
@@ -0,0 +1,156 @@
+// =================================================================================
+// FILE: example_event_loop.cpp
+//
+// DESCRIPTION:
+// Services several DMA engines and a periodic timer from a single thread with
+// epoll, using the non-blocking receive API instead of one blocking reader
+// thread per engine. Runs against the software AXI DMA emulator.
+//
+// Per engine the loop is:
+//   1. drain with dma_try_get_completed_blocks() until it returns 0
+//   2. dma_arm_irq(); if it returns 1, data raced in - go back to 1
+//   3. wait in epoll_wait(); on a readable fd call dma_consume_irq() and go to 1
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`, then `./example_event_loop`.
+//
+// =================================================================================
+#include "axi_dma_api.h"
+#include "axi_dma_controller.hpp"
+#include "axi_dma_emulator.hpp"
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+
+// --- Configuration ---
+const uint64_t MEM_SIZE = 0x2000000; // 32 MB per emulated engine
+const uint32_t PACKET_SIZE = 4096;
+const uint32_t WORD_SIZE = 8;
+const int NUM_ENGINES = 2;
+const uint32_t NUM_BDS = 64;
+const double PACKETS_PER_SEC = 20000;
+const int DURATION_TICKS = 20;       // Report ticks of 100 ms
+
+struct Engine {
+    AxiDmaHandle_t dma;
+    AxiDmaEmulator* emu;             // Owned by the controller
+    uint64_t next_word;              // Written by the emulator thread only
+    uint64_t expected;
+    uint64_t words;
+    uint64_t gaps;
+    uint64_t wakeups;
+};
+
+// Drains one engine completely and re-arms its interrupt
+static void service_engine(Engine& e) {
+    DmaBlock_t blocks[NUM_BDS];
+    for (;;) {
+        int n_blocks;
+        while ((n_blocks = dma_try_get_completed_blocks(e.dma, DMA_RECEIVE, blocks, NUM_BDS)) > 0) {
+            for (int b = 0; b < n_blocks; ++b) {
+                const uint64_t* rx = static_cast<const uint64_t*>(blocks[b].data);
+                uint32_t n = blocks[b].len / WORD_SIZE;
+                if (n && rx[0] != e.expected)
+                    e.gaps++;
+                e.expected = n ? rx[n - 1] + 1 : e.expected;
+                e.words += n;
+            }
+            dma_release_completed_blocks(e.dma, DMA_RECEIVE, n_blocks);
+        }
+        // Nothing left: arm, and only sleep if nothing completed in between
+        if (dma_arm_irq(e.dma, DMA_RECEIVE) != 1)
+            return;
+    }
+}
+
+int main() {
+    std::cout << "\n--- Running epoll Event Loop Test (" << NUM_ENGINES << " emulated engines) ---" << std::endl;
+
+    int ep = epoll_create1(0);
+    if (ep < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    Engine engines[NUM_ENGINES];
+    for (int i = 0; i < NUM_ENGINES; ++i) {
+        Engine& e = engines[i];
+        e.next_word = 0;
+        e.expected = e.words = e.gaps = e.wakeups = 0;
+
+        // Use the C++ constructor to attach a packet source, then drive it through the C API
+        AxiDmaEmulator* emu = new AxiDmaEmulator(MEM_SIZE);
+        e.emu = emu;
+        e.dma = new AxiDmaController(emu);
+        dma_init_rx_only(e.dma, DMA_MODE_SG, NUM_BDS, PACKET_SIZE);
+        dma_set_coalescing(e.dma, DMA_RECEIVE, 8, 20);
+        dma_start(e.dma, DMA_RECEIVE);
+        uint64_t* next_word = &e.next_word;
+        emu->setStreamSource([next_word](uint8_t* dst, uint32_t max_len) -> uint32_t {
+            uint32_t n = (max_len < PACKET_SIZE ? max_len : PACKET_SIZE) / WORD_SIZE;
+            uint64_t* words = reinterpret_cast<uint64_t*>(dst);
+            for (uint32_t w = 0; w < n; ++w)
+                words[w] = (*next_word)++;
+            return n * WORD_SIZE;
+        }, PACKETS_PER_SEC);
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        int fd = dma_get_fd(e.dma, DMA_RECEIVE);
+        if (fd < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            std::cerr << "Cannot register engine " << i << " with epoll" << std::endl;
+            return 1;
+        }
+        service_engine(e);
+    }
+
+    // A timer stands in for the other fds an application would watch (sockets, ...)
+    int tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    struct itimerspec its = {};
+    its.it_interval.tv_nsec = 100000000;
+    its.it_value.tv_nsec = 100000000;
+    timerfd_settime(tfd, 0, &its, NULL);
+    struct epoll_event tev = {};
+    tev.events = EPOLLIN;
+    tev.data.u32 = NUM_ENGINES;
+    epoll_ctl(ep, EPOLL_CTL_ADD, tfd, &tev);
+
+    int ticks = 0;
+    while (ticks < DURATION_TICKS) {
+        struct epoll_event events[NUM_ENGINES + 1];
+        int n = epoll_wait(ep, events, NUM_ENGINES + 1, -1);
+        for (int k = 0; k < n; ++k) {
+            uint32_t id = events[k].data.u32;
+            if (id == (uint32_t)NUM_ENGINES) {
+                uint64_t expirations;
+                if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations))
+                    ticks += (int)expirations;
+                continue;
+            }
+            Engine& e = engines[id];
+            dma_consume_irq(e.dma, DMA_RECEIVE);
+            e.wakeups++;
+            service_engine(e);
+        }
+    }
+
+    // Every gap must be explained by a packet the emulated FIFO dropped
+    bool ok = true;
+    for (int i = 0; i < NUM_ENGINES; ++i) {
+        Engine& e = engines[i];
+        uint64_t dropped = e.emu->packetsDropped();
+        std::cout << "Engine " << i << ": " << e.words << " words, " << e.wakeups << " wakeups, "
+                  << e.gaps << " gaps, " << dropped << " packets dropped" << std::endl;
+        ok = ok && e.words > 0 && e.gaps <= dropped;
+        dma_destroy(e.dma);
+    }
+    close(tfd);
+    close(ep);
+    std::cout << (ok ? "*** Event Loop Test SUCCESS ***" : "*** Event Loop Test FAILURE ***") << std::endl;
+    return 0;
+}
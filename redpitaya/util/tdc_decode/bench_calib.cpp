@@ -0,0 +1,219 @@
+// =================================================================================
+// FILE: bench_calib.cpp
+//
+// DESCRIPTION:
+// Calibrated decoding (tdc_calib.hpp), in two parts:
+//   1. Loads a random 64-channel table through a temporary file, checks every
+//      kernel against the scalar one and reports words per second, one DMA
+//      block at a time. Best of 5 runs.
+//   2. Hot swap: reader threads decode blocks while the main thread publishes
+//      new tables as fast as it can. Table g shifts every time by g ns, so a
+//      block decoded with a mix of tables, or one that went back to an older
+//      table, shows up as an error. Reports swaps per second and the time a
+//      publish waits for readers.
+//
+// USAGE:
+//   ./bench_calib [words] [readers] [swap seconds]     (default: 4194304 words, 2 readers, 2 s)
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "tdc_calib.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+const int RUNS = 5;
+const size_t BLOCK_WORDS = 512;
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+struct Columns {
+    std::vector<uint8_t> chid;
+    std::vector<float> position;
+    std::vector<int64_t> time;
+    explicit Columns(size_t n) : chid(n), position(n), time(n) {}
+    tdc_decode::CalibColumns view() { tdc_decode::CalibColumns c = {chid.data(), position.data(), time.data()}; return c; }
+};
+
+static double decode_all(tdc_decode::Calibration& calib, const std::vector<uint64_t>& words, Columns& out) {
+    tdc_decode::TsumUnwrapper unwrap;
+    tdc_decode::CalibColumns cols = out.view();
+    double t0 = now_sec();
+    for (size_t i = 0; i < words.size(); i += BLOCK_WORDS) {
+        size_t n = (words.size() - i < BLOCK_WORDS) ? words.size() - i : BLOCK_WORDS;
+        tdc_decode::CalibColumns block = {cols.chid + i, cols.position_mm + i, cols.time_ps + i};
+        calib.decode(words.data() + i, n, block, unwrap);
+    }
+    return now_sec() - t0 + 1e-7;
+}
+
+static bool same_position(float a, float b) {
+    if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) && std::isnan(b);
+    return std::fabs(a - b) <= 1e-5f * (1 + std::fabs(b));
+}
+
+static bool bench_kernels(size_t n) {
+    // Random table for all channels but the last one, through the file loader
+    std::mt19937_64 rng(12345);
+    std::uniform_real_distribution<double> uniform(-1, 1);
+    char path[] = "/tmp/bench_calib_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        std::cerr << "mkstemp failed" << std::endl;
+        return false;
+    }
+    close(fd);
+    {
+        std::ofstream file(path);
+        file << "# chid  t_diff_offset_ns  velocity_mm_per_ns  time_offset_ns\n";
+        for (unsigned c = 0; c + 1 < tdc_decode::CalibTable::CHANNELS; ++c)
+            file << c << "  " << 2 * uniform(rng) << "  " << 150 + 20 * uniform(rng) << "  " << 50 * uniform(rng) << "\n";
+    }
+    std::unique_ptr<tdc_decode::CalibTable> table = tdc_decode::CalibTable::load(path);
+    remove(path);
+
+    std::vector<uint64_t> words(n);
+    uint64_t t_sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        t_sum += rng() % 100000;
+        words[i] = (rng() & ~tdc_decode::T_SUM_MASK) | (t_sum & tdc_decode::T_SUM_MASK);
+    }
+
+    std::cout << "Calibrated decode of " << n << " words, " << BLOCK_WORDS << " words per block" << std::endl;
+    std::cout << std::left << std::setw(8) << "kernel" << std::right << std::setw(10) << "Mwords/s"
+              << std::setw(9) << "GB/s" << std::setw(10) << "speedup" << std::endl;
+
+    const tdc_decode::Kernel kernels[] = {tdc_decode::Kernel::SCALAR, tdc_decode::Kernel::SSE4,
+                                          tdc_decode::Kernel::AVX2, tdc_decode::Kernel::NEON};
+    Columns ref(n), out(n);
+    double scalar_rate = 0;
+    bool ok = true;
+    for (tdc_decode::Kernel kernel : kernels) {
+        if (!tdc_decode::kernelAvailable(kernel))
+            continue;
+        tdc_decode::Calibration calib(std::unique_ptr<tdc_decode::CalibTable>(new tdc_decode::CalibTable(*table)), kernel);
+        decode_all(calib, words, kernel == tdc_decode::Kernel::SCALAR ? ref : out);
+        if (kernel != tdc_decode::Kernel::SCALAR) {
+            size_t bad = 0;
+            for (size_t i = 0; i < n; ++i)
+                bad += (out.chid[i] != ref.chid[i] || out.time[i] != ref.time[i] ||
+                        !same_position(out.position[i], ref.position[i]));
+            if (bad) {
+                std::cerr << tdc_decode::kernelName(kernel) << ": " << bad << " words differ from scalar" << std::endl;
+                ok = false;
+                continue;
+            }
+        }
+        double best = 1e30;
+        for (int r = 0; r < RUNS; ++r) {
+            double t = decode_all(calib, words, out);
+            best = (t < best) ? t : best;
+        }
+        double rate = n / best;
+        if (kernel == tdc_decode::Kernel::SCALAR)
+            scalar_rate = rate;
+        std::cout << std::left << std::setw(8) << tdc_decode::kernelName(kernel) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(10) << rate / 1e6 << std::setw(9) << rate * 8 / 1e9
+                  << std::setw(9) << std::setprecision(2) << rate / scalar_rate << "x" << std::endl;
+    }
+    return ok;
+}
+
+// Table g: no position calibration needed, every channel offset by g ns
+static std::unique_ptr<tdc_decode::CalibTable> generation_table(uint64_t g) {
+    std::unique_ptr<tdc_decode::CalibTable> table(new tdc_decode::CalibTable());
+    for (unsigned c = 0; c < tdc_decode::CalibTable::CHANNELS; ++c)
+        table->set(c, tdc_decode::ChannelCalib{0, 150, (double)g});
+    return table;
+}
+
+static bool bench_swap(unsigned readers, double seconds) {
+    tdc_decode::Calibration calib(generation_table(1));
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> errors{0}, blocks{0};
+
+    // Every word has the same t_sum, so the time column only reflects the table
+    std::vector<uint64_t> words(BLOCK_WORDS);
+    std::mt19937_64 rng(7);
+    for (size_t i = 0; i < BLOCK_WORDS; ++i)
+        words[i] = (rng() & ~tdc_decode::T_SUM_MASK) | 1000000;
+    const int64_t sum_ps = 1000000 * tdc_decode::UNWRAPPED_PS;
+
+    std::vector<std::thread> threads;
+    for (unsigned r = 0; r < readers; ++r) {
+        threads.emplace_back([&]() {
+            Columns out(BLOCK_WORDS);
+            tdc_decode::TsumUnwrapper unwrap;
+            int64_t last = 0;
+            uint64_t done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                calib.decode(words.data(), BLOCK_WORDS, out.view(), unwrap);
+                int64_t g = (sum_ps - out.time[0]) / 1000;
+                bool mixed = false;
+                for (size_t i = 1; i < BLOCK_WORDS; ++i)
+                    mixed |= (out.time[i] != out.time[0]);
+                if (mixed || g < last || g < 1)
+                    errors.fetch_add(1, std::memory_order_relaxed);
+                last = g;
+                ++done;
+            }
+            blocks.fetch_add(done, std::memory_order_relaxed);
+        });
+    }
+
+    uint64_t swaps = 0;
+    double waited = 0, longest = 0;
+    double t0 = now_sec();
+    while (now_sec() - t0 < seconds) {
+        std::unique_ptr<tdc_decode::CalibTable> table = generation_table(calib.generation() + 1);
+        double p0 = now_sec();
+        calib.publish(std::move(table));
+        double p = now_sec() - p0;
+        waited += p;
+        longest = (p > longest) ? p : longest;
+        ++swaps;
+    }
+    double elapsed = now_sec() - t0;
+    stop.store(true);
+    for (std::thread& t : threads)
+        t.join();
+
+    std::cout << "Hot swap, " << readers << " readers: " << std::fixed << std::setprecision(0) << swaps / elapsed
+              << " swaps/s, publish waits " << std::setprecision(2) << waited / swaps * 1e6 << " us avg, "
+              << longest * 1e6 << " us max, readers " << std::setprecision(1)
+              << blocks.load() * BLOCK_WORDS / elapsed / 1e6 << " Mwords/s, " << errors.load() << " bad blocks"
+              << std::endl;
+    return errors.load() == 0;
+}
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? strtoull(argv[1], NULL, 0) : 4194304;
+    unsigned readers = (argc > 2) ? atoi(argv[2]) : 2;
+    double seconds = (argc > 3) ? atof(argv[3]) : 2;
+    if (n == 0)
+        n = BLOCK_WORDS;
+    if (readers < 1 || readers > tdc_decode::Calibration::MAX_READERS)
+        readers = 2;
+
+    bool ok = bench_kernels(n);
+    ok = bench_swap(readers, seconds) && ok;
+    std::cout << (ok ? "All checks passed" : "*** CHECK FAILED ***") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+// =================================================================================
+// FILE: bench_decode.cpp
+//
+// DESCRIPTION:
+// Decode throughput of every kernel in tdc_decode.hpp available on this CPU,
+// checked word for word against the scalar reference first. Two cases:
+//   block    one DMA block at a time into small reused columns (in cache),
+//            the way a readout consumer decodes
+//   stream   the whole buffer into full-size columns (memory bound)
+// Input words are random, so t_diff takes both signs. Best of 5 runs.
+//
+// USAGE:
+//   ./bench_decode [words] [block words]      (default: 4194304 words, 512 per block)
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "tdc_decode.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include <sys/time.h>
+
+
+const int RUNS = 5;
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+struct Columns {
+    std::vector<uint8_t> chid;
+    std::vector<int16_t> t_diff;
+    std::vector<uint64_t> t_sum;
+    explicit Columns(size_t n) : chid(n), t_diff(n), t_sum(n) {}
+    tdc_decode::CoincColumns view() { tdc_decode::CoincColumns c = {chid.data(), t_diff.data(), t_sum.data()}; return c; }
+};
+
+static bool verify(const std::vector<uint64_t>& words, tdc_decode::Kernel kernel) {
+    // Odd length so the scalar tail of the SIMD kernels is covered too
+    size_t n = words.size() - 3;
+    Columns out(n);
+    tdc_decode::decodeCoinc(words.data(), n, out.view(), kernel);
+    for (size_t i = 0; i < n; ++i) {
+        uint8_t chid;
+        int16_t t_diff;
+        uint64_t t_sum;
+        tdc_decode::decodeWord(words[i], &chid, &t_diff, &t_sum);
+        if (out.chid[i] != chid || out.t_diff[i] != t_diff || out.t_sum[i] != t_sum) {
+            std::cerr << tdc_decode::kernelName(kernel) << ": mismatch at word " << i << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static double bench_block(const std::vector<uint64_t>& words, size_t block_words, tdc_decode::Kernel kernel, uint64_t* check) {
+    Columns out(block_words);
+    double best = 1e30;
+    for (int r = 0; r < RUNS; ++r) {
+        double t0 = now_sec();
+        for (size_t i = 0; i + block_words <= words.size(); i += block_words) {
+            tdc_decode::decodeCoinc(words.data() + i, block_words, out.view(), kernel);
+            *check += out.t_sum[0] + out.chid[block_words - 1];
+        }
+        double t = now_sec() - t0 + 1e-7;
+        best = (t < best) ? t : best;
+    }
+    return best;
+}
+
+static double bench_stream(const std::vector<uint64_t>& words, tdc_decode::Kernel kernel, uint64_t* check) {
+    Columns out(words.size());
+    double best = 1e30;
+    for (int r = 0; r < RUNS; ++r) {
+        double t0 = now_sec();
+        tdc_decode::decodeCoinc(words.data(), words.size(), out.view(), kernel);
+        double t = now_sec() - t0 + 1e-7;
+        best = (t < best) ? t : best;
+        *check += out.t_sum[words.size() / 2] + (uint64_t)out.t_diff[words.size() - 1];
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? strtoull(argv[1], NULL, 0) : 4194304;
+    size_t block_words = (argc > 2) ? strtoull(argv[2], NULL, 0) : 512;
+    if (block_words == 0 || n < block_words)
+        n = block_words = 512;
+    n -= n % block_words;
+
+    std::vector<uint64_t> words(n);
+    std::mt19937_64 rng(12345);
+    for (size_t i = 0; i < n; ++i)
+        words[i] = rng();
+
+    std::cout << "Decoding " << n << " words (" << n * 8 / (1024 * 1024) << " MiB), "
+              << block_words << " words per block, best kernel: "
+              << tdc_decode::kernelName(tdc_decode::bestKernel()) << std::endl;
+    std::cout << std::left << std::setw(8) << "kernel" << std::right << std::setw(16) << "block Mwords/s"
+              << std::setw(9) << "GB/s" << std::setw(17) << "stream Mwords/s" << std::setw(9) << "GB/s"
+              << std::setw(10) << "speedup" << std::endl;
+
+    const tdc_decode::Kernel kernels[] = {tdc_decode::Kernel::SCALAR, tdc_decode::Kernel::SSE4,
+                                          tdc_decode::Kernel::AVX2, tdc_decode::Kernel::NEON};
+    uint64_t check = 0;
+    double scalar_rate = 0;
+    bool ok = true;
+    for (tdc_decode::Kernel kernel : kernels) {
+        if (!tdc_decode::kernelAvailable(kernel))
+            continue;
+        if (!verify(words, kernel)) {
+            ok = false;
+            continue;
+        }
+        double block_rate = n / bench_block(words, block_words, kernel, &check);
+        double stream_rate = n / bench_stream(words, kernel, &check);
+        if (kernel == tdc_decode::Kernel::SCALAR)
+            scalar_rate = block_rate;
+        std::cout << std::left << std::setw(8) << tdc_decode::kernelName(kernel) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(16) << block_rate / 1e6 << std::setw(9)
+                  << block_rate * 8 / 1e9 << std::setw(17) << stream_rate / 1e6 << std::setw(9)
+                  << stream_rate * 8 / 1e9 << std::setw(9) << std::setprecision(2) << block_rate / scalar_rate
+                  << "x" << std::endl;
+    }
+    // Keeps the decoded columns alive for the optimiser
+    if (check == 42)
+        std::cout << std::endl;
+    std::cout << (ok ? "All kernels match the scalar reference" : "*** KERNEL MISMATCH ***") << std::endl;
+    return ok ? 0 : 1;
+}
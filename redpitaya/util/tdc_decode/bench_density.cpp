@@ -0,0 +1,190 @@
+// =================================================================================
+// FILE: bench_density.cpp
+//
+// DESCRIPTION:
+// Code-density calibration (tdc_density.hpp) on synthetic single trigger
+// words from two channels. Each channel has its own random bin widths (DNL
+// up to +-0.3 LSB, as quoted for tdc_core.vhd) and the hits are uniform
+// within the coarse period.
+//   1. Recording cost per word, all words and every 16th, as a share of
+//      one core at the 70 MS/s peak rate. Blocks come from a 64 KiB window
+//      that stays in cache, as a block does right after readout. Best of 5.
+//   2. Two threads record every word of their half, merging every 2^20
+//      words, while the main thread takes snapshots. The DNL/INL from the
+//      merged counts are compared with the true ones.
+//   3. decodeSingle with that correction against the true hit times: rms
+//      error with the ideal bin centres and with the measured ones.
+//
+// USAGE:
+//   ./bench_density [words]      (default: 16777216)
+//
+// HOW TO COMPILE:
+// See the provided Makefile. Run `make`.
+//
+// =================================================================================
+#include "tdc_density.hpp"
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <sys/time.h>
+
+
+const int RUNS = 5;
+const size_t BLOCK_WORDS = 512;
+const size_t CACHED_WORDS = 8192;
+const double PEAK_RATE = 70e6;
+const unsigned CHANNELS[] = {0, 1};
+const double MAX_DNL = 0.3;
+
+static double now_sec() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+struct Sampler {
+    double edge[tdc_decode::FINE_CODES + 1];    // LSB
+};
+
+static Sampler random_sampler(std::mt19937_64& rng) {
+    std::uniform_real_distribution<double> dnl(-MAX_DNL, MAX_DNL);
+    double width[tdc_decode::FINE_CODES], total = 0;
+    for (unsigned k = 0; k < tdc_decode::FINE_CODES; ++k)
+        total += width[k] = 1 + dnl(rng);
+    Sampler s;
+    s.edge[0] = 0;
+    for (unsigned k = 0; k < tdc_decode::FINE_CODES; ++k)
+        s.edge[k + 1] = s.edge[k] + width[k] * tdc_decode::FINE_CODES / total;
+    return s;
+}
+
+static void record_all(tdc_decode::CodeDensity::Recorder& rec, const uint64_t* words, size_t n) {
+    for (size_t i = 0; i < n; i += BLOCK_WORDS)
+        rec.record(words + i, (n - i < BLOCK_WORDS) ? n - i : BLOCK_WORDS);
+}
+
+int main(int argc, char** argv) {
+    size_t n = (argc > 1) ? strtoull(argv[1], NULL, 0) : 16777216;
+    if (n < CACHED_WORDS)
+        n = CACHED_WORDS;
+    n -= n % BLOCK_WORDS;
+
+    // Words and true hit times within the coarse period (LSB)
+    std::mt19937_64 rng(12345);
+    Sampler sampler[2] = {random_sampler(rng), random_sampler(rng)};
+    std::uniform_real_distribution<double> phase(0, tdc_decode::FINE_CODES);
+    std::vector<uint64_t> words(n);
+    std::vector<double> truth(n);
+    uint64_t coarse = 0;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned s = rng() & 1;
+        double u = phase(rng);
+        unsigned code = 0;
+        while (code + 1 < tdc_decode::FINE_CODES && u >= sampler[s].edge[code + 1])
+            ++code;
+        coarse += 1 + rng() % 8;
+        truth[i] = u;
+        words[i] = tdc_decode::SingleCodec::Chid::put(CHANNELS[s]) | tdc_decode::SingleCodec::Coarse::put(coarse) |
+                   tdc_decode::SingleCodec::Fine::put(code);
+    }
+
+    // 1. Cost
+    std::cout << "Recording " << n << " single trigger words, " << BLOCK_WORDS << " words per block" << std::endl;
+    std::cout << std::left << std::setw(10) << "sampling" << std::right << std::setw(10) << "ns/word"
+              << std::setw(10) << "Mwords/s" << std::setw(20) << "core at 70 MS/s" << std::endl;
+    const unsigned shifts[] = {0, 4};
+    for (unsigned shift : shifts) {
+        tdc_decode::CodeDensity density;
+        double best = 1e30;
+        for (int r = 0; r < RUNS; ++r) {
+            tdc_decode::CodeDensity::Recorder rec(density, shift);
+            double t0 = now_sec();
+            for (size_t i = 0; i < n; i += BLOCK_WORDS)
+                rec.record(words.data() + i % CACHED_WORDS, BLOCK_WORDS);
+            rec.flush();
+            double t = now_sec() - t0 + 1e-7;
+            best = (t < best) ? t : best;
+        }
+        std::cout << std::left << std::setw(10) << ("1/" + std::to_string(1u << shift)) << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(10) << best / n * 1e9 << std::setw(10)
+                  << std::setprecision(1) << n / best / 1e6 << std::setw(19) << std::setprecision(2)
+                  << PEAK_RATE * best / n * 100 << "%" << std::endl;
+    }
+
+    // 2. Accuracy with concurrent recorders
+    tdc_decode::CodeDensity density;
+    std::atomic<int> running{2};
+    std::thread threads[2];
+    for (int t = 0; t < 2; ++t) {
+        threads[t] = std::thread([&, t]() {
+            // Every word, so the merged total can be checked against n
+            tdc_decode::CodeDensity::Recorder rec(density, 0);
+            size_t begin = t * (n / 2), end = t ? n : n / 2;
+            record_all(rec, words.data() + begin, end - begin);
+            rec.flush();
+            running.fetch_sub(1);
+        });
+    }
+    int snapshots = 0;
+    while (running.load() > 0) {
+        density.snapshot();
+        ++snapshots;
+        std::this_thread::yield();
+    }
+    for (std::thread& t : threads)
+        t.join();
+
+    // Short runs: calibrate anyway, allow for the statistical error
+    uint64_t min_entries = tdc_decode::CodeDensity::DEFAULT_MIN_ENTRIES;
+    if (n / 4 < min_entries)
+        min_entries = n / 4;
+    std::unique_ptr<tdc_decode::FineCorrection> correction = density.correction(min_entries);
+    const double tolerance = 0.02 + 5 * std::sqrt(2.0 * tdc_decode::FINE_CODES / n);
+    bool ok = true;
+    std::cout << std::endl << "Merged after " << snapshots << " snapshots during recording" << std::endl;
+    std::cout << std::left << std::setw(6) << "chid" << std::right << std::setw(12) << "entries" << std::setw(10)
+              << "max DNL" << std::setw(10) << "max INL" << std::setw(16) << "DNL error" << std::setw(12)
+              << "INL error" << std::endl;
+    for (unsigned s = 0; s < 2; ++s) {
+        unsigned ch = CHANNELS[s];
+        double dnl_error = 0, inl_error = 0;
+        for (unsigned k = 0; k < tdc_decode::FINE_CODES; ++k) {
+            double width = sampler[s].edge[k + 1] - sampler[s].edge[k];
+            double centre = (sampler[s].edge[k + 1] + sampler[s].edge[k]) / 2;
+            dnl_error = std::fmax(dnl_error, std::fabs(correction->dnl[ch * tdc_decode::FINE_CODES + k] - (width - 1)));
+            inl_error = std::fmax(inl_error, std::fabs(correction->inl[ch * tdc_decode::FINE_CODES + k] - (centre - k - 0.5)));
+        }
+        ok = ok && correction->calibrated[ch] && dnl_error < tolerance && inl_error < tolerance;
+        std::cout << std::left << std::setw(6) << ch << std::right << std::setw(12) << correction->entries[ch]
+                  << std::setprecision(3) << std::setw(10) << correction->maxDnl(ch) << std::setw(10)
+                  << correction->maxInl(ch) << std::setw(16) << dnl_error << std::setw(12) << inl_error << std::endl;
+    }
+    ok = ok && density.snapshot().entries(CHANNELS[0]) + density.snapshot().entries(CHANNELS[1]) == n;
+
+    // 3. Effect on the decoded times
+    std::unique_ptr<tdc_decode::FineCorrection> ideal = tdc_decode::CodeDensity::correction(tdc_decode::DensityHistogram());
+    std::vector<uint8_t> chid(n);
+    std::vector<int64_t> time_ps(n);
+    double rms[2];
+    for (int c = 0; c < 2; ++c) {
+        tdc_decode::decodeSingle(words.data(), n, c ? *correction : *ideal, chid.data(), time_ps.data());
+        double sum2 = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double expected = ((double)tdc_decode::SingleCodec::Coarse::get(words[i]) * tdc_decode::FINE_CODES + truth[i]) *
+                              tdc_decode::FINE_BIN_PS;
+            sum2 += (time_ps[i] - expected) * (time_ps[i] - expected);
+        }
+        rms[c] = std::sqrt(sum2 / n);
+    }
+    std::cout << std::endl << "Time error rms: " << std::setprecision(1) << rms[0] << " ps with ideal bins, "
+              << rms[1] << " ps with measured bin centres" << std::endl;
+    ok = ok && rms[1] < rms[0];
+
+    std::cout << (ok ? "All checks passed" : "*** CHECK FAILED ***") << std::endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,328 @@
+#!/usr/bin/env python3
+# =================================================================================
+# FILE: gen_tdc_layout.py
+#
+# DESCRIPTION:
+# Generates tdc_layout.hpp, the constexpr word layout used by the decoders,
+# from the firmware sources:
+#   src/tdc_2ch.vhd                 top level generics and generic map
+#   src/Trigger/fast_data_builder.vhd  coincidence word: CHID & t_diff & t_sum
+#   src/Trigger/trigger_single.vhd     single word: CHID & coarse & fine
+#
+# The widths of t_diff and t_sum are read from their signal declarations in
+# fast_data_builder.vhd, the rest from the generics (defaults, overridden by
+# the generic map of tdc_2ch.vhd where the entity is instantiated there).
+# The field order of dout is checked against the concatenations in the VHDL.
+# Anything the parser does not recognise is an error, never a guess.
+#
+# USAGE:
+#   ./gen_tdc_layout.py             - Rewrites tdc_layout.hpp
+#   ./gen_tdc_layout.py --check     - Exits 1 if tdc_layout.hpp is out of date
+#   ./gen_tdc_layout.py --src DIR   - Firmware sources in DIR instead of ../../../src
+#
+# =================================================================================
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_SRC = os.path.normpath(os.path.join(HERE, "..", "..", "..", "src"))
+DEFAULT_OUT = os.path.join(HERE, "tdc_layout.hpp")
+
+TOP = "tdc_2ch.vhd"
+COINC = os.path.join("Trigger", "fast_data_builder.vhd")
+SINGLE = os.path.join("Trigger", "trigger_single.vhd")
+
+LAYOUT_GENERICS = ("chid_bits", "fine_bits", "coarse_bits")
+
+
+class LayoutError(Exception):
+    pass
+
+
+def read_vhdl(path):
+    with open(path) as f:
+        text = f.read()
+    # Comments out, case folded: VHDL is case insensitive
+    return re.sub(r"--[^\n]*", "", text).lower()
+
+
+def evaluate(expr, names, where):
+    """Integer value of a constant VHDL expression such as 'FINE_BITS + COARSE_BITS - 1'."""
+    def substitute(m):
+        if m.group(0) not in names:
+            raise LayoutError("%s: unknown name '%s' in '%s'" % (where, m.group(0), expr.strip()))
+        return str(names[m.group(0)])
+    py = re.sub(r"[a-z_]\w*", substitute, expr).strip()
+    if not re.fullmatch(r"[\d\s+\-*/()]+", py):
+        raise LayoutError("%s: cannot evaluate '%s'" % (where, expr.strip()))
+    return int(eval(py.replace("/", "//")))
+
+
+def entity_generics(text, entity, where):
+    m = re.search(r"entity\s+%s\s+is\s+generic\s*\((.*?)\)\s*;\s*port" % entity, text, re.S)
+    if not m:
+        raise LayoutError("%s: no generic clause for entity %s" % (where, entity))
+    generics = {}
+    for name, value in re.findall(r"(\w+)\s*:\s*(?:natural|integer|positive)\s*:=\s*([^;]+?)\s*(?:;|$)", m.group(1)):
+        generics[name] = evaluate(value, generics, where)
+    return generics
+
+
+def generic_map(text, entity, names, where):
+    """Generic map of 'entity work.<entity>' in text, evaluated with names, or None if not instantiated."""
+    m = re.search(r"entity\s+work\.%s\s+generic\s+map\s*\((.*?)\)\s*port\s+map" % entity, text, re.S)
+    if not m:
+        return None
+    return dict((name, evaluate(value, names, where))
+                for name, value in re.findall(r"(\w+)\s*=>\s*([^,]+)", m.group(1)))
+
+
+def vector_width(text, kind, signal, names, where):
+    """Width of 'signal : kind(N - 1 downto 0)' or a port of the same form."""
+    m = re.search(r"\b%s\s*:\s*(?:out\s+|in\s+)?%s\s*\((.+?)\s+downto\s+0\s*\)" % (signal, kind), text)
+    if not m:
+        raise LayoutError("%s: no declaration '%s : %s(... downto 0)'" % (where, signal, kind))
+    return evaluate(m.group(1), names, where) + 1
+
+
+def concat_terms(text, target, where):
+    """Terms of every '<target> <= a & b & ...' with more than one term."""
+    found = []
+    for rhs in re.findall(r"\b%s\s*<=\s*([^;]+);" % target, text):
+        terms = [t.strip() for t in rhs.split("&")]
+        if len(terms) > 1:
+            found.append(terms)
+    if not found:
+        raise LayoutError("%s: no concatenation assigned to %s" % (where, target))
+    return found
+
+
+def expect(cond, where, message):
+    if not cond:
+        raise LayoutError("%s: %s" % (where, message))
+
+
+def effective_generics(text, entity, top_text, top_generics, where):
+    generics = entity_generics(text, entity, where)
+    overrides = generic_map(top_text, entity, top_generics, TOP)
+    if overrides:
+        generics.update(overrides)
+    for name in LAYOUT_GENERICS:
+        expect(name in generics, where, "generic %s missing" % name)
+    return generics, overrides is not None
+
+
+def parse_coinc(src, top_text, top_generics):
+    where = COINC
+    text = read_vhdl(os.path.join(src, COINC))
+    g, mapped = effective_generics(text, "fast_data_builder", top_text, top_generics, where)
+    word = vector_width(text, "std_logic_vector", "dout", g, where)
+    t_diff = vector_width(text, "signed", "t_diff", g, where)
+    t_sum = vector_width(text, "unsigned", "t_sum", g, where)
+
+    for terms in concat_terms(text, "dout", where):
+        expect(len(terms) == 3 and "chid_bits" in terms[0] and "t_diff" in terms[1] and "t_sum" in terms[2],
+               where, "dout is not CHID & t_diff & t_sum: %s" % " & ".join(terms))
+    # t_diff <= sign & diff(N downto 0), t_sum <= sum(M - 1 downto 0)
+    m = re.search(r"\bt_diff\s*<=\s*diff\s*\(\s*diff'left\s*\)\s*&\s*diff\s*\((.+?)\s+downto\s+0\s*\)", text)
+    expect(m and evaluate(m.group(1), g, where) + 2 == t_diff, where, "t_diff is not sign & %d LSBs" % (t_diff - 1))
+    m = re.search(r"\bt_sum\s*<=\s*sum\s*\((.+?)\s+downto\s+0\s*\)", text)
+    expect(m and evaluate(m.group(1), g, where) + 1 == t_sum, where, "t_sum is not the %d LSBs of sum" % t_sum)
+
+    expect(g["chid_bits"] + t_diff + t_sum == word, where,
+           "CHID %d + t_diff %d + t_sum %d != %d bits" % (g["chid_bits"], t_diff, t_sum, word))
+    return dict(word=word, chid=g["chid_bits"], fine=g["fine_bits"], coarse=g["coarse_bits"],
+                t_diff=t_diff, t_sum=t_sum, mapped=mapped)
+
+
+def parse_single(src, top_text, top_generics):
+    where = SINGLE
+    text = read_vhdl(os.path.join(src, SINGLE))
+    g, mapped = effective_generics(text, "single_trigger", top_text, top_generics, where)
+    word = vector_width(text, "std_logic_vector", "dout", g, where)
+    # Time stamps are coarse_counter & fine, output is CHID & time stamp
+    for terms in concat_terms(text, r"pending_time\s*\([^;<]*?\)", where):
+        expect(len(terms) == 2 and "coarse_counter" in terms[0] and "fine" in terms[1],
+               where, "time stamp is not coarse & fine: %s" % " & ".join(terms))
+    for terms in concat_terms(text, "dout_reg", where):
+        expect(len(terms) == 2 and "chid_bits" in terms[0] and "pending_time" in terms[1],
+               where, "dout is not CHID & time stamp: %s" % " & ".join(terms))
+    expect(g["chid_bits"] + g["coarse_bits"] + g["fine_bits"] == word, where,
+           "CHID %d + coarse %d + fine %d != %d bits" % (g["chid_bits"], g["coarse_bits"], g["fine_bits"], word))
+    return dict(word=word, chid=g["chid_bits"], fine=g["fine_bits"], coarse=g["coarse_bits"], mapped=mapped)
+
+
+def render(coinc, single):
+    def origin(layout, entity):
+        return "generic map in %s" % TOP if layout["mapped"] else "defaults of %s" % entity
+    return HEADER_TEMPLATE % dict(
+        coinc_origin=origin(coinc, "fast_data_builder"), single_origin=origin(single, "single_trigger"),
+        word=coinc["word"], c_chid=coinc["chid"], c_fine=coinc["fine"], c_coarse=coinc["coarse"],
+        t_diff=coinc["t_diff"], t_sum=coinc["t_sum"],
+        s_word=single["word"], s_chid=single["chid"], s_fine=single["fine"], s_coarse=single["coarse"])
+
+
+HEADER_TEMPLATE = """\
+// =================================================================================
+// FILE: tdc_layout.hpp
+//
+// GENERATED by gen_tdc_layout.py from the firmware sources. Do not edit: change
+// the VHDL and run `make layout` (or ./gen_tdc_layout.py).
+//
+// DESCRIPTION:
+// Bit layout of the 64-bit words written by the trigger modes, as compile time
+// constants:
+//
+//   coincidence (fast_data_builder.vhd, %(coinc_origin)s)
+//     | CHID | t_diff (signed) | t_sum |      t_diff = t1 - t2, t_sum = t1 + t2
+//
+//   single (trigger_single.vhd, %(single_origin)s)
+//     | CHID | coarse | fine |
+//
+// Times are in fine bins, 2^FINE_BITS per coarse clock period.
+//
+// Field<Shift, Bits> extracts and inserts one field; CoincCodec and
+// SingleCodec name the fields of each mode and decode whole words. Code that
+// depends on a width should say so with a static_assert against these
+// constants (or Codec::matches), so a firmware change breaks the build instead
+// of the data.
+//
+// Usage:
+//   tdc_layout::CoincCodec::Event e = tdc_layout::CoincCodec::decode(word);
+//   uint64_t fine = tdc_layout::SingleCodec::Fine::get(word);
+//   static_assert(tdc_layout::CoincCodec::matches<6, 10, 48>(), "decoder written for 6/10/48");
+//
+// =================================================================================
+#ifndef TDC_LAYOUT_HPP
+#define TDC_LAYOUT_HPP
+
+#include <cstdint>
+
+namespace tdc_layout {
+
+// Bits [Shift + Bits - 1 : Shift] of a 64-bit word
+template <unsigned Shift, unsigned Bits>
+struct Field {
+    static_assert(Bits > 0 && Shift + Bits <= 64, "field outside the 64-bit word");
+    static constexpr unsigned shift = Shift;
+    static constexpr unsigned bits = Bits;
+    static constexpr uint64_t mask = (Bits == 64) ? ~0ULL : (1ULL << (Bits %% 64)) - 1;
+
+    static constexpr uint64_t get(uint64_t word) { return (word >> Shift) & mask; }
+    // Two's complement field, sign extended
+    static constexpr int64_t getSigned(uint64_t word) { return (int64_t)(word << (64 - Shift - Bits)) >> (64 - Bits); }
+    static constexpr uint64_t put(uint64_t value) { return (value & mask) << Shift; }
+};
+
+// Hi sits directly above Lo
+template <class Hi, class Lo>
+struct Adjacent {
+    static constexpr bool value = Hi::shift == Lo::shift + Lo::bits;
+};
+
+constexpr unsigned WORD_BITS = %(word)d;
+
+// Coincidence mode
+struct CoincCodec {
+    static constexpr unsigned CHID_BITS = %(c_chid)d;
+    static constexpr unsigned FINE_BITS = %(c_fine)d;
+    static constexpr unsigned COARSE_BITS = %(c_coarse)d;
+    static constexpr unsigned T_DIFF_BITS = %(t_diff)d;
+    static constexpr unsigned T_SUM_BITS = %(t_sum)d;
+
+    typedef Field<WORD_BITS - CHID_BITS, CHID_BITS> Chid;
+    typedef Field<T_SUM_BITS, T_DIFF_BITS> TDiff;
+    typedef Field<0, T_SUM_BITS> TSum;
+
+    struct Event {
+        uint8_t chid;
+        int16_t t_diff;
+        uint64_t t_sum;
+    };
+
+    static constexpr Event decode(uint64_t word)
+    {
+        return Event{(uint8_t)Chid::get(word), (int16_t)TDiff::getSigned(word), TSum::get(word)};
+    }
+    static constexpr uint64_t encode(unsigned chid, int t_diff, uint64_t t_sum)
+    {
+        return Chid::put(chid) | TDiff::put((uint64_t)(int64_t)t_diff) | TSum::put(t_sum);
+    }
+    template <unsigned Chid_, unsigned TDiff_, unsigned TSum_>
+    static constexpr bool matches() { return CHID_BITS == Chid_ && T_DIFF_BITS == TDiff_ && T_SUM_BITS == TSum_; }
+};
+
+static_assert(Adjacent<CoincCodec::Chid, CoincCodec::TDiff>::value && Adjacent<CoincCodec::TDiff, CoincCodec::TSum>::value,
+              "coincidence fields do not tile the word");
+static_assert(CoincCodec::CHID_BITS <= 8 && CoincCodec::T_DIFF_BITS <= 16,
+              "CHID or t_diff no longer fit the uint8_t / int16_t of CoincCodec::Event");
+
+// Single trigger mode
+struct SingleCodec {
+    static constexpr unsigned CHID_BITS = %(s_chid)d;
+    static constexpr unsigned FINE_BITS = %(s_fine)d;
+    static constexpr unsigned COARSE_BITS = %(s_coarse)d;
+
+    typedef Field<WORD_BITS - CHID_BITS, CHID_BITS> Chid;
+    typedef Field<FINE_BITS, COARSE_BITS> Coarse;
+    typedef Field<0, FINE_BITS> Fine;
+    // Coarse and fine together, in fine bins
+    typedef Field<0, COARSE_BITS + FINE_BITS> Time;
+
+    struct Event {
+        uint8_t chid;
+        uint64_t time;
+    };
+
+    static constexpr Event decode(uint64_t word) { return Event{(uint8_t)Chid::get(word), Time::get(word)}; }
+    static constexpr uint64_t encode(unsigned chid, uint64_t time) { return Chid::put(chid) | Time::put(time); }
+    template <unsigned Chid_, unsigned Coarse_, unsigned Fine_>
+    static constexpr bool matches() { return CHID_BITS == Chid_ && COARSE_BITS == Coarse_ && FINE_BITS == Fine_; }
+};
+
+static_assert(%(s_word)d == WORD_BITS, "single and coincidence words differ in size");
+static_assert(Adjacent<SingleCodec::Chid, SingleCodec::Coarse>::value && Adjacent<SingleCodec::Coarse, SingleCodec::Fine>::value,
+              "single trigger fields do not tile the word");
+static_assert(SingleCodec::CHID_BITS <= 8, "CHID no longer fits the uint8_t of SingleCodec::Event");
+
+} // namespace tdc_layout
+
+#endif // TDC_LAYOUT_HPP
+"""
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Generate tdc_layout.hpp from the firmware VHDL")
+    parser.add_argument("--src", default=DEFAULT_SRC, help="firmware source directory (default: %(default)s)")
+    parser.add_argument("-o", "--output", default=DEFAULT_OUT, help="header to write (default: %(default)s)")
+    parser.add_argument("--check", action="store_true", help="only check that the header is up to date")
+    args = parser.parse_args()
+
+    try:
+        top_text = read_vhdl(os.path.join(args.src, TOP))
+        top_generics = entity_generics(top_text, "tdc_2ch", TOP)
+        header = render(parse_coinc(args.src, top_text, top_generics), parse_single(args.src, top_text, top_generics))
+    except (LayoutError, IOError) as e:
+        sys.stderr.write("gen_tdc_layout: %s\n" % e)
+        return 2
+
+    current = None
+    if os.path.exists(args.output):
+        with open(args.output) as f:
+            current = f.read()
+    if args.check:
+        if current != header:
+            sys.stderr.write("gen_tdc_layout: %s is out of date, run make layout\n" % args.output)
+            return 1
+        return 0
+    if current != header:
+        with open(args.output, "w") as f:
+            f.write(header)
+        print("Wrote %s" % args.output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
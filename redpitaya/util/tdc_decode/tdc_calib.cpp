@@ -0,0 +1,345 @@
+// =================================================================================
+// FILE: tdc_calib.cpp
+//
+// DESCRIPTION:
+// Calibration tables, their RCU-style swap, and the calibrated decode kernels
+// of tdc_calib.hpp. Each kernel decodes CHID and t_diff from the high 32 bits
+// of the words as in tdc_decode.cpp, looks the channel constants up, and
+// unwraps t_sum as in tdc_unwrap.cpp. The unwrapped sum is scaled to ps
+// with 32x32->64 multiplies of its two halves, as there is no 64-bit
+// multiply below AVX-512.
+//
+// =================================================================================
+#include "tdc_calib.hpp"
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TDC_CALIB_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TDC_CALIB_NEON 1
+#endif
+
+namespace tdc_decode {
+
+static_assert(UNWRAPPED_PS > 0 && UNWRAPPED_PS <= 0xFFFFFFFF, "kernels scale with 32-bit multiplies");
+
+CalibTable::CalibTable()
+{
+    for (unsigned c = 0; c < CHANNELS; ++c)
+    {
+        pos_scale[c] = 0;
+        pos_bias[c] = std::numeric_limits<float>::quiet_NaN();
+        time_offset_ps[c] = 0;
+    }
+}
+
+void CalibTable::set(unsigned chid, const ChannelCalib& calib)
+{
+    if (chid >= CHANNELS)
+        throw std::invalid_argument("CHID out of range: " + std::to_string(chid));
+    // t_diff counts fine bins, two unwrapped units
+    const double half_velocity = calib.velocity_mm_per_ns / 2;
+    pos_scale[chid] = (float)(2 * UNWRAPPED_NS * half_velocity);
+    pos_bias[chid] = (float)(-calib.t_diff_offset_ns * half_velocity);
+    time_offset_ps[chid] = std::llround(calib.time_offset_ns * 1000);
+}
+
+std::unique_ptr<CalibTable> CalibTable::load(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+        throw std::runtime_error("Cannot open calibration file " + path);
+
+    std::unique_ptr<CalibTable> table(new CalibTable());
+    bool seen[CHANNELS] = {};
+    std::string line;
+    for (int line_no = 1; std::getline(file, line); ++line_no)
+    {
+        std::string where = path + ":" + std::to_string(line_no) + ": ";
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        unsigned chid;
+        ChannelCalib calib;
+        if (!(in >> chid))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            throw std::runtime_error(where + "expected a CHID");
+        }
+        std::string extra;
+        if (!(in >> calib.t_diff_offset_ns >> calib.velocity_mm_per_ns >> calib.time_offset_ns) || (in >> extra))
+            throw std::runtime_error(where + "expected chid t_diff_offset_ns velocity_mm_per_ns time_offset_ns");
+        if (chid >= CHANNELS)
+            throw std::runtime_error(where + "CHID " + std::to_string(chid) + " out of range");
+        if (seen[chid])
+            throw std::runtime_error(where + "CHID " + std::to_string(chid) + " listed twice");
+        if (!(calib.velocity_mm_per_ns > 0))
+            throw std::runtime_error(where + "velocity must be positive");
+        seen[chid] = true;
+        table->set(chid, calib);
+    }
+    return table;
+}
+
+static void calibScalar(const uint64_t* words, size_t n, const CalibTable& t, int64_t ref, const CalibColumns& out)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t w = words[i];
+        unsigned c = (unsigned)Codec::Chid::get(w);
+        out.chid[i] = (uint8_t)c;
+        out.position_mm[i] = (float)Codec::TDiff::getSigned(w) * t.pos_scale[c] + t.pos_bias[c];
+        uint64_t sum = (uint64_t)TsumUnwrapper::unwrapValue(w, ref);
+        out.time_ps[i] = (int64_t)(sum * UNWRAPPED_PS) - t.time_offset_ps[c];
+    }
+}
+
+static void calibTail(const uint64_t* words, size_t done, size_t n, const CalibTable& t, int64_t ref,
+                      const CalibColumns& out)
+{
+    CalibColumns rest = {out.chid + done, out.position_mm + done, out.time_ps + done};
+    calibScalar(words + done, n - done, t, ref, rest);
+}
+
+#ifdef TDC_CALIB_X86
+
+__attribute__((target("sse4.1")))
+static inline __m128i scaleSse4(__m128i sum, __m128i k)
+{
+    __m128i hi = _mm_mul_epu32(_mm_srli_epi64(sum, 32), k);
+    return _mm_add_epi64(_mm_mul_epu32(sum, k), _mm_slli_epi64(hi, 32));
+}
+
+// 4 words per iteration, lookups lane by lane
+__attribute__((target("sse4.1")))
+static void calibSse4(const uint64_t* words, size_t n, const CalibTable& t, int64_t ref, const CalibColumns& out)
+{
+    const __m128i mask = _mm_set1_epi64x((long long)T_SUM_MASK);
+    const __m128i half = _mm_set1_epi64x((long long)T_SUM_HALF);
+    const __m128i r = _mm_set1_epi64x(ref);
+    const __m128i base = _mm_sub_epi64(r, half);
+    const __m128i k = _mm_set1_epi64x(UNWRAPPED_PS);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i w0 = _mm_loadu_si128((const __m128i*)(words + i));
+        __m128i w1 = _mm_loadu_si128((const __m128i*)(words + i + 2));
+        __m128i hi = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(w0), _mm_castsi128_ps(w1), _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i chid = _mm_srli_epi32(hi, HI_CHID_RIGHT);
+        __m128 diff = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_slli_epi32(hi, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT));
+
+        unsigned c0 = _mm_extract_epi32(chid, 0), c1 = _mm_extract_epi32(chid, 1);
+        unsigned c2 = _mm_extract_epi32(chid, 2), c3 = _mm_extract_epi32(chid, 3);
+        __m128 scale = _mm_setr_ps(t.pos_scale[c0], t.pos_scale[c1], t.pos_scale[c2], t.pos_scale[c3]);
+        __m128 bias = _mm_setr_ps(t.pos_bias[c0], t.pos_bias[c1], t.pos_bias[c2], t.pos_bias[c3]);
+        _mm_storeu_ps(out.position_mm + i, _mm_add_ps(_mm_mul_ps(diff, scale), bias));
+
+        __m128i s0 = _mm_add_epi64(base, _mm_xor_si128(_mm_and_si128(_mm_sub_epi64(w0, r), mask), half));
+        __m128i s1 = _mm_add_epi64(base, _mm_xor_si128(_mm_and_si128(_mm_sub_epi64(w1, r), mask), half));
+        __m128i off0 = _mm_set_epi64x(t.time_offset_ps[c1], t.time_offset_ps[c0]);
+        __m128i off1 = _mm_set_epi64x(t.time_offset_ps[c3], t.time_offset_ps[c2]);
+        _mm_storeu_si128((__m128i*)(out.time_ps + i), _mm_sub_epi64(scaleSse4(s0, k), off0));
+        _mm_storeu_si128((__m128i*)(out.time_ps + i + 2), _mm_sub_epi64(scaleSse4(s1, k), off1));
+
+        out.chid[i] = (uint8_t)c0;
+        out.chid[i + 1] = (uint8_t)c1;
+        out.chid[i + 2] = (uint8_t)c2;
+        out.chid[i + 3] = (uint8_t)c3;
+    }
+    calibTail(words, i, n, t, ref, out);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i scaleAvx2(__m256i sum, __m256i k)
+{
+    __m256i hi = _mm256_mul_epu32(_mm256_srli_epi64(sum, 32), k);
+    return _mm256_add_epi64(_mm256_mul_epu32(sum, k), _mm256_slli_epi64(hi, 32));
+}
+
+// 8 words per iteration, lookups with gathers
+__attribute__((target("avx2")))
+static void calibAvx2(const uint64_t* words, size_t n, const CalibTable& t, int64_t ref, const CalibColumns& out)
+{
+    const __m256i mask = _mm256_set1_epi64x((long long)T_SUM_MASK);
+    const __m256i half = _mm256_set1_epi64x((long long)T_SUM_HALF);
+    const __m256i r = _mm256_set1_epi64x(ref);
+    const __m256i base = _mm256_sub_epi64(r, half);
+    const __m256i k = _mm256_set1_epi64x(UNWRAPPED_PS);
+    // The in-lane shuffle leaves the high halves as words 0,1,4,5 | 2,3,6,7
+    const __m256i order = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+    const long long* offsets = (const long long*)t.time_offset_ps;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i w0 = _mm256_loadu_si256((const __m256i*)(words + i));
+        __m256i w1 = _mm256_loadu_si256((const __m256i*)(words + i + 4));
+        __m256i hi = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(w0), _mm256_castsi256_ps(w1), _MM_SHUFFLE(3, 1, 3, 1)));
+        hi = _mm256_permutevar8x32_epi32(hi, order);
+        __m256i chid = _mm256_srli_epi32(hi, HI_CHID_RIGHT);
+        __m256 diff = _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(hi, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT));
+
+        __m256 scale = _mm256_i32gather_ps(t.pos_scale, chid, 4);
+        __m256 bias = _mm256_i32gather_ps(t.pos_bias, chid, 4);
+        _mm256_storeu_ps(out.position_mm + i, _mm256_add_ps(_mm256_mul_ps(diff, scale), bias));
+
+        __m128i chid_lo = _mm256_castsi256_si128(chid);
+        __m128i chid_hi = _mm256_extracti128_si256(chid, 1);
+        __m256i s0 = _mm256_add_epi64(base, _mm256_xor_si256(_mm256_and_si256(_mm256_sub_epi64(w0, r), mask), half));
+        __m256i s1 = _mm256_add_epi64(base, _mm256_xor_si256(_mm256_and_si256(_mm256_sub_epi64(w1, r), mask), half));
+        __m256i off0 = _mm256_i32gather_epi64(offsets, chid_lo, 8);
+        __m256i off1 = _mm256_i32gather_epi64(offsets, chid_hi, 8);
+        _mm256_storeu_si256((__m256i*)(out.time_ps + i), _mm256_sub_epi64(scaleAvx2(s0, k), off0));
+        _mm256_storeu_si256((__m256i*)(out.time_ps + i + 4), _mm256_sub_epi64(scaleAvx2(s1, k), off1));
+
+        __m128i c16 = _mm_packus_epi32(chid_lo, chid_hi);
+        _mm_storel_epi64((__m128i*)(out.chid + i), _mm_packus_epi16(c16, c16));
+    }
+    calibTail(words, i, n, t, ref, out);
+}
+
+#endif // TDC_CALIB_X86
+
+#ifdef TDC_CALIB_NEON
+
+static inline uint64x2_t scaleNeon(uint64x2_t sum, uint32x2_t k)
+{
+    uint64x2_t hi = vmull_u32(vshrn_n_u64(sum, 32), k);
+    return vaddq_u64(vmull_u32(vmovn_u64(sum), k), vshlq_n_u64(hi, 32));
+}
+
+// 4 words per iteration, lookups lane by lane
+static void calibNeon(const uint64_t* words, size_t n, const CalibTable& t, int64_t ref, const CalibColumns& out)
+{
+    const uint64x2_t mask = vdupq_n_u64(T_SUM_MASK);
+    const uint64x2_t half = vdupq_n_u64(T_SUM_HALF);
+    const uint64x2_t r = vdupq_n_u64((uint64_t)ref);
+    const uint64x2_t base = vsubq_u64(r, half);
+    const uint32x2_t k = vdup_n_u32((uint32_t)UNWRAPPED_PS);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint32x4_t hi = vld2q_u32((const uint32_t*)(words + i)).val[1];
+        uint32x4_t chid = vshrq_n_u32(hi, HI_CHID_RIGHT);
+        float32x4_t diff = vcvtq_f32_s32(vshrq_n_s32(vshlq_n_s32(vreinterpretq_s32_u32(hi), HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT));
+
+        unsigned c0 = vgetq_lane_u32(chid, 0), c1 = vgetq_lane_u32(chid, 1);
+        unsigned c2 = vgetq_lane_u32(chid, 2), c3 = vgetq_lane_u32(chid, 3);
+        float32x4_t scale = vdupq_n_f32(0), bias = vdupq_n_f32(0);
+        scale = vld1q_lane_f32(&t.pos_scale[c0], scale, 0);
+        scale = vld1q_lane_f32(&t.pos_scale[c1], scale, 1);
+        scale = vld1q_lane_f32(&t.pos_scale[c2], scale, 2);
+        scale = vld1q_lane_f32(&t.pos_scale[c3], scale, 3);
+        bias = vld1q_lane_f32(&t.pos_bias[c0], bias, 0);
+        bias = vld1q_lane_f32(&t.pos_bias[c1], bias, 1);
+        bias = vld1q_lane_f32(&t.pos_bias[c2], bias, 2);
+        bias = vld1q_lane_f32(&t.pos_bias[c3], bias, 3);
+        vst1q_f32(out.position_mm + i, vmlaq_f32(bias, diff, scale));
+
+        uint64x2_t w0 = vld1q_u64(words + i);
+        uint64x2_t w1 = vld1q_u64(words + i + 2);
+        uint64x2_t s0 = vaddq_u64(base, veorq_u64(vandq_u64(vsubq_u64(w0, r), mask), half));
+        uint64x2_t s1 = vaddq_u64(base, veorq_u64(vandq_u64(vsubq_u64(w1, r), mask), half));
+        int64x2_t off0 = vcombine_s64(vld1_s64(&t.time_offset_ps[c0]), vld1_s64(&t.time_offset_ps[c1]));
+        int64x2_t off1 = vcombine_s64(vld1_s64(&t.time_offset_ps[c2]), vld1_s64(&t.time_offset_ps[c3]));
+        vst1q_s64(out.time_ps + i, vsubq_s64(vreinterpretq_s64_u64(scaleNeon(s0, k)), off0));
+        vst1q_s64(out.time_ps + i + 2, vsubq_s64(vreinterpretq_s64_u64(scaleNeon(s1, k)), off1));
+
+        out.chid[i] = (uint8_t)c0;
+        out.chid[i + 1] = (uint8_t)c1;
+        out.chid[i + 2] = (uint8_t)c2;
+        out.chid[i + 3] = (uint8_t)c3;
+    }
+    calibTail(words, i, n, t, ref, out);
+}
+
+#endif // TDC_CALIB_NEON
+
+Calibration::Calibration(std::unique_ptr<CalibTable> table, Kernel kernel)
+{
+    if (kernel == Kernel::AUTO)
+        kernel = bestKernel();
+    else if (!kernelAvailable(kernel))
+        throw std::invalid_argument(std::string("Calibration kernel not available: ") + kernelName(kernel));
+    m_kernel = kernel;
+    switch (kernel)
+    {
+#ifdef TDC_CALIB_X86
+    case Kernel::SSE4: m_fn = calibSse4; break;
+    case Kernel::AVX2: m_fn = calibAvx2; break;
+#endif
+#ifdef TDC_CALIB_NEON
+    case Kernel::NEON: m_fn = calibNeon; break;
+#endif
+    default: m_fn = calibScalar; break;
+    }
+    m_table.store(table ? table.release() : new CalibTable(), std::memory_order_release);
+}
+
+Calibration::~Calibration()
+{
+    delete m_table.load(std::memory_order_acquire);
+}
+
+// Writer side. A reader that marked its slot before the generation bump may
+// still use the old table and is waited for. One that marks it later loads
+// the pointer after the swap, whatever generation it read.
+void Calibration::publish(std::unique_ptr<CalibTable> table)
+{
+    if (!table)
+        table.reset(new CalibTable());
+    std::lock_guard<std::mutex> lock(m_publish_mutex);
+    const CalibTable* old = m_table.exchange(table.release(), std::memory_order_seq_cst);
+    uint64_t generation = m_generation.fetch_add(1, std::memory_order_seq_cst) + 1;
+    for (unsigned i = 0; i < MAX_READERS; ++i)
+    {
+        uint64_t g;
+        while ((g = m_readers[i].generation.load(std::memory_order_seq_cst)) != 0 && g < generation)
+            std::this_thread::yield();
+    }
+    delete old;
+}
+
+size_t Calibration::decode(const uint64_t* words, size_t n, const CalibColumns& out, TsumUnwrapper& unwrap)
+{
+    if (n == 0)
+        return 0;
+
+    // Claim a reader slot, starting at the one this thread used last
+    static thread_local unsigned hint = 0;
+    ReaderSlot* slot = nullptr;
+    for (unsigned i = hint, tries = 0; !slot; i = (i + 1) % MAX_READERS)
+    {
+        uint64_t idle = 0;
+        if (m_readers[i].generation.compare_exchange_strong(idle, m_generation.load(std::memory_order_seq_cst),
+                                                            std::memory_order_seq_cst))
+        {
+            slot = &m_readers[i];
+            hint = i;
+        }
+        else if (++tries % MAX_READERS == 0)
+            std::this_thread::yield();
+    }
+
+    const CalibTable* table = m_table.load(std::memory_order_seq_cst);
+    int64_t ref = unwrap.blockReference(words[0]);
+    m_fn(words, n, *table, ref, out);
+    unwrap.setReference(TsumUnwrapper::unwrapValue(words[n - 1], ref));
+
+    slot->generation.store(0, std::memory_order_release);
+    return n;
+}
+
+size_t Calibration::decodeBlock(const void* data, uint32_t len, const CalibColumns& out, TsumUnwrapper& unwrap)
+{
+    return decode(static_cast<const uint64_t*>(data), len / sizeof(uint64_t), out, unwrap);
+}
+
+} // namespace tdc_decode
@@ -0,0 +1,126 @@
+// =================================================================================
+// FILE: tdc_calib.hpp
+//
+// DESCRIPTION:
+// Calibrated decoding of coincidence words. A per-CHID table turns each word
+// straight into hit position and corrected hit time, in the same pass that
+// decodes and unwraps it:
+//
+//   position_mm = (t_diff_ns - t_diff_offset_ns) * velocity_mm_per_ns / 2
+//   time_ps     = (t1 + t2) / 2 - time_offset      (t_sum unwrapped, see tdc_unwrap.hpp)
+//
+// Position is along the bar, positive towards the end read out by the second
+// channel of the pair. time_offset holds the cable delays and the half-bar
+// transit time. Channels missing from the table decode to position NaN and
+// no time offset.
+//
+// The table is stored as columns indexed by CHID. The AVX2 kernel fetches the
+// constants with gathers, SSE4.1 and NEON with per-lane loads.
+//
+// Tables are swapped RCU-style while readout runs. decode() pins the current
+// table for one call: it marks a reader slot with the table generation and
+// loads the pointer, no locks. publish() swaps the pointer and waits until
+// no slot holds an older generation, then frees the old table. Up to
+// MAX_READERS threads can decode at the same time.
+//
+// Table file, one channel per line, '#' starts a comment:
+//   # chid  t_diff_offset_ns  velocity_mm_per_ns  time_offset_ns
+//   0       0.42              150.0               12.5
+//
+// Usage:
+//   tdc_decode::Calibration calib(tdc_decode::CalibTable::load("bars.cal"));
+//   tdc_decode::TsumUnwrapper unwrap;                 // one per data stream
+//   tdc_decode::CalibColumns cols = {chid.data(), position.data(), time.data()};
+//   calib.decodeBlock(block.data, block.len, cols, unwrap);
+//   calib.load("bars.cal");                           // from any thread, any time
+//
+// =================================================================================
+#ifndef TDC_CALIB_HPP
+#define TDC_CALIB_HPP
+
+#include "tdc_decode.hpp"
+#include "tdc_unwrap.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace tdc_decode {
+
+// One channel as written in the table file
+struct ChannelCalib {
+    double t_diff_offset_ns;
+    double velocity_mm_per_ns;
+    double time_offset_ns;
+};
+
+// Constants in the form the kernels use, one column entry per CHID
+struct CalibTable {
+    static constexpr unsigned CHANNELS = 1u << CHID_BITS;
+
+    float pos_scale[CHANNELS];          // mm per t_diff LSB
+    float pos_bias[CHANNELS];           // mm, NaN if not calibrated
+    int64_t time_offset_ps[CHANNELS];
+
+    // All channels uncalibrated
+    CalibTable();
+    void set(unsigned chid, const ChannelCalib& calib);
+    bool calibrated(unsigned chid) const { return pos_bias[chid] == pos_bias[chid]; }
+
+    // Throws std::runtime_error naming the file and line on any error
+    static std::unique_ptr<CalibTable> load(const std::string& path);
+};
+
+// Output columns, one entry per word. Any alignment.
+struct CalibColumns {
+    uint8_t* chid;
+    float* position_mm;
+    int64_t* time_ps;
+};
+
+class Calibration {
+public:
+    static constexpr unsigned MAX_READERS = 16;
+
+    // Starts with table, or an all-uncalibrated one if null. Throws
+    // std::invalid_argument if the kernel is not available.
+    explicit Calibration(std::unique_ptr<CalibTable> table = nullptr, Kernel kernel = Kernel::AUTO);
+    ~Calibration();
+    Calibration(const Calibration&) = delete;
+    Calibration& operator=(const Calibration&) = delete;
+
+    // Swaps in a new table and frees the old one once no decode uses it.
+    // Blocks for at most one decode call per reader.
+    void publish(std::unique_ptr<CalibTable> table);
+    void load(const std::string& path) { publish(CalibTable::load(path)); }
+    // Tables published so far, 1 for the initial one
+    uint64_t generation() const { return m_generation.load(std::memory_order_acquire); }
+
+    // Decodes n words with the current table, unwrapping t_sum with unwrap
+    // (one per data stream). Returns n.
+    size_t decode(const uint64_t* words, size_t n, const CalibColumns& out, TsumUnwrapper& unwrap);
+    // Decodes the len / 8 whole words of a DMA block
+    size_t decodeBlock(const void* data, uint32_t len, const CalibColumns& out, TsumUnwrapper& unwrap);
+    Kernel kernel() const { return m_kernel; }
+
+private:
+    typedef void (*KernelFn)(const uint64_t*, size_t, const CalibTable&, int64_t, const CalibColumns&);
+
+    // Generation the reader started at, 0 when idle
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> generation{0};
+    };
+
+    Kernel m_kernel;
+    KernelFn m_fn;
+    std::atomic<const CalibTable*> m_table{nullptr};
+    std::atomic<uint64_t> m_generation{1};
+    ReaderSlot m_readers[MAX_READERS];
+    std::mutex m_publish_mutex;
+};
+
+} // namespace tdc_decode
+
+#endif // TDC_CALIB_HPP
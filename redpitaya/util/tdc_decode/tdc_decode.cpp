@@ -0,0 +1,225 @@
+// =================================================================================
+// FILE: tdc_decode.cpp
+//
+// DESCRIPTION:
+// Decode kernels of tdc_decode.hpp. The x86 kernels are compiled with target
+// attributes, so the library builds with plain flags and picks SSE4.1/AVX2 at
+// run time. The NEON kernel is built when the compiler targets NEON
+// (-mfpu=neon on ARMv7, always on AArch64).
+//
+// All SIMD kernels work on the high 32 bits of each word, which hold CHID and
+// t_diff (HI_* shifts in tdc_decode.hpp). t_sum is the word masked to 48
+// bits. Leftover words go through the scalar kernel.
+//
+// =================================================================================
+#include "tdc_decode.hpp"
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TDC_DECODE_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TDC_DECODE_NEON 1
+#endif
+
+namespace tdc_decode {
+
+typedef void (*KernelFn)(const uint64_t*, size_t, const CoincColumns&);
+
+static void decodeScalar(const uint64_t* words, size_t n, const CoincColumns& out)
+{
+    for (size_t i = 0; i < n; ++i)
+        decodeWord(words[i], &out.chid[i], &out.t_diff[i], &out.t_sum[i]);
+}
+
+static void decodeTail(const uint64_t* words, size_t done, size_t n, const CoincColumns& out)
+{
+    CoincColumns rest = {out.chid + done, out.t_diff + done, out.t_sum + done};
+    decodeScalar(words + done, n - done, rest);
+}
+
+#ifdef TDC_DECODE_X86
+
+// 8 words per iteration
+__attribute__((target("sse4.1")))
+static void decodeSse4(const uint64_t* words, size_t n, const CoincColumns& out)
+{
+    const __m128i mask = _mm_set1_epi64x((long long)T_SUM_MASK);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i w0 = _mm_loadu_si128((const __m128i*)(words + i));
+        __m128i w1 = _mm_loadu_si128((const __m128i*)(words + i + 2));
+        __m128i w2 = _mm_loadu_si128((const __m128i*)(words + i + 4));
+        __m128i w3 = _mm_loadu_si128((const __m128i*)(words + i + 6));
+        _mm_storeu_si128((__m128i*)(out.t_sum + i), _mm_and_si128(w0, mask));
+        _mm_storeu_si128((__m128i*)(out.t_sum + i + 2), _mm_and_si128(w1, mask));
+        _mm_storeu_si128((__m128i*)(out.t_sum + i + 4), _mm_and_si128(w2, mask));
+        _mm_storeu_si128((__m128i*)(out.t_sum + i + 6), _mm_and_si128(w3, mask));
+
+        // High halves of words 0-3 and 4-7
+        __m128i hi0 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(w0), _mm_castsi128_ps(w1), _MM_SHUFFLE(3, 1, 3, 1)));
+        __m128i hi1 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(w2), _mm_castsi128_ps(w3), _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m128i d0 = _mm_srai_epi32(_mm_slli_epi32(hi0, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        __m128i d1 = _mm_srai_epi32(_mm_slli_epi32(hi1, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        _mm_storeu_si128((__m128i*)(out.t_diff + i), _mm_packs_epi32(d0, d1));
+
+        __m128i c = _mm_packus_epi32(_mm_srli_epi32(hi0, HI_CHID_RIGHT), _mm_srli_epi32(hi1, HI_CHID_RIGHT));
+        _mm_storel_epi64((__m128i*)(out.chid + i), _mm_packus_epi16(c, c));
+    }
+    decodeTail(words, i, n, out);
+}
+
+// 16 words per iteration
+__attribute__((target("avx2")))
+static void decodeAvx2(const uint64_t* words, size_t n, const CoincColumns& out)
+{
+    const __m256i mask = _mm256_set1_epi64x((long long)T_SUM_MASK);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i w0 = _mm256_loadu_si256((const __m256i*)(words + i));
+        __m256i w1 = _mm256_loadu_si256((const __m256i*)(words + i + 4));
+        __m256i w2 = _mm256_loadu_si256((const __m256i*)(words + i + 8));
+        __m256i w3 = _mm256_loadu_si256((const __m256i*)(words + i + 12));
+        _mm256_storeu_si256((__m256i*)(out.t_sum + i), _mm256_and_si256(w0, mask));
+        _mm256_storeu_si256((__m256i*)(out.t_sum + i + 4), _mm256_and_si256(w1, mask));
+        _mm256_storeu_si256((__m256i*)(out.t_sum + i + 8), _mm256_and_si256(w2, mask));
+        _mm256_storeu_si256((__m256i*)(out.t_sum + i + 12), _mm256_and_si256(w3, mask));
+
+        // In-lane shuffles and packs leave 16-bit results in the order
+        // 0,1,4,5,8,9,12,13 | 2,3,6,7,10,11,14,15: one 32-bit permute restores it
+        __m256i hi0 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(w0), _mm256_castsi256_ps(w1), _MM_SHUFFLE(3, 1, 3, 1)));
+        __m256i hi1 = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(w2), _mm256_castsi256_ps(w3), _MM_SHUFFLE(3, 1, 3, 1)));
+
+        __m256i d0 = _mm256_srai_epi32(_mm256_slli_epi32(hi0, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        __m256i d1 = _mm256_srai_epi32(_mm256_slli_epi32(hi1, HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        __m256i d = _mm256_permutevar8x32_epi32(_mm256_packs_epi32(d0, d1), order);
+        _mm256_storeu_si256((__m256i*)(out.t_diff + i), d);
+
+        __m256i c = _mm256_packus_epi32(_mm256_srli_epi32(hi0, HI_CHID_RIGHT), _mm256_srli_epi32(hi1, HI_CHID_RIGHT));
+        c = _mm256_permutevar8x32_epi32(c, order);
+        __m128i c8 = _mm_packus_epi16(_mm256_castsi256_si128(c), _mm256_extracti128_si256(c, 1));
+        _mm_storeu_si128((__m128i*)(out.chid + i), c8);
+    }
+    decodeTail(words, i, n, out);
+}
+
+#endif // TDC_DECODE_X86
+
+#ifdef TDC_DECODE_NEON
+
+// 8 words per iteration. vld2 splits low and high halves; vst2 stores t_sum
+// as low half and high half masked to 16 bits.
+static void decodeNeon(const uint64_t* words, size_t n, const CoincColumns& out)
+{
+    const uint32x4_t hi_mask = vdupq_n_u32((uint32_t)(T_SUM_MASK >> 32));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint32x4x2_t w0 = vld2q_u32((const uint32_t*)(words + i));
+        uint32x4x2_t w1 = vld2q_u32((const uint32_t*)(words + i + 4));
+
+        uint32x4x2_t s0, s1;
+        s0.val[0] = w0.val[0];
+        s0.val[1] = vandq_u32(w0.val[1], hi_mask);
+        s1.val[0] = w1.val[0];
+        s1.val[1] = vandq_u32(w1.val[1], hi_mask);
+        vst2q_u32((uint32_t*)(out.t_sum + i), s0);
+        vst2q_u32((uint32_t*)(out.t_sum + i + 4), s1);
+
+        int32x4_t d0 = vshrq_n_s32(vshlq_n_s32(vreinterpretq_s32_u32(w0.val[1]), HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        int32x4_t d1 = vshrq_n_s32(vshlq_n_s32(vreinterpretq_s32_u32(w1.val[1]), HI_T_DIFF_LEFT), HI_T_DIFF_RIGHT);
+        vst1q_s16(out.t_diff + i, vcombine_s16(vmovn_s32(d0), vmovn_s32(d1)));
+
+        uint16x8_t c = vcombine_u16(vmovn_u32(vshrq_n_u32(w0.val[1], HI_CHID_RIGHT)),
+                                    vmovn_u32(vshrq_n_u32(w1.val[1], HI_CHID_RIGHT)));
+        vst1_u8(out.chid + i, vmovn_u16(c));
+    }
+    decodeTail(words, i, n, out);
+}
+
+#endif // TDC_DECODE_NEON
+
+const char* kernelName(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::AUTO: return "auto";
+    case Kernel::SCALAR: return "scalar";
+    case Kernel::SSE4: return "sse4";
+    case Kernel::AVX2: return "avx2";
+    case Kernel::NEON: return "neon";
+    }
+    return "?";
+}
+
+bool kernelAvailable(Kernel kernel)
+{
+    switch (kernel)
+    {
+    case Kernel::AUTO:
+    case Kernel::SCALAR:
+        return true;
+#ifdef TDC_DECODE_X86
+    case Kernel::SSE4:
+        return __builtin_cpu_supports("sse4.1");
+    case Kernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+#ifdef TDC_DECODE_NEON
+    case Kernel::NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+Kernel bestKernel()
+{
+    static const Kernel best = kernelAvailable(Kernel::AVX2)   ? Kernel::AVX2
+                               : kernelAvailable(Kernel::NEON) ? Kernel::NEON
+                               : kernelAvailable(Kernel::SSE4) ? Kernel::SSE4
+                                                               : Kernel::SCALAR;
+    return best;
+}
+
+static KernelFn kernelFunction(Kernel kernel)
+{
+    if (kernel == Kernel::AUTO)
+        kernel = bestKernel();
+    else if (!kernelAvailable(kernel))
+        throw std::invalid_argument(std::string("Decode kernel not available: ") + kernelName(kernel));
+    switch (kernel)
+    {
+#ifdef TDC_DECODE_X86
+    case Kernel::SSE4: return decodeSse4;
+    case Kernel::AVX2: return decodeAvx2;
+#endif
+#ifdef TDC_DECODE_NEON
+    case Kernel::NEON: return decodeNeon;
+#endif
+    default: return decodeScalar;
+    }
+}
+
+size_t decodeCoinc(const uint64_t* words, size_t n, const CoincColumns& out, Kernel kernel)
+{
+    static const KernelFn best = kernelFunction(Kernel::AUTO);
+    KernelFn fn = (kernel == Kernel::AUTO) ? best : kernelFunction(kernel);
+    fn(words, n, out);
+    return n;
+}
+
+size_t decodeBlock(const void* data, uint32_t len, const CoincColumns& out, Kernel kernel)
+{
+    return decodeCoinc(static_cast<const uint64_t*>(data), len / sizeof(uint64_t), out, kernel);
+}
+
+} // namespace tdc_decode
@@ -0,0 +1,92 @@
+// =================================================================================
+// FILE: tdc_decode.hpp
+//
+// DESCRIPTION:
+// Host-side decoding of the 64-bit coincidence words written by
+// fast_data_builder.vhd into structure-of-arrays columns:
+//
+//   63      58 57        48 47                                   0
+//   |  CHID   |   t_diff   |                t_sum                 |
+//      6 bit    10 bit signed          48 bit unsigned
+//
+// CHID is the first channel of the pair, t_diff = t1 - t2 (sign bit and 9
+// LSBs) and t_sum = t1 + t2 (low 48 bits), both in 0.25 ns units. The widths
+// come from tdc_layout.hpp, generated from the VHDL: the kernels follow a
+// changed layout on rebuild, or fail to compile if they cannot.
+//
+// One pass over a DMA block fills the chid, t_diff (sign extended) and t_sum
+// columns. Kernels: scalar, SSE4.1 and AVX2 (x86-64), NEON (Cortex-A9 with
+// -mfpu=neon, AArch64). Kernel::AUTO picks the fastest one the CPU supports,
+// resolved once per process.
+//
+// Usage:
+//   std::vector<uint8_t> chid(n); std::vector<int16_t> t_diff(n); std::vector<uint64_t> t_sum(n);
+//   tdc_decode::CoincColumns cols = {chid.data(), t_diff.data(), t_sum.data()};
+//   tdc_decode::decodeBlock(block.data, block.len, cols);
+//
+// =================================================================================
+#ifndef TDC_DECODE_HPP
+#define TDC_DECODE_HPP
+
+#include "tdc_layout.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace tdc_decode {
+
+// Word layout of fast_data_builder.vhd
+typedef tdc_layout::CoincCodec Codec;
+constexpr unsigned CHID_SHIFT = Codec::Chid::shift;
+constexpr unsigned CHID_BITS = Codec::Chid::bits;
+constexpr unsigned T_DIFF_SHIFT = Codec::TDiff::shift;
+constexpr unsigned T_DIFF_BITS = Codec::TDiff::bits;
+constexpr unsigned T_SUM_BITS = Codec::TSum::bits;
+constexpr uint64_t T_SUM_MASK = Codec::TSum::mask;
+
+// Shifts of the high 32-bit half of a word, which the SIMD kernels work on:
+// t_diff = (hi << HI_T_DIFF_LEFT) >> HI_T_DIFF_RIGHT (arithmetic), chid = hi >> HI_CHID_RIGHT
+static_assert(CHID_SHIFT + CHID_BITS == 64 && T_DIFF_SHIFT + T_DIFF_BITS == CHID_SHIFT && T_DIFF_SHIFT >= 32,
+              "SIMD kernels assume CHID and t_diff in the high 32 bits");
+constexpr int HI_T_DIFF_LEFT = 64 - T_DIFF_SHIFT - T_DIFF_BITS;
+constexpr int HI_T_DIFF_RIGHT = 32 - T_DIFF_BITS;
+constexpr int HI_CHID_RIGHT = CHID_SHIFT - 32;
+
+enum class Kernel {
+    AUTO,     // Fastest available
+    SCALAR,
+    SSE4,     // SSE4.1, x86-64
+    AVX2,     // x86-64
+    NEON      // ARMv7 with NEON, AArch64
+};
+
+// Output columns, one entry per word. Any alignment.
+struct CoincColumns {
+    uint8_t* chid;
+    int16_t* t_diff;
+    uint64_t* t_sum;
+};
+
+// Scalar reference for one word
+inline void decodeWord(uint64_t word, uint8_t* chid, int16_t* t_diff, uint64_t* t_sum)
+{
+    Codec::Event e = Codec::decode(word);
+    *chid = e.chid;
+    *t_diff = e.t_diff;
+    *t_sum = e.t_sum;
+}
+
+const char* kernelName(Kernel kernel);
+// Compiled in and supported by this CPU. AUTO and SCALAR always are.
+bool kernelAvailable(Kernel kernel);
+// What AUTO resolves to
+Kernel bestKernel();
+
+// Decodes n words into the columns and returns n. Throws std::invalid_argument
+// if the kernel is not available.
+size_t decodeCoinc(const uint64_t* words, size_t n, const CoincColumns& out, Kernel kernel = Kernel::AUTO);
+// Decodes the len / 8 whole words of a DMA block
+size_t decodeBlock(const void* data, uint32_t len, const CoincColumns& out, Kernel kernel = Kernel::AUTO);
+
+} // namespace tdc_decode
+
+#endif // TDC_DECODE_HPP
@@ -0,0 +1,155 @@
+// =================================================================================
+// FILE: tdc_density.cpp
+//
+// DESCRIPTION:
+// Code-density histograms and the fine-time correction of tdc_density.hpp.
+//
+// =================================================================================
+#include "tdc_density.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace tdc_decode {
+
+static inline unsigned densityBin(uint64_t word)
+{
+    return (unsigned)(SingleCodec::Chid::get(word) << SingleCodec::FINE_BITS) | (unsigned)SingleCodec::Fine::get(word);
+}
+
+uint64_t DensityHistogram::entries(unsigned chid) const
+{
+    uint64_t n = 0;
+    for (unsigned k = 0; k < FINE_CODES; ++k)
+        n += counts[chid * FINE_CODES + k];
+    return n;
+}
+
+float FineCorrection::maxDnl(unsigned chid) const
+{
+    float m = 0;
+    for (unsigned k = 0; k < FINE_CODES; ++k)
+        m = std::fmax(m, std::fabs(dnl[chid * FINE_CODES + k]));
+    return m;
+}
+
+float FineCorrection::maxInl(unsigned chid) const
+{
+    float m = 0;
+    for (unsigned k = 0; k < FINE_CODES; ++k)
+        m = std::fmax(m, std::fabs(inl[chid * FINE_CODES + k]));
+    return m;
+}
+
+CodeDensity::Recorder::Recorder(CodeDensity& density, unsigned sample_shift, uint64_t flush_words)
+    : m_density(density), m_sample_shift(sample_shift),
+      m_flush_words((flush_words == 0 || flush_words > (1ULL << 31)) ? (1ULL << 31) : flush_words)
+{
+    memset(m_counts, 0, sizeof(m_counts));
+}
+
+CodeDensity::Recorder::~Recorder()
+{
+    flush();
+}
+
+void CodeDensity::Recorder::record(const uint64_t* words, size_t n)
+{
+    const size_t step = (size_t)1 << m_sample_shift;
+    uint32_t* c0 = m_counts[0];
+    uint32_t* c1 = m_counts[1];
+    uint32_t* c2 = m_counts[2];
+    uint32_t* c3 = m_counts[3];
+    size_t i = 0;
+    for (; i + 3 * step < n; i += 4 * step)
+    {
+        ++c0[densityBin(words[i])];
+        ++c1[densityBin(words[i + step])];
+        ++c2[densityBin(words[i + 2 * step])];
+        ++c3[densityBin(words[i + 3 * step])];
+    }
+    for (; i < n; i += step)
+        ++c0[densityBin(words[i])];
+
+    m_pending += (n + step - 1) >> m_sample_shift;
+    if (m_pending >= m_flush_words)
+        flush();
+}
+
+void CodeDensity::Recorder::flush()
+{
+    if (m_pending == 0)
+        return;
+    for (unsigned b = 0; b < DENSITY_BINS; ++b)
+    {
+        uint64_t sum = 0;
+        for (unsigned c = 0; c < COPIES; ++c)
+            sum += m_counts[c][b];
+        if (sum)
+            m_density.m_counts[b].fetch_add(sum, std::memory_order_relaxed);
+    }
+    memset(m_counts, 0, sizeof(m_counts));
+    m_pending = 0;
+}
+
+CodeDensity::CodeDensity()
+{
+    for (unsigned b = 0; b < DENSITY_BINS; ++b)
+        m_counts[b].store(0, std::memory_order_relaxed);
+}
+
+DensityHistogram CodeDensity::snapshot() const
+{
+    DensityHistogram h;
+    for (unsigned b = 0; b < DENSITY_BINS; ++b)
+        h.counts[b] = m_counts[b].load(std::memory_order_relaxed);
+    return h;
+}
+
+DensityHistogram CodeDensity::take()
+{
+    DensityHistogram h;
+    for (unsigned b = 0; b < DENSITY_BINS; ++b)
+        h.counts[b] = m_counts[b].exchange(0, std::memory_order_relaxed);
+    return h;
+}
+
+std::unique_ptr<FineCorrection> CodeDensity::correction(uint64_t min_entries) const
+{
+    return correction(snapshot(), min_entries);
+}
+
+std::unique_ptr<FineCorrection> CodeDensity::correction(const DensityHistogram& histogram, uint64_t min_entries)
+{
+    std::unique_ptr<FineCorrection> c(new FineCorrection());
+    for (unsigned ch = 0; ch < DENSITY_CHANNELS; ++ch)
+    {
+        uint64_t n = histogram.entries(ch);
+        c->entries[ch] = n;
+        c->calibrated[ch] = (n > 0 && n >= min_entries);
+        double edge = 0;
+        for (unsigned k = 0; k < FINE_CODES; ++k)
+        {
+            unsigned b = ch * FINE_CODES + k;
+            double width = c->calibrated[ch] ? (double)histogram.counts[b] * FINE_CODES / n : 1.0;
+            double centre = edge + width / 2;
+            c->dnl[b] = (float)(width - 1);
+            c->inl[b] = (float)(centre - (k + 0.5));
+            c->centre_ps[b] = std::llround(centre * FINE_BIN_PS);
+            edge += width;
+        }
+    }
+    return c;
+}
+
+void decodeSingle(const uint64_t* words, size_t n, const FineCorrection& correction, uint8_t* chid, int64_t* time_ps)
+{
+    const int64_t period_ps = FINE_CODES * FINE_BIN_PS;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint64_t w = words[i];
+        chid[i] = (uint8_t)SingleCodec::Chid::get(w);
+        time_ps[i] = (int64_t)SingleCodec::Coarse::get(w) * period_ps + correction.centre_ps[densityBin(w)];
+    }
+}
+
+} // namespace tdc_decode
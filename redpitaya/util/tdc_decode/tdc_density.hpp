@@ -0,0 +1,138 @@
+// =================================================================================
+// FILE: tdc_density.hpp
+//
+// DESCRIPTION:
+// Online code-density calibration of the fine time. Each fine code of the
+// 16-phase sampler (tdc_core.vhd) should be hit in proportion to its width,
+// so a histogram of the codes of uncorrelated hits measures every bin:
+//
+//   width_k  = counts_k / N * 2^FINE_BITS      (LSB)
+//   DNL_k    = width_k - 1
+//   centre_k = width_0 + ... + width_k-1 + width_k / 2
+//   INL_k    = centre_k - (k + 0.5)            (bin centre against ideal)
+//
+// The histogram needs per-channel fine codes, which only single trigger
+// words carry (CHID | coarse | fine). In coincidence words the low bits of
+// t_sum and t_diff mix the codes of both channels of the pair. Record single
+// trigger data, e.g. a short single-trigger run now and then, to follow drift.
+//
+// Each readout thread owns a Recorder with plain counters. It keeps four
+// interleaved copies so repeated codes do not serialise on one counter, and
+// records every 2^sample_shift-th word, by default every 16th. Counting every
+// word at the 70 MS/s peak takes a noticeable share of a core, on the order of
+// 10% depending on the machine (run bench_density to measure it); the
+// histogram must not compete with decoding, and every 16th word still adds
+// over 4 M entries per second, plenty for a density estimate. Every
+// flush_words words, or on flush(), the Recorder adds its counts to the
+// shared histogram with relaxed atomic adds. No locks, and the readout
+// thread never waits.
+//
+// correction() turns the merged counts into a FineCorrection: per-channel
+// DNL, INL and a bin-centre LUT in ps, which decodeSingle() applies.
+//
+// Usage:
+//   tdc_decode::CodeDensity density;
+//   tdc_decode::CodeDensity::Recorder rec(density);          // one per thread, every 16th word
+//   rec.recordBlock(block.data, block.len);                  // hot path
+//   std::unique_ptr<tdc_decode::FineCorrection> c = density.correction();
+//   tdc_decode::decodeSingle(words, n, *c, chid, time_ps);
+//
+// =================================================================================
+#ifndef TDC_DENSITY_HPP
+#define TDC_DENSITY_HPP
+
+#include "tdc_layout.hpp"
+#include "tdc_unwrap.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace tdc_decode {
+
+typedef tdc_layout::SingleCodec SingleCodec;
+
+constexpr unsigned FINE_CODES = 1u << SingleCodec::FINE_BITS;
+constexpr unsigned DENSITY_CHANNELS = 1u << SingleCodec::CHID_BITS;
+// One histogram bin per channel and fine code, index (chid << FINE_BITS) | fine
+constexpr unsigned DENSITY_BINS = DENSITY_CHANNELS * FINE_CODES;
+// Nominal fine bin, the t_diff/t_sum LSB
+constexpr int64_t FINE_BIN_PS = 2 * UNWRAPPED_PS;
+
+struct DensityHistogram {
+    uint64_t counts[DENSITY_BINS];
+
+    uint64_t entries(unsigned chid) const;
+};
+
+struct FineCorrection {
+    bool calibrated[DENSITY_CHANNELS];      // had at least min_entries
+    uint64_t entries[DENSITY_CHANNELS];
+    float dnl[DENSITY_BINS];                // LSB, 0 where not calibrated
+    float inl[DENSITY_BINS];                // LSB, bin centre against k + 0.5
+    int64_t centre_ps[DENSITY_BINS];        // bin centre in the coarse period, (k + 0.5) * FINE_BIN_PS if not calibrated
+
+    // Largest |DNL| and |INL| of a channel
+    float maxDnl(unsigned chid) const;
+    float maxInl(unsigned chid) const;
+};
+
+class CodeDensity {
+public:
+    class Recorder {
+    public:
+        static constexpr unsigned DEFAULT_SAMPLE_SHIFT = 4;
+        static constexpr uint64_t DEFAULT_FLUSH_WORDS = 1 << 20;
+
+        // Records every 2^sample_shift-th word (0: every word) and merges
+        // every flush_words recorded words (at most 2^31)
+        explicit Recorder(CodeDensity& density, unsigned sample_shift = DEFAULT_SAMPLE_SHIFT,
+                          uint64_t flush_words = DEFAULT_FLUSH_WORDS);
+        // Flushes what is left
+        ~Recorder();
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
+
+        // Single trigger words
+        void record(const uint64_t* words, size_t n);
+        void recordBlock(const void* data, uint32_t len) { record(static_cast<const uint64_t*>(data), len / sizeof(uint64_t)); }
+        // Adds the local counts to the shared histogram and clears them
+        void flush();
+
+    private:
+        static constexpr unsigned COPIES = 4;
+
+        CodeDensity& m_density;
+        unsigned m_sample_shift;
+        uint64_t m_flush_words;
+        uint64_t m_pending = 0;
+        uint32_t m_counts[COPIES][DENSITY_BINS];
+    };
+
+    CodeDensity();
+
+    // Merged counts so far
+    DensityHistogram snapshot() const;
+    // Merged counts so far, and starts over: one interval of a drift series
+    DensityHistogram take();
+    void reset() { take(); }
+
+    // From the merged counts, channels with fewer than min_entries uncorrected
+    std::unique_ptr<FineCorrection> correction(uint64_t min_entries = DEFAULT_MIN_ENTRIES) const;
+    static std::unique_ptr<FineCorrection> correction(const DensityHistogram& histogram,
+                                                      uint64_t min_entries = DEFAULT_MIN_ENTRIES);
+
+    // About 1% statistical error per bin
+    static constexpr uint64_t DEFAULT_MIN_ENTRIES = 10000 * FINE_CODES;
+
+private:
+    std::atomic<uint64_t> m_counts[DENSITY_BINS];
+};
+
+// Decodes n single trigger words into CHID and time in ps, each fine code
+// placed at its measured bin centre
+void decodeSingle(const uint64_t* words, size_t n, const FineCorrection& correction, uint8_t* chid, int64_t* time_ps);
+
+} // namespace tdc_decode
+
+#endif // TDC_DENSITY_HPP
@@ -0,0 +1,125 @@
+// =================================================================================
+// FILE: tdc_layout.hpp
+//
+// GENERATED by gen_tdc_layout.py from the firmware sources. Do not edit: change
+// the VHDL and run `make layout` (or ./gen_tdc_layout.py).
+//
+// DESCRIPTION:
+// Bit layout of the 64-bit words written by the trigger modes, as compile time
+// constants:
+//
+//   coincidence (fast_data_builder.vhd, generic map in tdc_2ch.vhd)
+//     | CHID | t_diff (signed) | t_sum |      t_diff = t1 - t2, t_sum = t1 + t2
+//
+//   single (trigger_single.vhd, defaults of single_trigger)
+//     | CHID | coarse | fine |
+//
+// Times are in fine bins, 2^FINE_BITS per coarse clock period.
+//
+// Field<Shift, Bits> extracts and inserts one field; CoincCodec and
+// SingleCodec name the fields of each mode and decode whole words. Code that
+// depends on a width should say so with a static_assert against these
+// constants (or Codec::matches), so a firmware change breaks the build instead
+// of the data.
+//
+// Usage:
+//   tdc_layout::CoincCodec::Event e = tdc_layout::CoincCodec::decode(word);
+//   uint64_t fine = tdc_layout::SingleCodec::Fine::get(word);
+//   static_assert(tdc_layout::CoincCodec::matches<6, 10, 48>(), "decoder written for 6/10/48");
+//
+// =================================================================================
+#ifndef TDC_LAYOUT_HPP
+#define TDC_LAYOUT_HPP
+
+#include <cstdint>
+
+namespace tdc_layout {
+
+// Bits [Shift + Bits - 1 : Shift] of a 64-bit word
+template <unsigned Shift, unsigned Bits>
+struct Field {
+    static_assert(Bits > 0 && Shift + Bits <= 64, "field outside the 64-bit word");
+    static constexpr unsigned shift = Shift;
+    static constexpr unsigned bits = Bits;
+    static constexpr uint64_t mask = (Bits == 64) ? ~0ULL : (1ULL << (Bits % 64)) - 1;
+
+    static constexpr uint64_t get(uint64_t word) { return (word >> Shift) & mask; }
+    // Two's complement field, sign extended
+    static constexpr int64_t getSigned(uint64_t word) { return (int64_t)(word << (64 - Shift - Bits)) >> (64 - Bits); }
+    static constexpr uint64_t put(uint64_t value) { return (value & mask) << Shift; }
+};
+
+// Hi sits directly above Lo
+template <class Hi, class Lo>
+struct Adjacent {
+    static constexpr bool value = Hi::shift == Lo::shift + Lo::bits;
+};
+
+constexpr unsigned WORD_BITS = 64;
+
+// Coincidence mode
+struct CoincCodec {
+    static constexpr unsigned CHID_BITS = 6;
+    static constexpr unsigned FINE_BITS = 4;
+    static constexpr unsigned COARSE_BITS = 54;
+    static constexpr unsigned T_DIFF_BITS = 10;
+    static constexpr unsigned T_SUM_BITS = 48;
+
+    typedef Field<WORD_BITS - CHID_BITS, CHID_BITS> Chid;
+    typedef Field<T_SUM_BITS, T_DIFF_BITS> TDiff;
+    typedef Field<0, T_SUM_BITS> TSum;
+
+    struct Event {
+        uint8_t chid;
+        int16_t t_diff;
+        uint64_t t_sum;
+    };
+
+    static constexpr Event decode(uint64_t word)
+    {
+        return Event{(uint8_t)Chid::get(word), (int16_t)TDiff::getSigned(word), TSum::get(word)};
+    }
+    static constexpr uint64_t encode(unsigned chid, int t_diff, uint64_t t_sum)
+    {
+        return Chid::put(chid) | TDiff::put((uint64_t)(int64_t)t_diff) | TSum::put(t_sum);
+    }
+    template <unsigned Chid_, unsigned TDiff_, unsigned TSum_>
+    static constexpr bool matches() { return CHID_BITS == Chid_ && T_DIFF_BITS == TDiff_ && T_SUM_BITS == TSum_; }
+};
+
+static_assert(Adjacent<CoincCodec::Chid, CoincCodec::TDiff>::value && Adjacent<CoincCodec::TDiff, CoincCodec::TSum>::value,
+              "coincidence fields do not tile the word");
+static_assert(CoincCodec::CHID_BITS <= 8 && CoincCodec::T_DIFF_BITS <= 16,
+              "CHID or t_diff no longer fit the uint8_t / int16_t of CoincCodec::Event");
+
+// Single trigger mode
+struct SingleCodec {
+    static constexpr unsigned CHID_BITS = 6;
+    static constexpr unsigned FINE_BITS = 4;
+    static constexpr unsigned COARSE_BITS = 54;
+
+    typedef Field<WORD_BITS - CHID_BITS, CHID_BITS> Chid;
+    typedef Field<FINE_BITS, COARSE_BITS> Coarse;
+    typedef Field<0, FINE_BITS> Fine;
+    // Coarse and fine together, in fine bins
+    typedef Field<0, COARSE_BITS + FINE_BITS> Time;
+
+    struct Event {
+        uint8_t chid;
+        uint64_t time;
+    };
+
+    static constexpr Event decode(uint64_t word) { return Event{(uint8_t)Chid::get(word), Time::get(word)}; }
+    static constexpr uint64_t encode(unsigned chid, uint64_t time) { return Chid::put(chid) | Time::put(time); }
+    template <unsigned Chid_, unsigned Coarse_, unsigned Fine_>
+    static constexpr bool matches() { return CHID_BITS == Chid_ && COARSE_BITS == Coarse_ && FINE_BITS == Fine_; }
+};
+
+static_assert(64 == WORD_BITS, "single and coincidence words differ in size");
+static_assert(Adjacent<SingleCodec::Chid, SingleCodec::Coarse>::value && Adjacent<SingleCodec::Coarse, SingleCodec::Fine>::value,
+              "single trigger fields do not tile the word");
+static_assert(SingleCodec::CHID_BITS <= 8, "CHID no longer fits the uint8_t of SingleCodec::Event");
+
+} // namespace tdc_layout
+
+#endif // TDC_LAYOUT_HPP
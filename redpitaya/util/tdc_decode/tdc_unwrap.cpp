@@ -0,0 +1,136 @@
+// =================================================================================
+// FILE: tdc_unwrap.cpp
+//
+// DESCRIPTION:
+// Kernels of tdc_unwrap.hpp. For every value, with reference r:
+//   d = (t_sum - r) mod 2^48, sign extended from bit 47 as (d ^ 2^47) - 2^47
+//   time = r + d
+// Only 64-bit add/sub/and/xor, so SSE2-level instructions suffice on x86 and
+// plain NEON on ARMv7. The lanes are independent, leftovers go scalar.
+//
+// =================================================================================
+#include "tdc_unwrap.hpp"
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TDC_UNWRAP_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TDC_UNWRAP_NEON 1
+#endif
+
+namespace tdc_decode {
+
+static void unwrapScalar(const uint64_t* t_sum, size_t n, int64_t ref, int64_t* time)
+{
+    for (size_t i = 0; i < n; ++i)
+        time[i] = TsumUnwrapper::unwrapValue(t_sum[i], ref);
+}
+
+static void unwrapTail(const uint64_t* t_sum, size_t done, size_t n, int64_t ref, int64_t* time)
+{
+    unwrapScalar(t_sum + done, n - done, ref, time + done);
+}
+
+#ifdef TDC_UNWRAP_X86
+
+// 4 values per iteration
+__attribute__((target("sse4.1")))
+static void unwrapSse4(const uint64_t* t_sum, size_t n, int64_t ref, int64_t* time)
+{
+    const __m128i mask = _mm_set1_epi64x((long long)T_SUM_MASK);
+    const __m128i half = _mm_set1_epi64x((long long)T_SUM_HALF);
+    const __m128i r = _mm_set1_epi64x(ref);
+    const __m128i base = _mm_sub_epi64(r, half);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(t_sum + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(t_sum + i + 2));
+        a = _mm_xor_si128(_mm_and_si128(_mm_sub_epi64(a, r), mask), half);
+        b = _mm_xor_si128(_mm_and_si128(_mm_sub_epi64(b, r), mask), half);
+        _mm_storeu_si128((__m128i*)(time + i), _mm_add_epi64(base, a));
+        _mm_storeu_si128((__m128i*)(time + i + 2), _mm_add_epi64(base, b));
+    }
+    unwrapTail(t_sum, i, n, ref, time);
+}
+
+// 8 values per iteration
+__attribute__((target("avx2")))
+static void unwrapAvx2(const uint64_t* t_sum, size_t n, int64_t ref, int64_t* time)
+{
+    const __m256i mask = _mm256_set1_epi64x((long long)T_SUM_MASK);
+    const __m256i half = _mm256_set1_epi64x((long long)T_SUM_HALF);
+    const __m256i r = _mm256_set1_epi64x(ref);
+    const __m256i base = _mm256_sub_epi64(r, half);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(t_sum + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(t_sum + i + 4));
+        a = _mm256_xor_si256(_mm256_and_si256(_mm256_sub_epi64(a, r), mask), half);
+        b = _mm256_xor_si256(_mm256_and_si256(_mm256_sub_epi64(b, r), mask), half);
+        _mm256_storeu_si256((__m256i*)(time + i), _mm256_add_epi64(base, a));
+        _mm256_storeu_si256((__m256i*)(time + i + 4), _mm256_add_epi64(base, b));
+    }
+    unwrapTail(t_sum, i, n, ref, time);
+}
+
+#endif // TDC_UNWRAP_X86
+
+#ifdef TDC_UNWRAP_NEON
+
+// 4 values per iteration
+static void unwrapNeon(const uint64_t* t_sum, size_t n, int64_t ref, int64_t* time)
+{
+    const uint64x2_t mask = vdupq_n_u64(T_SUM_MASK);
+    const uint64x2_t half = vdupq_n_u64(T_SUM_HALF);
+    const uint64x2_t r = vdupq_n_u64((uint64_t)ref);
+    const uint64x2_t base = vsubq_u64(r, half);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint64x2_t a = vld1q_u64(t_sum + i);
+        uint64x2_t b = vld1q_u64(t_sum + i + 2);
+        a = veorq_u64(vandq_u64(vsubq_u64(a, r), mask), half);
+        b = veorq_u64(vandq_u64(vsubq_u64(b, r), mask), half);
+        vst1q_s64(time + i, vreinterpretq_s64_u64(vaddq_u64(base, a)));
+        vst1q_s64(time + i + 2, vreinterpretq_s64_u64(vaddq_u64(base, b)));
+    }
+    unwrapTail(t_sum, i, n, ref, time);
+}
+
+#endif // TDC_UNWRAP_NEON
+
+TsumUnwrapper::TsumUnwrapper(Kernel kernel)
+{
+    if (kernel == Kernel::AUTO)
+        kernel = bestKernel();
+    else if (!kernelAvailable(kernel))
+        throw std::invalid_argument(std::string("Unwrap kernel not available: ") + kernelName(kernel));
+    m_kernel = kernel;
+    switch (kernel)
+    {
+#ifdef TDC_UNWRAP_X86
+    case Kernel::SSE4: m_fn = unwrapSse4; break;
+    case Kernel::AVX2: m_fn = unwrapAvx2; break;
+#endif
+#ifdef TDC_UNWRAP_NEON
+    case Kernel::NEON: m_fn = unwrapNeon; break;
+#endif
+    default: m_fn = unwrapScalar; break;
+    }
+}
+
+void TsumUnwrapper::unwrap(const uint64_t* t_sum, size_t n, int64_t* time)
+{
+    if (n == 0)
+        return;
+    m_fn(t_sum, n, blockReference(t_sum[0]), time);
+    m_reference = time[n - 1];
+}
+
+} // namespace tdc_decode
@@ -0,0 +1,96 @@
+// =================================================================================
+// FILE: tdc_unwrap.hpp
+//
+// DESCRIPTION:
+// Streaming unwrapper for t_sum, the low 48 bits of t1 + t2 in coincidence
+// words. Restores the full sum on a 64-bit axis that does not wrap, carrying
+// the epoch from one DMA block to the next.
+//
+// The unwrapped value is t1 + t2 itself, i.e. the mean event time (t1+t2)/2
+// in half fine bins (0.125 ns). This keeps the half bin that a division by
+// two would drop. In mean time the 48 bits span 2^48 half bins, about 9.8 h,
+// and t_sum wraps at that period.
+//
+// Each value is placed within +-2^47 half bins (about 4.9 h) of a reference,
+// which is the last event of the previous block. One reference per block makes
+// the whole block a data-parallel pass (SSE4.1, AVX2, NEON, as in
+// tdc_decode.hpp). Events a trigger arbiter delivers slightly out of order
+// come out in the same order with their correct times, they only need to lie
+// inside that window. Gaps without events longer than 4.9 h cannot be
+// unwrapped: call setReference() with a known time after such a pause.
+//
+// Usage:
+//   tdc_decode::TsumUnwrapper unwrap;
+//   for each block:
+//       tdc_decode::decodeBlock(block.data, block.len, cols);
+//       unwrap.unwrap(cols.t_sum, n, time);       // time may be cols.t_sum
+//   double ns = tdc_decode::TsumUnwrapper::toNs(time[i]);
+//
+// =================================================================================
+#ifndef TDC_UNWRAP_HPP
+#define TDC_UNWRAP_HPP
+
+#include "tdc_decode.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace tdc_decode {
+
+// Unwrapped time unit: half a fine bin of the mean time
+constexpr int64_t UNWRAPPED_PS = 125;
+constexpr double UNWRAPPED_NS = UNWRAPPED_PS / 1000.0;
+// Window of the unwrap, +-T_SUM_HALF around the reference
+constexpr uint64_t T_SUM_HALF = 1ULL << (T_SUM_BITS - 1);
+
+class TsumUnwrapper {
+public:
+    // Throws std::invalid_argument if the kernel is not available
+    explicit TsumUnwrapper(Kernel kernel = Kernel::AUTO);
+
+    // Unwraps n t_sum values into time. Raw coincidence words work as well,
+    // the bits above t_sum are ignored. time may alias t_sum.
+    void unwrap(const uint64_t* t_sum, size_t n, int64_t* time);
+
+    // Next event starts at epoch 0, as at the start of a run
+    void reset() { m_primed = false; }
+    // Next events are placed around this time, e.g. to line up several boards
+    // or after a long pause
+    void setReference(int64_t time)
+    {
+        m_reference = time;
+        m_primed = true;
+    }
+    // Time of the last event unwrapped, or the one set
+    int64_t reference() const { return m_reference; }
+    Kernel kernel() const { return m_kernel; }
+
+    // For kernels that unwrap inline (tdc_calib.hpp): the reference for a
+    // block that starts with first_t_sum, primed on the first block. Finish
+    // the block with setReference() of its last time.
+    int64_t blockReference(uint64_t first_t_sum)
+    {
+        if (!m_primed)
+            setReference((int64_t)(first_t_sum & T_SUM_MASK));
+        return m_reference;
+    }
+    // One value against a reference: r + sext48(t_sum - r)
+    static int64_t unwrapValue(uint64_t t_sum, int64_t reference)
+    {
+        uint64_t d = ((t_sum - (uint64_t)reference) & T_SUM_MASK) ^ T_SUM_HALF;
+        return (int64_t)((uint64_t)reference + d - T_SUM_HALF);
+    }
+
+    static double toNs(int64_t time) { return time * UNWRAPPED_NS; }
+
+private:
+    typedef void (*KernelFn)(const uint64_t*, size_t, int64_t, int64_t*);
+
+    Kernel m_kernel;
+    KernelFn m_fn;
+    int64_t m_reference = 0;
+    bool m_primed = false;
+};
+
+} // namespace tdc_decode
+
+#endif // TDC_UNWRAP_HPP